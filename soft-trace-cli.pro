@@ -0,0 +1,22 @@
+# Headless batch renderer, no Qt modules nor OpenGL context
+QT -= core gui
+CONFIG += console
+CONFIG -= app_bundle qt
+TEMPLATE = app
+TARGET = ./bin/soft-trace-cli
+# Add GLM to the INCLUDEPATH
+INCLUDEPATH += /usr/include/glm
+INCLUDEPATH += ./src
+OBJECTS_DIR=./build/cli/obj
+
+DEFINES += SOFT_TRACE_HEADLESS
+
+#adding openMP
+QMAKE_CXXFLAGS+= -fopenmp -Wall
+CONFIG += c++17
+LIBS += -fopenmp
+
+# Input
+include(soft-trace-core.pri)
+
+SOURCES += src/cli.cpp
@@ -0,0 +1,65 @@
+# Tracing core, shared by the Qt application and the headless batch renderer
+# Must not depend on Qt nor on an OpenGL context when SOFT_TRACE_HEADLESS is defined
+
+HEADERS += src/AABB.h \
+           src/AccumulationBuffer.h \
+           src/BVH.h \
+           src/BVHCache.h \
+           src/BVHLeaves.h \
+           src/CancellationToken.h \
+           src/CollisionInfo.h \
+           src/Instance.h \
+           src/Light.h \
+           src/MappedFile.h \
+           src/Material.h \
+           src/Math.h \
+           src/Mesh.h \
+           src/ObjParser.h \
+           src/Random.h \
+           src/Ray.h \
+           src/Raytracer.h \
+           src/RenderJob.h \
+           src/RenderParameters.h \
+           src/RGBAImage.h \
+           src/RGBAValue.h \
+           src/Sampler.h \
+           src/Scene.h \
+           src/SceneCache.h \
+           src/SurfaceElement.h \
+           src/ThreeDModel.h \
+           src/TileScheduler.h \
+           src/TopLevelBVH.h \
+           src/Triangle.h \
+           src/TrianglePacket.h \
+           src/WideBVH.h
+
+SOURCES += src/AABB.cpp \
+           src/AccumulationBuffer.cpp \
+           src/BVH.cpp \
+           src/BVHCache.cpp \
+           src/CancellationToken.cpp \
+           src/CollisionInfo.cpp \
+           src/Instance.cpp \
+           src/Light.cpp \
+           src/MappedFile.cpp \
+           src/Material.cpp \
+           src/Math.cpp \
+           src/Mesh.cpp \
+           src/ObjParser.cpp \
+           src/Random.cpp \
+           src/Ray.cpp \
+           src/Raytracer.cpp \
+           src/RenderJob.cpp \
+           src/RenderParameters.cpp \
+           src/RGBAImage.cpp \
+           src/RGBAValue.cpp \
+           src/Sampler.cpp \
+           src/Scene.cpp \
+           src/SceneCache.cpp \
+           src/SurfaceElement.cpp \
+           src/ThreeDModel.cpp \
+           src/TileScheduler.cpp \
+           src/TopLevelBVH.cpp \
+           src/Triangle.cpp \
+           src/TrianglePacket.cpp \
+           src/WideBVH.cpp
@@ -24,41 +24,19 @@ CONFIG += c++17
 LIBS += -fopenmp
 
 # Input
+include(soft-trace-core.pri)
+
 HEADERS += src/ArcBall.h \
            src/ArcBallWidget.h \
-           src/Light.h \
-           src/Material.h \
-           src/Math.h \
-           src/Random.h \
-           src/Ray.h \
            src/RaytraceRenderWidget.h \
            src/RenderController.h \
-           src/RenderParameters.h \
            src/RenderWidget.h \
-           src/RenderWindow.h \
-           src/RGBAImage.h \
-           src/RGBAValue.h \
-           src/Scene.h \
-           src/SurfaceElement.h \
-           src/ThreeDModel.h \
-           src/Triangle.h
+           src/RenderWindow.h
 
 SOURCES += src/ArcBall.cpp \
            src/ArcBallWidget.cpp \
-           src/Light.cpp \
-           src/Material.cpp \
-           src/Math.cpp \
-           src/Random.cpp \
-           src/Ray.cpp \
-           src/RenderParameters.cpp \
-           src/Scene.cpp \
-           src/SurfaceElement.cpp \
-           src/ThreeDModel.cpp \
-           src/Triangle.cpp \
            src/main.cpp \
            src/RaytraceRenderWidget.cpp \
            src/RenderController.cpp \
            src/RenderWidget.cpp \
-           src/RenderWindow.cpp \
-           src/RGBAImage.cpp \
-           src/RGBAValue.cpp
+           src/RenderWindow.cpp
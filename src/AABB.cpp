@@ -0,0 +1,102 @@
+#include "AABB.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "Math.h"
+
+AABB::AABB()
+    : min(std::numeric_limits<float>::infinity()),
+      max(-std::numeric_limits<float>::infinity()) {
+}
+
+AABB::AABB(const glm::vec3& min, const glm::vec3& max)
+    : min(min),
+      max(max) {
+}
+
+void AABB::extend(const glm::vec3& point) {
+    min = {std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z)};
+    max = {std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z)};
+}
+
+void AABB::extend(const AABB& other) {
+    // Component-wise, so that extending by an empty box is a no-op
+    min = {std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z)};
+    max = {std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z)};
+}
+
+/**
+ * @return the part of the box also in other, empty if they do not overlap
+ */
+AABB AABB::intersection(const AABB& other) const {
+    return {{std::max(min.x, other.min.x), std::max(min.y, other.min.y), std::max(min.z, other.min.z)},
+            {std::min(max.x, other.max.x), std::min(max.y, other.max.y), std::min(max.z, other.max.z)}};
+}
+
+bool AABB::isEmpty() const {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+glm::vec3 AABB::centroid() const {
+    return (min + max) * 0.5f;
+}
+
+glm::vec3 AABB::extent() const {
+    return max - min;
+}
+
+/**
+ * @return the surface area of the box, 0 if the box is empty
+ */
+float AABB::surfaceArea() const {
+    if (isEmpty()) {
+        return 0.0f;
+    }
+
+    glm::vec3 e = extent();
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+/**
+ * @return index of the axis {x = 0, y = 1, z = 2} along which the box is the longest
+ */
+int AABB::longestAxis() const {
+    glm::vec3 e = extent();
+
+    if (e.x > e.y && e.x > e.z) {
+        return 0;
+    }
+
+    return e.y > e.z ? 1 : 2;
+}
+
+/**
+ * @brief AABB::intersect performs the slab test of the ray against the box.
+ *
+ * @param ray to test against the box
+ * @param inverseDirection 1 / ray.direction, precomputed once per ray
+ * @param tMax distance beyond which hits are discarded
+ *
+ * @return the entry t of the ray into the box, NO_INTERSECT if the box is missed or further than tMax
+ */
+float AABB::intersect(const Ray& ray, const glm::vec3& inverseDirection, float tMax) const {
+    float tNear = -std::numeric_limits<float>::infinity();
+    float tFar = std::numeric_limits<float>::infinity();
+
+    for (int axis = 0; axis < 3; axis++) {
+        float t1 = (min[axis] - ray.origin[axis]) * inverseDirection[axis];
+        float t2 = (max[axis] - ray.origin[axis]) * inverseDirection[axis];
+
+        // Ordering of the arguments discards NaNs from 0 * inf when the origin lies on a slab
+        tNear = std::max(tNear, std::min(t1, t2));
+        tFar = std::min(tFar, std::max(t1, t2));
+    }
+
+    // Box is behind the ray, missed, or further than the current closest hit
+    if (tFar < tNear || tFar <= 0.0f || tNear >= tMax) {
+        return NO_INTERSECT;
+    }
+
+    return std::max(tNear, 0.0f);
+}
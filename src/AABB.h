@@ -0,0 +1,37 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <glm/vec3.hpp>
+
+#include "Ray.h"
+
+// Axis-aligned bounding box, starts empty (min = +inf, max = -inf)
+class AABB {
+public:
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB();
+
+    AABB(const glm::vec3& min, const glm::vec3& max);
+
+    void extend(const glm::vec3& point);
+
+    void extend(const AABB& other);
+
+    AABB intersection(const AABB& other) const;
+
+    bool isEmpty() const;
+
+    glm::vec3 centroid() const;
+
+    glm::vec3 extent() const;
+
+    float surfaceArea() const;
+
+    int longestAxis() const;
+
+    float intersect(const Ray& ray, const glm::vec3& inverseDirection, float tMax) const;
+};
+
+#endif // AABB_H
@@ -0,0 +1,176 @@
+#include "AccumulationBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define GAMMA 2.2f
+// Two-sided 95% quantile of the normal distribution, half width of the confidence interval in standard errors
+#define CONFIDENCE_Z 1.96f
+// Luminance under which the confidence interval is compared with this luminance instead of the mean,
+// so that black pixels converge
+#define CONVERGENCE_LUMINANCE_FLOOR 0.01f
+
+RGBAValue toneMap(const glm::vec3& colour) {
+    // We already calculate everything in float, so we just do gamma correction
+    // before putting it integer format.
+    return RGBAValue(
+        std::pow(std::max(colour.r, 0.0f), 1.0f / GAMMA) * 255.0f,
+        std::pow(std::max(colour.g, 0.0f), 1.0f / GAMMA) * 255.0f,
+        std::pow(std::max(colour.b, 0.0f), 1.0f / GAMMA) * 255.0f,
+        255.0f);
+}
+
+float luminance(const glm::vec3& colour) {
+    return 0.2126f * colour.r + 0.7152f * colour.g + 0.0722f * colour.b;
+}
+
+AccumulationBuffer::AccumulationBuffer()
+    : width(0),
+      height(0),
+      samples(0) {
+}
+
+void AccumulationBuffer::resize(long width, long height) {
+    this->width = width;
+    this->height = height;
+    sums.assign(static_cast<unsigned long>(width * height), glm::vec3(0.0f));
+    luminanceSquares.assign(static_cast<unsigned long>(width * height), 0.0f);
+    counts.assign(static_cast<unsigned long>(width * height), 0);
+    samples = 0;
+}
+
+void AccumulationBuffer::clear() {
+    std::fill(sums.begin(), sums.end(), glm::vec3(0.0f));
+    std::fill(luminanceSquares.begin(), luminanceSquares.end(), 0.0f);
+    std::fill(counts.begin(), counts.end(), 0);
+    samples = 0;
+}
+
+glm::vec3* AccumulationBuffer::operator[](const int rowIndex) {
+    return sums.data() + rowIndex * width;
+}
+
+const glm::vec3* AccumulationBuffer::operator[](const int rowIndex) const {
+    return sums.data() + rowIndex * width;
+}
+
+/**
+ * @brief AccumulationBuffer::add adds a sample to pixel (col, row), samples is counted by the caller once per pass
+ */
+void AccumulationBuffer::add(const int row, const int col, const glm::vec3& sample) {
+    const long index = row * width + col;
+    const float sampleLuminance = luminance(sample);
+
+    sums[index] += sample;
+    luminanceSquares[index] += sampleLuminance * sampleLuminance;
+    counts[index]++;
+}
+
+/**
+ * @return the number of samples accumulated on pixel (col, row)
+ */
+unsigned int AccumulationBuffer::sampleCount(const int row, const int col) const {
+    return counts[row * width + col];
+}
+
+/**
+ * @return the number of samples accumulated on all the pixels
+ */
+unsigned long long AccumulationBuffer::totalSamples() const {
+    unsigned long long total = 0;
+    for (unsigned int count : counts) {
+        total += count;
+    }
+    return total;
+}
+
+/**
+ * @return the average of the samples of pixel (col, row), black if it has none
+ */
+glm::vec3 AccumulationBuffer::mean(const int row, const int col) const {
+    const long index = row * width + col;
+    return counts[index] > 0 ? sums[index] / static_cast<float>(counts[index]) : glm::vec3(0.0f);
+}
+
+/**
+ * @return the unbiased variance of the luminance of the samples of pixel (col, row),
+ *         0 until at least 2 samples are accumulated
+ */
+float AccumulationBuffer::variance(const int row, const int col) const {
+    const long index = row * width + col;
+
+    if (counts[index] < 2) {
+        return 0.0f;
+    }
+
+    const float n = static_cast<float>(counts[index]);
+    const float mean = luminance(sums[index]) / n;
+
+    return std::max(0.0f, (luminanceSquares[index] - n * mean * mean) / (n - 1.0f));
+}
+
+/**
+ * @brief AccumulationBuffer::converged tells whether the mean luminance of pixel (col, row) is known closely enough:
+ *        its 95% confidence interval is within threshold of it, relatively.
+ *        The error of a gamma corrected value is proportional to the relative error of the linear one,
+ *        so the same threshold gives the same visible noise in bright and dark pixels.
+ *
+ * @return false until at least 2 samples are accumulated
+ */
+bool AccumulationBuffer::converged(const int row, const int col, const float threshold) const {
+    const long index = row * width + col;
+
+    if (counts[index] < 2) {
+        return false;
+    }
+
+    const float n = static_cast<float>(counts[index]);
+    const float mean = luminance(sums[index]) / n;
+    const float halfWidth = CONFIDENCE_Z * std::sqrt(variance(row, col) / n);
+
+    return halfWidth <= threshold * std::max(mean, CONVERGENCE_LUMINANCE_FLOOR);
+}
+
+/**
+ * @brief AccumulationBuffer::toneMap writes the average of the accumulated samples of every pixel into image
+ *
+ * @param image of the same size as the buffer
+ */
+void AccumulationBuffer::toneMap(RGBAImage& image) const {
+    if (samples == 0) {
+        return;
+    }
+
+    // clang-format off
+#pragma omp parallel for
+    // clang-format on
+    for (int row = 0; row < height; row++) {
+        for (int col = 0; col < width; col++) {
+            const unsigned int count = std::max(1u, counts[row * width + col]);
+            image[row][col] = ::toneMap((*this)[row][col] * (1.0f / static_cast<float>(count)));
+        }
+    }
+}
+
+/**
+ * @brief AccumulationBuffer::sampleHeatmap draws the samples accumulated on every pixel into image,
+ *        from black for none through blue, green and yellow to red for maxSamples or more
+ *
+ * @param image of the same size as the buffer
+ */
+void AccumulationBuffer::sampleHeatmap(RGBAImage& image, const unsigned int maxSamples) const {
+    const glm::vec3 ramp[] = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f},
+                              {1.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}};
+    const int steps = sizeof(ramp) / sizeof(ramp[0]) - 1;
+
+    for (int row = 0; row < height; row++) {
+        for (int col = 0; col < width; col++) {
+            const float t = std::min(1.0f, static_cast<float>(counts[row * width + col])
+                                           / static_cast<float>(std::max(1u, maxSamples))) * steps;
+            const int step = std::min(static_cast<int>(t), steps - 1);
+            const glm::vec3 colour = ramp[step] + (t - static_cast<float>(step)) * (ramp[step + 1] - ramp[step]);
+
+            image[row][col] = RGBAValue(colour.r * 255.0f, colour.g * 255.0f, colour.b * 255.0f, 255.0f);
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef ACCUMULATION_BUFFER_H
+#define ACCUMULATION_BUFFER_H
+
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include "RGBAImage.h"
+
+// Gamma corrected and clamped 8-bit value of a linear HDR colour
+RGBAValue toneMap(const glm::vec3& colour);
+
+// Rec. 709 relative luminance of a linear colour
+float luminance(const glm::vec3& colour);
+
+/*
+ * Float RGB buffer accumulating the sum of the samples of every pixel
+ * Used by progressive rendering, one sample per pixel is added on every pass,
+ * and by Monte Carlo renders, which add all the samples of a pixel at once
+ * The squares of the luminances of the samples are summed too, giving the variance of every pixel
+ * Pixels are counted separately, adaptive sampling stops adding samples to the pixels that converged
+ */
+class AccumulationBuffer {
+public:
+    long width, height;
+
+    // number of progressive passes accumulated, the most samples accumulated on a pixel
+    unsigned int samples;
+
+    AccumulationBuffer();
+
+    void resize(long width, long height);
+
+    void clear();
+
+    glm::vec3* operator[](int rowIndex);
+
+    const glm::vec3* operator[](int rowIndex) const;
+
+    void add(int row, int col, const glm::vec3& sample);
+
+    unsigned int sampleCount(int row, int col) const;
+
+    unsigned long long totalSamples() const;
+
+    glm::vec3 mean(int row, int col) const;
+
+    float variance(int row, int col) const;
+
+    bool converged(int row, int col, float threshold) const;
+
+    void toneMap(RGBAImage& image) const;
+
+    void sampleHeatmap(RGBAImage& image, unsigned int maxSamples) const;
+
+private:
+    std::vector<glm::vec3> sums;
+    std::vector<float> luminanceSquares;
+    std::vector<unsigned int> counts;
+};
+
+#endif // ACCUMULATION_BUFFER_H
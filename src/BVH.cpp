@@ -0,0 +1,1242 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <omp.h>
+
+#include "Math.h"
+#include "BVHLeaves.h"
+
+// Number of bins used to evaluate the SAH along each axis
+#define BVH_BINS 12
+// Relative cost of traversing a node with respect to intersecting a triangle
+#define BVH_TRAVERSAL_COST 1.0f
+
+// Nodes with more primitives than this have their two subtrees built as parallel tasks
+#define BVH_TASK_PRIMITIVES 4096
+// Nodes with more primitives than this are bounded, binned and partitioned by parallel tasks
+#define BVH_PARALLEL_PRIMITIVES 65536
+// Primitives handled by each of those tasks, fixed so that the hierarchy does not depend on the thread count
+#define BVH_CHUNK_PRIMITIVES 16384
+
+// Bits of the Morton codes of the linear BVH per axis, 30 bits in total
+#define LBVH_MORTON_BITS 10
+// Bits of the Morton codes sorted by each pass of the radix sort
+#define LBVH_RADIX_BITS 10
+// Ranges of at most this many primitives become leaves of the linear BVH
+#define LBVH_LEAF_PRIMITIVES 4
+
+// Number of bins used to evaluate spatial splits along each axis
+#define SBVH_BINS 32
+// Spatial splits may add up to this many references per triangle, over the whole hierarchy
+#define SBVH_MAX_DUPLICATION 0.5f
+// Spatial splits are only looked for where the children of the best object split overlap by more than
+// this fraction of the surface area of the root
+#define SBVH_MIN_OVERLAP 1e-5f
+
+// Primitives binned along one axis, see BVH::findBestSplit
+struct SAHBin {
+    AABB bounds;
+    unsigned int count = 0;
+};
+
+// Bins of all 3 axes
+struct SAHBins {
+    SAHBin axes[3][BVH_BINS];
+};
+
+bool BVHNode::isLeaf() const {
+    return count > 0;
+}
+
+/**
+ * @brief BVH::BuildState::reached records that a node was created at depth
+ */
+void BVH::BuildState::reached(const unsigned int depth) {
+    unsigned int deepest = maxDepth.load();
+    while (deepest < depth && !maxDepth.compare_exchange_weak(deepest, depth)) {
+    }
+}
+
+/**
+ * @brief BVH::BuildState::allocatePair takes two consecutive nodes for the children of a node
+ *
+ * @return the index of the first of them
+ */
+unsigned int BVH::BuildState::allocatePair() {
+    return nodeCount.fetch_add(2);
+}
+
+/**
+ * @brief chunkCount number of chunks of BVH_CHUNK_PRIMITIVES the given number of primitives is split into
+ */
+static unsigned int chunkCount(const unsigned int primitives) {
+    return (primitives + BVH_CHUNK_PRIMITIVES - 1) / BVH_CHUNK_PRIMITIVES;
+}
+
+/**
+ * @brief forEachChunk calls chunk(c, begin, end) on every chunk c of [first, first + count) as a task,
+ *        and waits for all of them. Tasks run on the enclosing parallel region, if any.
+ */
+template<typename Chunk>
+static void forEachChunk(const unsigned int first, const unsigned int count, const Chunk& chunk) {
+    const unsigned int chunks = chunkCount(count);
+    for (unsigned int c = 0; c < chunks; c++) {
+        const unsigned int begin = first + c * BVH_CHUNK_PRIMITIVES;
+        const unsigned int end = std::min(first + count, begin + BVH_CHUNK_PRIMITIVES);
+
+        // clang-format off
+#pragma omp task default(shared) firstprivate(c, begin, end)
+        // clang-format on
+        chunk(c, begin, end);
+    }
+    // clang-format off
+#pragma omp taskwait
+    // clang-format on
+}
+
+/**
+ * @brief inParallel calls build from a parallel region, so that the tasks it spawns have threads to run on.
+ *        Builds that are already in one, such as those of several meshes at once, join it instead.
+ *
+ * @param primitives built over, small builds are not worth starting threads for
+ */
+template<typename Build>
+static void inParallel(const std::size_t primitives, const Build& build) {
+    if (primitives <= BVH_TASK_PRIMITIVES || omp_in_parallel()) {
+        build();
+        return;
+    }
+
+    // clang-format off
+#pragma omp parallel
+#pragma omp single
+    // clang-format on
+    build();
+}
+
+/**
+ * @brief expandBits spreads the lower 10 bits of value 3 bits apart, to interleave them with 2 other axes
+ */
+static std::uint32_t expandBits(std::uint32_t value) {
+    value = (value * 0x00010001u) & 0xFF0000FFu;
+    value = (value * 0x00000101u) & 0x0F00F00Fu;
+    value = (value * 0x00000011u) & 0xC30C30C3u;
+    value = (value * 0x00000005u) & 0x49249249u;
+    return value;
+}
+
+/**
+ * @brief mortonCode interleaves the bits of point quantised within bounds, so that points close along
+ *        the Z-order curve have close codes
+ */
+static std::uint32_t mortonCode(const glm::vec3& point, const AABB& bounds) {
+    const float cells = static_cast<float>(1u << LBVH_MORTON_BITS);
+    const glm::vec3 extent = bounds.extent();
+
+    std::uint32_t axes[3];
+    for (int a = 0; a < 3; a++) {
+        float position = extent[a] > 0.0f ? (point[a] - bounds.min[a]) / extent[a] : 0.0f;
+        axes[a] = static_cast<std::uint32_t>(std::clamp(position * cells, 0.0f, cells - 1.0f));
+    }
+
+    return (expandBits(axes[0]) << 2) | (expandBits(axes[1]) << 1) | expandBits(axes[2]);
+}
+
+/**
+ * @brief clipTriangle bounds the part of triangle between lower and upper along axis, and within box
+ *
+ * @return an empty box if the triangle does not reach between the planes
+ */
+static AABB clipTriangle(const Triangle& triangle, const int axis, const float lower, const float upper, const AABB& box) {
+    AABB clipped;
+
+    for (int i = 0; i < 3; i++) {
+        const glm::vec3 start = perspective(triangle.vertices[i]);
+        const glm::vec3 end = perspective(triangle.vertices[(i + 1) % 3]);
+
+        if (lower <= start[axis] && start[axis] <= upper) {
+            clipped.extend(start);
+        }
+
+        // Points where the edge crosses either plane
+        for (const float plane : {lower, upper}) {
+            if ((start[axis] < plane && plane < end[axis]) || (end[axis] < plane && plane < start[axis])) {
+                glm::vec3 crossing = start + (end - start) * ((plane - start[axis]) / (end[axis] - start[axis]));
+                crossing[axis] = plane;
+                clipped.extend(crossing);
+            }
+        }
+    }
+
+    return clipped.intersection(box);
+}
+
+BVH::BVH()
+    : maxDepth(0),
+      duplicateCount(0) {
+}
+
+/**
+ * @brief BVH::build constructs the hierarchy over triangles, with the given algorithm.
+ *        The triangles are reordered so that every leaf references a contiguous range.
+ *
+ * @param triangles to build the hierarchy over, reordered in place
+ * @param builder binned SAH for the fastest traversals, linear for the fastest builds
+ * @param sourceOrder set to the index in the original triangles of every triangle after the build, if not null
+ */
+void BVH::build(std::vector<Triangle>& triangles, const BVHBuilder builder, std::vector<unsigned int>* sourceOrder) {
+    if (builder == BVHBuilder::Spatial) {
+        std::vector<unsigned int> spatialOrder;
+        buildSpatial(triangles, spatialOrder);
+        if (sourceOrder != nullptr) {
+            sourceOrder->swap(spatialOrder);
+        }
+        return;
+    }
+
+    const auto count = static_cast<unsigned int>(triangles.size());
+    std::vector<AABB> bounds(count);
+    std::vector<unsigned int> order(count);
+
+    inParallel(count, [&]() {
+        forEachChunk(0, count, [&](unsigned int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                bounds[i] = triangles[i].bounds();
+                order[i] = i;
+            }
+        });
+    });
+
+    build(bounds, order, builder);
+
+    // Apply the final ordering so leaves index the triangles directly
+    reorder(triangles, order);
+
+    if (sourceOrder != nullptr) {
+        sourceOrder->swap(order);
+    }
+}
+
+/**
+ * @brief BVH::reorder puts triangles in the order of the leaves of a hierarchy, as its build did
+ *
+ * @param order index in triangles of every triangle of the leaves, triangles may appear more than once
+ */
+void BVH::reorder(std::vector<Triangle>& triangles, const std::vector<unsigned int>& order) {
+    const auto count = static_cast<unsigned int>(order.size());
+    std::vector<Triangle> ordered(count);
+
+    inParallel(count, [&]() {
+        forEachChunk(0, count, [&](unsigned int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                ordered[i] = triangles[order[i]];
+            }
+        });
+    });
+    triangles.swap(ordered);
+}
+
+/**
+ * @brief BVH::restore adopts the nodes of a hierarchy built earlier, see BVHCache
+ *
+ * @param cachedNodes taken over, left empty
+ * @param depth of the hierarchy
+ * @param duplicates triangles it references more than once
+ */
+void BVH::restore(std::vector<BVHNode>& cachedNodes, const unsigned int depth, const unsigned int duplicates) {
+    nodes.swap(cachedNodes);
+    cachedNodes.clear();
+    maxDepth = depth;
+    duplicateCount = duplicates;
+}
+
+/**
+ * @brief BVH::build constructs the hierarchy over arbitrary primitives, given their bounds.
+ *        Leaves reference contiguous ranges of order rather than the primitives themselves.
+ *        Subtrees are built as OpenMP tasks, the hierarchy is the same whatever the number of threads.
+ *
+ * @param bounds of every primitive, indexed by primitive
+ * @param order the primitives to build the hierarchy over, reordered in place
+ * @param builder binned SAH for the fastest traversals, linear for the fastest builds.
+ *        Spatial splits need the triangles themselves, primitives only known by their bounds use object splits only.
+ */
+void BVH::build(const std::vector<AABB>& bounds, std::vector<unsigned int>& order, const BVHBuilder builder) {
+    nodes.clear();
+    maxDepth = 0;
+    duplicateCount = 0;
+
+    if (order.empty()) {
+        return;
+    }
+
+    // A binary tree with N leaves has at most 2N - 1 nodes, allocated upfront so that tasks can take
+    // nodes from them concurrently without them moving
+    nodes.resize(2 * order.size() - 1);
+
+    BuildState state;
+    state.nodeCount = 1;
+    state.maxDepth = 0;
+
+    nodes[0].leftFirst = 0;
+    nodes[0].count = static_cast<unsigned int>(order.size());
+
+    inParallel(order.size(), [&]() {
+        if (builder == BVHBuilder::Linear) {
+            buildLinear(bounds, order, state);
+        } else {
+            subdivide(0, bounds, order, 1, state);
+        }
+    });
+
+    nodes.resize(state.nodeCount);
+    nodes.shrink_to_fit();
+    maxDepth = state.maxDepth;
+}
+
+/**
+ * @brief BVH::subdivide splits a node on the best binned SAH plane, and its children in turn.
+ *        Large children are subdivided as parallel tasks.
+ *
+ * @param nodeIndex node over a range of order, which becomes interior if it is worth splitting
+ * @param depth of the node, the root being at depth 1
+ * @param state shared by the tasks of the build
+ */
+void BVH::subdivide(unsigned int nodeIndex,
+                    const std::vector<AABB>& bounds,
+                    std::vector<unsigned int>& order,
+                    unsigned int depth,
+                    BuildState& state) {
+    state.reached(depth);
+
+    BVHNode& node = nodes[nodeIndex];
+
+    AABB centroidBounds;
+    boundRange(node.leftFirst, node.count, bounds, order, node.bounds, centroidBounds);
+
+    if (node.count <= 1 || depth >= BVH_MAX_DEPTH) {
+        return;
+    }
+
+    int axis;
+    float splitPosition;
+    float splitCost = findBestSplit(node, centroidBounds, bounds, order, axis, splitPosition);
+    float leafCost = static_cast<float>(node.count) * node.bounds.surfaceArea();
+
+    // Splitting is not worth it according to the SAH
+    if (axis < 0 || splitCost >= leafCost) {
+        return;
+    }
+
+    unsigned int leftCount = partition(node.leftFirst, node.count, bounds, order, axis, splitPosition);
+    if (leftCount == 0 || leftCount == node.count) {
+        return;
+    }
+
+    // Children are allocated as a pair, right = left + 1
+    const unsigned int leftIndex = state.allocatePair();
+
+    nodes[leftIndex].leftFirst = node.leftFirst;
+    nodes[leftIndex].count = leftCount;
+    nodes[leftIndex + 1].leftFirst = node.leftFirst + leftCount;
+    nodes[leftIndex + 1].count = node.count - leftCount;
+
+    const bool parallel = node.count > BVH_TASK_PRIMITIVES;
+
+    node.leftFirst = leftIndex;
+    node.count = 0;
+
+    if (parallel) {
+        // clang-format off
+#pragma omp task default(shared)
+        // clang-format on
+        subdivide(leftIndex, bounds, order, depth + 1, state);
+
+        subdivide(leftIndex + 1, bounds, order, depth + 1, state);
+
+        // clang-format off
+#pragma omp taskwait
+        // clang-format on
+    } else {
+        subdivide(leftIndex, bounds, order, depth + 1, state);
+        subdivide(leftIndex + 1, bounds, order, depth + 1, state);
+    }
+}
+
+/**
+ * @brief BVH::boundRange bounds a range of order, and the centroids in it. Large ranges are bounded in parallel.
+ *
+ * @param box set to the bounds of the primitives in the range
+ * @param centroidBox set to the bounds of their centroids
+ */
+void BVH::boundRange(const unsigned int first,
+                     const unsigned int count,
+                     const std::vector<AABB>& bounds,
+                     const std::vector<unsigned int>& order,
+                     AABB& box,
+                     AABB& centroidBox) {
+    auto bound = [&](unsigned int begin, unsigned int end, AABB& rangeBox, AABB& rangeCentroids) {
+        rangeBox = AABB();
+        rangeCentroids = AABB();
+        for (unsigned int i = begin; i < end; i++) {
+            rangeBox.extend(bounds[order[i]]);
+            rangeCentroids.extend(bounds[order[i]].centroid());
+        }
+    };
+
+    if (count <= BVH_PARALLEL_PRIMITIVES) {
+        bound(first, first + count, box, centroidBox);
+        return;
+    }
+
+    std::vector<AABB> chunkBoxes(chunkCount(count));
+    std::vector<AABB> chunkCentroids(chunkCount(count));
+    forEachChunk(first, count, [&](unsigned int c, unsigned int begin, unsigned int end) {
+        bound(begin, end, chunkBoxes[c], chunkCentroids[c]);
+    });
+
+    box = AABB();
+    centroidBox = AABB();
+    for (unsigned int c = 0; c < chunkBoxes.size(); c++) {
+        box.extend(chunkBoxes[c]);
+        centroidBox.extend(chunkCentroids[c]);
+    }
+}
+
+/**
+ * @brief BVH::findBestSplit bins the centroids of the node along each axis and evaluates the SAH
+ *        at every bin boundary. Large nodes are binned in parallel.
+ *
+ * @param centroidBounds bounds of the centroids of the primitives of the node
+ * @param axis set to the best axis, -1 if no split is possible
+ * @param splitPosition set to the position along axis of the best split plane
+ * @param leftBounds set to the bounds of the primitives before the plane, if not null
+ * @param rightBounds set to the bounds of the primitives after the plane, if not null
+ *
+ * @return the SAH cost of the best split, scaled by the area of the node
+ */
+float BVH::findBestSplit(const BVHNode& node,
+                         const AABB& centroidBounds,
+                         const std::vector<AABB>& bounds,
+                         const std::vector<unsigned int>& order,
+                         int& axis,
+                         float& splitPosition,
+                         AABB* leftBounds,
+                         AABB* rightBounds) const {
+    float scale[3];
+    for (int a = 0; a < 3; a++) {
+        float extent = centroidBounds.max[a] - centroidBounds.min[a];
+        // All centroids on the same plane, nothing to split along this axis, see below
+        scale[a] = extent < EPS ? 0.0f : BVH_BINS / extent;
+    }
+
+    // All 3 axes are binned in one pass over the primitives
+    auto binRange = [&](unsigned int begin, unsigned int end, SAHBins& bins) {
+        for (unsigned int i = begin; i < end; i++) {
+            const AABB& box = bounds[order[i]];
+            const glm::vec3 centroid = box.centroid();
+
+            for (int a = 0; a < 3; a++) {
+                int bin = std::min(BVH_BINS - 1, static_cast<int>((centroid[a] - centroidBounds.min[a]) * scale[a]));
+                bins.axes[a][bin].bounds.extend(box);
+                bins.axes[a][bin].count++;
+            }
+        }
+    };
+
+    SAHBins binned;
+
+    if (node.count <= BVH_PARALLEL_PRIMITIVES) {
+        binRange(node.leftFirst, node.leftFirst + node.count, binned);
+    } else {
+        std::vector<SAHBins> chunkBins(chunkCount(node.count));
+        forEachChunk(node.leftFirst, node.count, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            binRange(begin, end, chunkBins[c]);
+        });
+
+        for (const SAHBins& chunk : chunkBins) {
+            for (int a = 0; a < 3; a++) {
+                for (int b = 0; b < BVH_BINS; b++) {
+                    binned.axes[a][b].bounds.extend(chunk.axes[a][b].bounds);
+                    binned.axes[a][b].count += chunk.axes[a][b].count;
+                }
+            }
+        }
+    }
+
+    float bestCost = std::numeric_limits<float>::infinity();
+    int bestBin = 0;
+    axis = -1;
+    splitPosition = 0.0f;
+
+    for (int a = 0; a < 3; a++) {
+        if (scale[a] == 0.0f) {
+            continue;
+        }
+
+        const SAHBin* bins = binned.axes[a];
+
+        // Sweep from both sides, accumulating the area and count to each side of every plane
+        float leftArea[BVH_BINS - 1];
+        float rightArea[BVH_BINS - 1];
+        unsigned int leftCount[BVH_BINS - 1];
+        unsigned int rightCount[BVH_BINS - 1];
+
+        AABB leftBox;
+        AABB rightBox;
+        unsigned int leftSum = 0;
+        unsigned int rightSum = 0;
+
+        for (int i = 0; i < BVH_BINS - 1; i++) {
+            leftSum += bins[i].count;
+            leftCount[i] = leftSum;
+            leftBox.extend(bins[i].bounds);
+            leftArea[i] = leftBox.surfaceArea();
+
+            rightSum += bins[BVH_BINS - 1 - i].count;
+            rightCount[BVH_BINS - 2 - i] = rightSum;
+            rightBox.extend(bins[BVH_BINS - 1 - i].bounds);
+            rightArea[BVH_BINS - 2 - i] = rightBox.surfaceArea();
+        }
+
+        for (int i = 0; i < BVH_BINS - 1; i++) {
+            if (leftCount[i] == 0 || rightCount[i] == 0) {
+                continue;
+            }
+
+            float cost = BVH_TRAVERSAL_COST * node.bounds.surfaceArea()
+                         + static_cast<float>(leftCount[i]) * leftArea[i]
+                         + static_cast<float>(rightCount[i]) * rightArea[i];
+
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestBin = i;
+                axis = a;
+                splitPosition = centroidBounds.min[a] + static_cast<float>(i + 1) / scale[a];
+            }
+        }
+    }
+
+    if (axis >= 0 && leftBounds != nullptr && rightBounds != nullptr) {
+        *leftBounds = AABB();
+        *rightBounds = AABB();
+        for (int i = 0; i < BVH_BINS; i++) {
+            (i <= bestBin ? *leftBounds : *rightBounds).extend(binned.axes[axis][i].bounds);
+        }
+    }
+
+    return bestCost;
+}
+
+/**
+ * @brief BVH::partition moves the primitives of a range of order with their centroid before splitPosition
+ *        along axis to its front. Large ranges are partitioned in parallel, keeping the order of the primitives
+ *        on each side so that the result does not depend on the number of threads.
+ *
+ * @return the number of primitives before splitPosition
+ */
+unsigned int BVH::partition(const unsigned int first,
+                            const unsigned int count,
+                            const std::vector<AABB>& bounds,
+                            std::vector<unsigned int>& order,
+                            const int axis,
+                            const float splitPosition) {
+    auto isLeft = [&](unsigned int index) {
+        return bounds[index].centroid()[axis] < splitPosition;
+    };
+
+    if (count <= BVH_PARALLEL_PRIMITIVES) {
+        auto begin = order.begin() + first;
+        return static_cast<unsigned int>(std::partition(begin, begin + count, isLeft) - begin);
+    }
+
+    // Count the primitives to the left in every chunk, then scatter each chunk to its place on either side
+    std::vector<unsigned int> chunkLeft(chunkCount(count));
+    forEachChunk(first, count, [&](unsigned int c, unsigned int begin, unsigned int end) {
+        chunkLeft[c] = static_cast<unsigned int>(std::count_if(order.begin() + begin, order.begin() + end, isLeft));
+    });
+
+    std::vector<unsigned int> leftOffset(chunkLeft.size());
+    unsigned int leftCount = 0;
+    for (unsigned int c = 0; c < chunkLeft.size(); c++) {
+        leftOffset[c] = leftCount;
+        leftCount += chunkLeft[c];
+    }
+
+    std::vector<unsigned int> partitioned(count);
+    forEachChunk(first, count, [&](unsigned int c, unsigned int begin, unsigned int end) {
+        unsigned int left = leftOffset[c];
+        // primitives of the previous chunks on the right side follow all of those on the left
+        unsigned int right = leftCount + (begin - first) - leftOffset[c];
+
+        for (unsigned int i = begin; i < end; i++) {
+            partitioned[isLeft(order[i]) ? left++ : right++] = order[i];
+        }
+    });
+
+    forEachChunk(first, count, [&](unsigned int, unsigned int begin, unsigned int end) {
+        std::copy(partitioned.begin() + (begin - first), partitioned.begin() + (end - first), order.begin() + begin);
+    });
+
+    return leftCount;
+}
+
+/**
+ * @brief BVH::buildLinear builds a linear BVH (LBVH): the primitives are sorted along a Z-order curve
+ *        through the Morton codes of their centroids, and the hierarchy splits them where the codes first differ.
+ *        Much faster to build than the SAH, as no split is evaluated, but slower to traverse.
+ *
+ * @param state shared by the tasks of the build, the root is the first node
+ */
+void BVH::buildLinear(const std::vector<AABB>& bounds, std::vector<unsigned int>& order, BuildState& state) {
+    const auto count = static_cast<unsigned int>(order.size());
+
+    AABB box;
+    AABB centroidBounds;
+    boundRange(0, count, bounds, order, box, centroidBounds);
+
+    // Code in the upper half, primitive in the lower half, so that sorting the keys sorts the primitives
+    std::vector<std::uint64_t> keys(count);
+    forEachChunk(0, count, [&](unsigned int, unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            keys[i] = static_cast<std::uint64_t>(mortonCode(bounds[order[i]].centroid(), centroidBounds)) << 32
+                      | order[i];
+        }
+    });
+
+    // Least significant digit radix sort of the codes, every pass is stable and scatters chunks in parallel
+    const unsigned int radix = 1u << LBVH_RADIX_BITS;
+    const unsigned int chunks = chunkCount(count);
+    std::vector<std::uint64_t> sorted(count);
+    std::vector<unsigned int> offsets(static_cast<std::size_t>(chunks) * radix);
+
+    for (unsigned int shift = 32; shift < 32 + 3 * LBVH_MORTON_BITS; shift += LBVH_RADIX_BITS) {
+        auto digit = [shift, radix](std::uint64_t key) {
+            return static_cast<unsigned int>(key >> shift) & (radix - 1);
+        };
+
+        std::fill(offsets.begin(), offsets.end(), 0u);
+        forEachChunk(0, count, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                offsets[c * radix + digit(keys[i])]++;
+            }
+        });
+
+        // Turn the histograms into the position of every digit of every chunk, chunk by chunk within a digit
+        unsigned int position = 0;
+        for (unsigned int d = 0; d < radix; d++) {
+            for (unsigned int c = 0; c < chunks; c++) {
+                unsigned int digits = offsets[c * radix + d];
+                offsets[c * radix + d] = position;
+                position += digits;
+            }
+        }
+
+        forEachChunk(0, count, [&](unsigned int c, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                sorted[offsets[c * radix + digit(keys[i])]++] = keys[i];
+            }
+        });
+
+        keys.swap(sorted);
+    }
+
+    std::vector<std::uint32_t> codes(count);
+    forEachChunk(0, count, [&](unsigned int, unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            codes[i] = static_cast<std::uint32_t>(keys[i] >> 32);
+            order[i] = static_cast<unsigned int>(keys[i]);
+        }
+    });
+
+    emitLinear(0, bounds, order, codes, 1, state);
+}
+
+/**
+ * @brief BVH::emitLinear splits a node of the linear BVH at the highest bit in which the codes of its primitives
+ *        differ, and its children in turn. Bounds are gathered bottom up once the children are built.
+ *
+ * @param nodeIndex node over a range of order, which becomes interior unless it is small enough for a leaf
+ * @param codes Morton code of every primitive of order, sorted
+ * @param depth of the node, the root being at depth 1
+ * @param state shared by the tasks of the build
+ */
+void BVH::emitLinear(unsigned int nodeIndex,
+                     const std::vector<AABB>& bounds,
+                     const std::vector<unsigned int>& order,
+                     const std::vector<std::uint32_t>& codes,
+                     unsigned int depth,
+                     BuildState& state) {
+    state.reached(depth);
+
+    BVHNode& node = nodes[nodeIndex];
+
+    if (node.count <= LBVH_LEAF_PRIMITIVES || depth >= BVH_MAX_DEPTH) {
+        node.bounds = AABB();
+        for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+            node.bounds.extend(bounds[order[i]]);
+        }
+        return;
+    }
+
+    const unsigned int first = node.leftFirst;
+    const unsigned int last = node.leftFirst + node.count - 1;
+
+    // Primitives sharing a code are split in the middle
+    unsigned int leftCount = node.count / 2;
+    if (codes[first] != codes[last]) {
+        // The right child starts at the first code with the highest differing bit set
+        const int bit = 31 - __builtin_clz(codes[first] ^ codes[last]);
+        const std::uint32_t rightStart = (codes[last] >> bit) << bit;
+        leftCount = static_cast<unsigned int>(
+            std::lower_bound(codes.begin() + first, codes.begin() + last + 1, rightStart) - (codes.begin() + first));
+    }
+
+    // Children are allocated as a pair, right = left + 1
+    const unsigned int leftIndex = state.allocatePair();
+
+    nodes[leftIndex].leftFirst = first;
+    nodes[leftIndex].count = leftCount;
+    nodes[leftIndex + 1].leftFirst = first + leftCount;
+    nodes[leftIndex + 1].count = node.count - leftCount;
+
+    const bool parallel = node.count > BVH_TASK_PRIMITIVES;
+
+    node.leftFirst = leftIndex;
+    node.count = 0;
+
+    if (parallel) {
+        // clang-format off
+#pragma omp task default(shared)
+        // clang-format on
+        emitLinear(leftIndex, bounds, order, codes, depth + 1, state);
+
+        emitLinear(leftIndex + 1, bounds, order, codes, depth + 1, state);
+
+        // clang-format off
+#pragma omp taskwait
+        // clang-format on
+    } else {
+        emitLinear(leftIndex, bounds, order, codes, depth + 1, state);
+        emitLinear(leftIndex + 1, bounds, order, codes, depth + 1, state);
+    }
+
+    node.bounds = nodes[leftIndex].bounds;
+    node.bounds.extend(nodes[leftIndex + 1].bounds);
+}
+
+/**
+ * @brief BVH::buildSpatial constructs a spatial split BVH (SBVH) over triangles: nodes are split either by partitioning
+ *        their triangles, or by a plane through space whenever that lowers the SAH cost, in which case the triangles
+ *        crossing the plane are referenced from both sides with the bounds of their part on each.
+ *        Large triangles overlapping many small ones are cut down to size rather than enlarging every node they are in.
+ *
+ * @param triangles to build the hierarchy over, replaced by one copy per leaf referencing them
+ * @param sourceOrder set to the index in the original triangles of every triangle after the build
+ */
+void BVH::buildSpatial(std::vector<Triangle>& triangles, std::vector<unsigned int>& sourceOrder) {
+    nodes.clear();
+    maxDepth = 0;
+    duplicateCount = 0;
+
+    if (triangles.empty()) {
+        return;
+    }
+
+    const auto count = static_cast<unsigned int>(triangles.size());
+    SpatialReferences spatial{triangles, {}, {}, static_cast<unsigned int>(count * SBVH_MAX_DUPLICATION), 0.0f, {}};
+    spatial.bounds.reserve(count + spatial.budget);
+    spatial.triangle.reserve(count + spatial.budget);
+    spatial.order.reserve(count + spatial.budget);
+
+    std::vector<unsigned int> references(count);
+    AABB rootBounds;
+    for (unsigned int i = 0; i < count; i++) {
+        spatial.bounds.push_back(triangles[i].bounds());
+        spatial.triangle.push_back(i);
+        references[i] = i;
+        rootBounds.extend(spatial.bounds[i]);
+    }
+    spatial.minOverlap = SBVH_MIN_OVERLAP * rootBounds.surfaceArea();
+
+    // Every reference may end up in a leaf of its own
+    nodes.resize(2 * (count + spatial.budget) - 1);
+
+    BuildState state;
+    state.nodeCount = 1;
+    state.maxDepth = 0;
+
+    subdivideSpatial(0, references, spatial, 1, state);
+
+    nodes.resize(state.nodeCount);
+    nodes.shrink_to_fit();
+    maxDepth = state.maxDepth;
+    duplicateCount = static_cast<unsigned int>(spatial.order.size()) - count;
+
+    // Leaves index the triangles directly, triangles cut by spatial splits are copied into every leaf they reach
+    reorder(triangles, spatial.order);
+    sourceOrder.swap(spatial.order);
+}
+
+/**
+ * @brief BVH::subdivideSpatial splits a node of a spatial split build on the cheapest of the best object split
+ *        and the best spatial split, and its children in turn. Built depth first on a single thread,
+ *        as splits draw on the duplication budget left by the nodes built before them.
+ *
+ * @param nodeIndex node to build over references
+ * @param references to the triangles in the node, handed over to its children
+ * @param depth of the node, the root being at depth 1
+ */
+void BVH::subdivideSpatial(unsigned int nodeIndex,
+                           std::vector<unsigned int>& references,
+                           SpatialReferences& spatial,
+                           unsigned int depth,
+                           BuildState& state) {
+    state.reached(depth);
+
+    BVHNode& node = nodes[nodeIndex];
+    const auto count = static_cast<unsigned int>(references.size());
+
+    AABB centroidBounds;
+    boundRange(0, count, spatial.bounds, references, node.bounds, centroidBounds);
+
+    auto makeLeaf = [&]() {
+        node.leftFirst = static_cast<unsigned int>(spatial.order.size());
+        node.count = count;
+        for (unsigned int reference : references) {
+            spatial.order.push_back(spatial.triangle[reference]);
+        }
+    };
+
+    if (count <= 1 || depth >= BVH_MAX_DEPTH) {
+        makeLeaf();
+        return;
+    }
+
+    BVHNode range{};
+    range.bounds = node.bounds;
+    range.leftFirst = 0;
+    range.count = count;
+
+    int axis;
+    float splitPosition;
+    AABB leftBounds;
+    AABB rightBounds;
+    const float objectCost = findBestSplit(range, centroidBounds, spatial.bounds, references, axis, splitPosition,
+                                           &leftBounds, &rightBounds);
+
+    // Spatial splits can only do better where the children of the object split overlap
+    SpatialSplit split{};
+    float spatialCost = std::numeric_limits<float>::infinity();
+    if (spatial.budget > 0
+        && (axis < 0 || leftBounds.intersection(rightBounds).surfaceArea() > spatial.minOverlap)) {
+        spatialCost = findSpatialSplit(node.bounds, references, spatial, split);
+
+        // Not enough references left for those the split would duplicate
+        if (spatialCost < objectCost && split.leftCount + split.rightCount - count > spatial.budget) {
+            spatialCost = std::numeric_limits<float>::infinity();
+        }
+    }
+
+    const float leafCost = static_cast<float>(count) * node.bounds.surfaceArea();
+
+    // Splitting is not worth it according to the SAH
+    if (std::min(objectCost, spatialCost) >= leafCost) {
+        makeLeaf();
+        return;
+    }
+
+    std::vector<unsigned int> left;
+    std::vector<unsigned int> right;
+    if (spatialCost < objectCost) {
+        splitReferences(references, spatial, split, left, right);
+    } else {
+        for (unsigned int reference : references) {
+            (spatial.bounds[reference].centroid()[axis] < splitPosition ? left : right).push_back(reference);
+        }
+    }
+
+    // Everything went to one side, nothing was duplicated
+    if (left.empty() || right.empty()) {
+        makeLeaf();
+        return;
+    }
+
+    // The children own the references from now on
+    std::vector<unsigned int>().swap(references);
+
+    // Children are allocated as a pair, right = left + 1
+    const unsigned int leftIndex = state.allocatePair();
+
+    node.leftFirst = leftIndex;
+    node.count = 0;
+
+    subdivideSpatial(leftIndex, left, spatial, depth + 1, state);
+    subdivideSpatial(leftIndex + 1, right, spatial, depth + 1, state);
+}
+
+/**
+ * @brief BVH::findSpatialSplit bins the references of a node along each axis of the node, clipping those that span
+ *        several bins to each of them, and evaluates the SAH at every bin boundary.
+ *        References are counted on the left of the planes after the bin they enter and on the right of those
+ *        before the bin they exit, so those crossing a plane are counted on both sides.
+ *
+ * @param split set to the best plane along with the bounds and references to each side, axis -1 if there is none
+ *
+ * @return the SAH cost of the best split, scaled by the area of the node
+ */
+float BVH::findSpatialSplit(const AABB& nodeBounds,
+                            const std::vector<unsigned int>& references,
+                            const SpatialReferences& spatial,
+                            SpatialSplit& split) {
+    struct SpatialBin {
+        AABB bounds;
+        unsigned int entries = 0;
+        unsigned int exits = 0;
+    };
+
+    float bestCost = std::numeric_limits<float>::infinity();
+    split.axis = -1;
+
+    for (int a = 0; a < 3; a++) {
+        const float minimum = nodeBounds.min[a];
+        const float extent = nodeBounds.max[a] - minimum;
+
+        // Flat along this axis, there is no space to split
+        if (extent < EPS) {
+            continue;
+        }
+
+        const float scale = SBVH_BINS / extent;
+        auto binOf = [&](float position) {
+            return std::clamp(static_cast<int>((position - minimum) * scale), 0, SBVH_BINS - 1);
+        };
+
+        SpatialBin bins[SBVH_BINS];
+        for (unsigned int reference : references) {
+            const AABB& box = spatial.bounds[reference];
+            const int first = binOf(box.min[a]);
+            const int last = binOf(box.max[a]);
+
+            bins[first].entries++;
+            bins[last].exits++;
+
+            if (first == last) {
+                bins[first].bounds.extend(box);
+                continue;
+            }
+
+            const Triangle& triangle = spatial.triangles[spatial.triangle[reference]];
+            for (int b = first; b <= last; b++) {
+                const float lower = minimum + static_cast<float>(b) / scale;
+                const float upper = minimum + static_cast<float>(b + 1) / scale;
+                bins[b].bounds.extend(clipTriangle(triangle, a, lower, upper, box));
+            }
+        }
+
+        // Sweep from both sides, accumulating the bounds and count to each side of every plane
+        AABB leftBoxes[SBVH_BINS - 1];
+        AABB rightBoxes[SBVH_BINS - 1];
+        unsigned int leftCount[SBVH_BINS - 1];
+        unsigned int rightCount[SBVH_BINS - 1];
+
+        AABB leftBox;
+        AABB rightBox;
+        unsigned int leftSum = 0;
+        unsigned int rightSum = 0;
+
+        for (int i = 0; i < SBVH_BINS - 1; i++) {
+            leftSum += bins[i].entries;
+            leftCount[i] = leftSum;
+            leftBox.extend(bins[i].bounds);
+            leftBoxes[i] = leftBox;
+
+            rightSum += bins[SBVH_BINS - 1 - i].exits;
+            rightCount[SBVH_BINS - 2 - i] = rightSum;
+            rightBox.extend(bins[SBVH_BINS - 1 - i].bounds);
+            rightBoxes[SBVH_BINS - 2 - i] = rightBox;
+        }
+
+        for (int i = 0; i < SBVH_BINS - 1; i++) {
+            if (leftCount[i] == 0 || rightCount[i] == 0) {
+                continue;
+            }
+
+            float cost = BVH_TRAVERSAL_COST * nodeBounds.surfaceArea()
+                         + static_cast<float>(leftCount[i]) * leftBoxes[i].surfaceArea()
+                         + static_cast<float>(rightCount[i]) * rightBoxes[i].surfaceArea();
+
+            if (cost < bestCost) {
+                bestCost = cost;
+                split = {a, minimum + static_cast<float>(i + 1) / scale,
+                         leftBoxes[i], rightBoxes[i], leftCount[i], rightCount[i]};
+            }
+        }
+    }
+
+    return bestCost;
+}
+
+/**
+ * @brief BVH::splitReferences distributes the references of a node to either side of a spatial split.
+ *        A reference crossing the plane is cut in two, unless moving all of it to one side costs less according
+ *        to the SAH (reference unsplitting) or the duplication budget is spent.
+ *
+ * @param split estimated bounds and counts to each side, updated as references are moved whole
+ */
+void BVH::splitReferences(const std::vector<unsigned int>& references,
+                          SpatialReferences& spatial,
+                          SpatialSplit split,
+                          std::vector<unsigned int>& left,
+                          std::vector<unsigned int>& right) {
+    const int axis = split.axis;
+
+    for (unsigned int reference : references) {
+        const AABB box = spatial.bounds[reference];
+
+        if (box.max[axis] <= split.position) {
+            left.push_back(reference);
+            continue;
+        }
+        if (box.min[axis] >= split.position) {
+            right.push_back(reference);
+            continue;
+        }
+
+        AABB leftUnion = split.leftBounds;
+        leftUnion.extend(box);
+        AABB rightUnion = split.rightBounds;
+        rightUnion.extend(box);
+
+        const auto leftCount = static_cast<float>(split.leftCount);
+        const auto rightCount = static_cast<float>(split.rightCount);
+        const float splitCost = split.leftBounds.surfaceArea() * leftCount + split.rightBounds.surfaceArea() * rightCount;
+        const float leftCost = leftUnion.surfaceArea() * leftCount + split.rightBounds.surfaceArea() * (rightCount - 1.0f);
+        const float rightCost = split.leftBounds.surfaceArea() * (leftCount - 1.0f) + rightUnion.surfaceArea() * rightCount;
+
+        const unsigned int triangle = spatial.triangle[reference];
+        const AABB leftPart = clipTriangle(spatial.triangles[triangle], axis, box.min[axis], split.position, box);
+        const AABB rightPart = clipTriangle(spatial.triangles[triangle], axis, split.position, box.max[axis], box);
+        const bool canSplit = spatial.budget > 0 && !leftPart.isEmpty() && !rightPart.isEmpty();
+
+        if (!canSplit || leftCost < splitCost || rightCost < splitCost) {
+            if (rightPart.isEmpty() || (!leftPart.isEmpty() && leftCost <= rightCost)) {
+                left.push_back(reference);
+                split.leftBounds = leftUnion;
+                split.rightCount--;
+            } else {
+                right.push_back(reference);
+                split.rightBounds = rightUnion;
+                split.leftCount--;
+            }
+            continue;
+        }
+
+        spatial.bounds[reference] = leftPart;
+        left.push_back(reference);
+
+        right.push_back(static_cast<unsigned int>(spatial.bounds.size()));
+        spatial.bounds.push_back(rightPart);
+        spatial.triangle.push_back(triangle);
+        spatial.budget--;
+    }
+}
+
+/**
+ * @brief BVH::closestHitWith traverses the hierarchy front to back, pruning nodes further than the closest hit.
+ *
+ * @param ray to intersect with the triangles
+ * @param maxT distance along ray beyond which triangles are ignored
+ * @param leaves tests ray against the triangles of a leaf, see TriangleLeaves::closest
+ * @param statistics counts the nodes and triangles visited, if not null
+ *
+ * @return the collision with the closest triangle hit by ray within maxT, if any
+ */
+template<typename Leaves>
+CollisionInfo BVH::closestHitWith(const Ray& ray, float maxT, const Leaves& leaves,
+                                  TraversalStatistics* statistics) const {
+    CollisionInfo closest;
+    float t = maxT;
+
+    if (nodes.empty()) {
+        return closest;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+
+    // Pending nodes along with the distance at which the ray enters them
+    BVHStackEntry stack[BVH_MAX_DEPTH + 1];
+    unsigned int stackSize = 0;
+
+    float rootT = nodes[0].bounds.intersect(ray, inverseDirection, t);
+    if (rootT == NO_INTERSECT) {
+        return closest;
+    }
+    stack[stackSize++] = {0, rootT};
+
+    while (stackSize > 0) {
+        const auto [nodeIndex, entryT] = stack[--stackSize];
+
+        // A closer hit was found after this node was pushed
+        if (entryT >= t) {
+            continue;
+        }
+
+        const BVHNode& node = nodes[nodeIndex];
+
+        if (node.isLeaf()) {
+            if (statistics != nullptr) {
+                statistics->triangles += node.count;
+            }
+            leaves.closest(nodeIndex, node, t, closest);
+            continue;
+        }
+
+        if (statistics != nullptr) {
+            statistics->nodes++;
+        }
+
+        unsigned int near = node.leftFirst;
+        unsigned int far = node.leftFirst + 1;
+        float nearT = nodes[near].bounds.intersect(ray, inverseDirection, t);
+        float farT = nodes[far].bounds.intersect(ray, inverseDirection, t);
+
+        if (nearT == NO_INTERSECT || (farT != NO_INTERSECT && farT < nearT)) {
+            std::swap(near, far);
+            std::swap(nearT, farT);
+        }
+
+        // Push the far child first so the near child is visited next
+        if (farT != NO_INTERSECT) {
+            stack[stackSize++] = {far, farT};
+        }
+        if (nearT != NO_INTERSECT) {
+            stack[stackSize++] = {near, nearT};
+        }
+    }
+
+    return closest;
+}
+
+/**
+ * @brief BVH::closestHit finds the closest triangle hit by ray with the given intersection kernel,
+ *        see closestHitWith
+ *
+ * @param triangles the hierarchy was built over, in the order produced by build
+ * @param packed triangles packed from this hierarchy, tested by the SIMD kernel
+ */
+CollisionInfo BVH::closestHit(const Ray& ray,
+                              const std::vector<Triangle>& triangles,
+                              const PackedTriangles& packed,
+                              const IntersectionKernel kernel,
+                              float maxT,
+                              TraversalStatistics* statistics) const {
+    return visitLeaves(ray, triangles, packed, kernel, [&](const auto& leaves) {
+        return closestHitWith(ray, maxT, leaves, statistics);
+    });
+}
+
+/**
+ * @brief BVH::occludingHitWith looks for any opaque, non-emissive triangle along ray up to maxT.
+ *        Traversal stops at the first such triangle, regardless of it being the closest.
+ *        Emissive triangles never occlude. Reflective or transparent triangles only occlude
+ *        partially, so the closest of them is kept in case no opaque triangle is found.
+ *
+ * @param ray to intersect with the triangles
+ * @param maxT distance along ray beyond which triangles are ignored
+ * @param leaves tests ray against the triangles of a leaf, see TriangleLeaves::occluding
+ * @param statistics counts the nodes and triangles visited, if not null
+ *
+ * @return the collision with an opaque triangle within maxT if any,
+ *         otherwise with the closest reflective or transparent triangle within maxT if any
+ */
+template<typename Leaves>
+CollisionInfo BVH::occludingHitWith(const Ray& ray, float maxT, const Leaves& leaves,
+                                    TraversalStatistics* statistics) const {
+    CollisionInfo closestTransparent;
+    float t = maxT;
+
+    if (nodes.empty()) {
+        return closestTransparent;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+
+    unsigned int stack[BVH_MAX_DEPTH + 1];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const unsigned int nodeIndex = stack[--stackSize];
+        const BVHNode& node = nodes[nodeIndex];
+
+        if (node.bounds.intersect(ray, inverseDirection, t) == NO_INTERSECT) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            if (statistics != nullptr) {
+                statistics->triangles += node.count;
+            }
+            if (leaves.occluding(nodeIndex, node, t, closestTransparent)) {
+                return closestTransparent;
+            }
+            continue;
+        }
+
+        if (statistics != nullptr) {
+            statistics->nodes++;
+        }
+
+        stack[stackSize++] = node.leftFirst + 1;
+        stack[stackSize++] = node.leftFirst;
+    }
+
+    return closestTransparent;
+}
+
+/**
+ * @brief BVH::occludingHit any-hit query with the given intersection kernel, see occludingHitWith
+ */
+CollisionInfo BVH::occludingHit(const Ray& ray,
+                                const std::vector<Triangle>& triangles,
+                                const PackedTriangles& packed,
+                                const IntersectionKernel kernel,
+                                float maxT,
+                                TraversalStatistics* statistics) const {
+    return visitLeaves(ray, triangles, packed, kernel, [&](const auto& leaves) {
+        return occludingHitWith(ray, maxT, leaves, statistics);
+    });
+}
+
+unsigned int BVH::depth() const {
+    return maxDepth;
+}
+
+/**
+ * @return the triangles referenced by more than one leaf, counted once per extra leaf, 0 unless built with spatial splits
+ */
+unsigned int BVH::duplicates() const {
+    return duplicateCount;
+}
+
+/**
+ * @brief BVH::sahCost estimates the cost of tracing a ray through the hierarchy with the Surface Area Heuristic,
+ *        the probability of a ray hitting a node being the ratio of its surface area to that of the root
+ *
+ * @return the cost in units of triangle intersections, 0 for an empty or flat hierarchy
+ */
+float BVH::sahCost() const {
+    if (nodes.empty() || nodes[0].bounds.surfaceArea() <= 0.0f) {
+        return 0.0f;
+    }
+
+    double cost = 0.0;
+    for (const BVHNode& node : nodes) {
+        const double area = node.bounds.surfaceArea();
+        cost += node.isLeaf() ? area * node.count : area * BVH_TRAVERSAL_COST;
+    }
+
+    return static_cast<float>(cost / nodes[0].bounds.surfaceArea());
+}
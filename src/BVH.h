@@ -0,0 +1,211 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "AABB.h"
+#include "CollisionInfo.h"
+#include "Ray.h"
+#include "Triangle.h"
+
+class PackedTriangles;
+
+// Hard cap on the depth of the tree, bounds the traversal stack
+#define BVH_MAX_DEPTH 64
+
+// Node of the BVH, 32 bytes
+// Interior nodes: leftFirst is the index of the left child, the right child is leftFirst + 1
+// Leaf nodes: leftFirst is the index of the first primitive, count the number of primitives
+struct BVHNode {
+    AABB bounds;
+    unsigned int leftFirst;
+    unsigned int count;
+
+    bool isLeaf() const;
+};
+
+// Node pending traversal along with the distance at which the ray enters it
+// Left uninitialised when allocated, unlike std::pair, as traversal stacks are set up for every ray
+struct BVHStackEntry {
+    unsigned int node;
+    float entryT;
+};
+
+// Layouts of the bottom level hierarchies, the wide ones are collapsed from the binary one
+enum class BVHLayout {
+    Binary,
+    // 4 children per node, tested at once with SSE
+    Wide4,
+    // 8 children per node, tested at once with AVX2
+    Wide8
+};
+
+// Algorithms the bottom level hierarchies can be built with
+enum class BVHBuilder {
+    // binned Surface Area Heuristic, the best trees to traverse
+    BinnedSAH,
+    // linear BVH over the Morton codes of the centroids, the fastest to build
+    Linear,
+    // binned SAH that may also split space, referencing triangles from every leaf they overlap (SBVH)
+    // Better trees around large triangles overlapping small ones, but slower to build and in a single thread
+    Spatial
+};
+
+// Work done by traversals, only counted when asked for
+struct TraversalStatistics {
+    // interior nodes whose children were tested
+    unsigned long long nodes = 0;
+    // triangles of the leaves reached
+    unsigned long long triangles = 0;
+};
+
+// Bounding Volume Hierarchy built with the Surface Area Heuristic (SAH), or along Morton codes
+// The object split builders construct subtrees as parallel tasks
+class BVH {
+public:
+    std::vector<BVHNode> nodes;
+
+    BVH();
+
+    void build(std::vector<Triangle>& triangles,
+               BVHBuilder builder = BVHBuilder::BinnedSAH,
+               std::vector<unsigned int>* sourceOrder = nullptr);
+
+    void build(const std::vector<AABB>& bounds,
+               std::vector<unsigned int>& order,
+               BVHBuilder builder = BVHBuilder::BinnedSAH);
+
+    void restore(std::vector<BVHNode>& cachedNodes, unsigned int depth, unsigned int duplicates);
+
+    static void reorder(std::vector<Triangle>& triangles, const std::vector<unsigned int>& order);
+
+    CollisionInfo closestHit(const Ray& ray,
+                             const std::vector<Triangle>& triangles,
+                             const PackedTriangles& packed,
+                             IntersectionKernel kernel,
+                             float maxT,
+                             TraversalStatistics* statistics = nullptr) const;
+
+    CollisionInfo occludingHit(const Ray& ray,
+                               const std::vector<Triangle>& triangles,
+                               const PackedTriangles& packed,
+                               IntersectionKernel kernel,
+                               float maxT,
+                               TraversalStatistics* statistics = nullptr) const;
+
+    unsigned int depth() const;
+
+    unsigned int duplicates() const;
+
+    float sahCost() const;
+
+private:
+    // Progress of a build, shared by its tasks
+    struct BuildState {
+        // nodes taken so far, children are taken in pairs
+        std::atomic<unsigned int> nodeCount;
+        std::atomic<unsigned int> maxDepth;
+
+        void reached(unsigned int depth);
+
+        unsigned int allocatePair();
+    };
+
+    // References to the triangles of a spatial split build, a triangle is referenced once per leaf it overlaps
+    struct SpatialReferences {
+        const std::vector<Triangle>& triangles;
+        // bounds of the part of the triangle in the node the reference is in
+        std::vector<AABB> bounds;
+        std::vector<unsigned int> triangle;
+        // references that can still be added by spatial splits
+        unsigned int budget;
+        // spatial splits are only looked for in nodes whose object split children overlap more than this
+        float minOverlap;
+        // triangle of every reference of the leaves, leaf by leaf
+        std::vector<unsigned int> order;
+    };
+
+    // Plane of a spatial split, along with the estimated bounds and number of references to each side
+    struct SpatialSplit {
+        int axis;
+        float position;
+        AABB leftBounds;
+        AABB rightBounds;
+        unsigned int leftCount;
+        unsigned int rightCount;
+    };
+
+    unsigned int maxDepth;
+
+    // references added by spatial splits, beyond one per triangle
+    unsigned int duplicateCount;
+
+    void subdivide(unsigned int nodeIndex,
+                   const std::vector<AABB>& bounds,
+                   std::vector<unsigned int>& order,
+                   unsigned int depth,
+                   BuildState& state);
+
+    static void boundRange(unsigned int first,
+                           unsigned int count,
+                           const std::vector<AABB>& bounds,
+                           const std::vector<unsigned int>& order,
+                           AABB& box,
+                           AABB& centroidBox);
+
+    float findBestSplit(const BVHNode& node,
+                        const AABB& centroidBounds,
+                        const std::vector<AABB>& bounds,
+                        const std::vector<unsigned int>& order,
+                        int& axis,
+                        float& splitPosition,
+                        AABB* leftBounds = nullptr,
+                        AABB* rightBounds = nullptr) const;
+
+    static unsigned int partition(unsigned int first,
+                                  unsigned int count,
+                                  const std::vector<AABB>& bounds,
+                                  std::vector<unsigned int>& order,
+                                  int axis,
+                                  float splitPosition);
+
+    void buildLinear(const std::vector<AABB>& bounds, std::vector<unsigned int>& order, BuildState& state);
+
+    void emitLinear(unsigned int nodeIndex,
+                    const std::vector<AABB>& bounds,
+                    const std::vector<unsigned int>& order,
+                    const std::vector<std::uint32_t>& codes,
+                    unsigned int depth,
+                    BuildState& state);
+
+    void buildSpatial(std::vector<Triangle>& triangles, std::vector<unsigned int>& sourceOrder);
+
+    void subdivideSpatial(unsigned int nodeIndex,
+                          std::vector<unsigned int>& references,
+                          SpatialReferences& spatial,
+                          unsigned int depth,
+                          BuildState& state);
+
+    static float findSpatialSplit(const AABB& nodeBounds,
+                                  const std::vector<unsigned int>& references,
+                                  const SpatialReferences& spatial,
+                                  SpatialSplit& split);
+
+    static void splitReferences(const std::vector<unsigned int>& references,
+                                SpatialReferences& spatial,
+                                SpatialSplit split,
+                                std::vector<unsigned int>& left,
+                                std::vector<unsigned int>& right);
+
+    template<typename Leaves>
+    CollisionInfo closestHitWith(const Ray& ray, float maxT, const Leaves& leaves,
+                                 TraversalStatistics* statistics) const;
+
+    template<typename Leaves>
+    CollisionInfo occludingHitWith(const Ray& ray, float maxT, const Leaves& leaves,
+                                   TraversalStatistics* statistics) const;
+};
+
+#endif // BVH_H
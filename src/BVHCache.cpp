@@ -0,0 +1,305 @@
+#include "BVHCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#include "MappedFile.h"
+#include "SceneCache.h"
+
+// First bytes of every cache file, including the terminating null
+#define BVH_CACHE_MAGIC "STBVH"
+// Written in the byte order of the machine, a cache from a machine with another byte order is stale
+#define BVH_CACHE_BYTE_ORDER 0x01020304u
+// Every section starts on a multiple of this many bytes
+#define BVH_CACHE_ALIGNMENT 8
+
+static_assert(sizeof(BVHNode) == 32, "BVH nodes must be 32 bytes, as laid out in the cache");
+static_assert(sizeof(unsigned int) == sizeof(std::uint32_t), "triangle indices must be 32 bits");
+
+// Range of the file holding count elements
+struct BVHCacheSection {
+    std::uint64_t offset;
+    std::uint64_t count;
+};
+
+struct BVHCacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t geometryHash;
+    // size of the whole file, catches truncated writes
+    std::uint64_t fileSize;
+    // hash of the nodes and the order, catches corrupted bounds that the tree itself cannot show
+    std::uint64_t contentHash;
+
+    // triangles of the model, before spatial splits duplicate any
+    std::uint64_t triangleCount;
+    std::uint32_t depth;
+    std::uint32_t duplicates;
+
+    BVHCacheSection nodes;
+    BVHCacheSection order;
+};
+
+static std::uint64_t alignOffset(std::uint64_t offset) {
+    return (offset + BVH_CACHE_ALIGNMENT - 1) / BVH_CACHE_ALIGNMENT * BVH_CACHE_ALIGNMENT;
+}
+
+/**
+ * @return whether section lies within a file of fileSize bytes
+ */
+static bool sectionFits(const BVHCacheSection& section, std::size_t elementSize, std::uint64_t fileSize) {
+    return section.offset % BVH_CACHE_ALIGNMENT == 0
+           && section.offset <= fileSize
+           && section.count <= (fileSize - section.offset) / elementSize;
+}
+
+/**
+ * @brief contentHash chains the hashes of the nodes and of the order of a hierarchy, as laid out in the cache
+ */
+static std::uint64_t contentHash(const BVHNode* nodes, const std::size_t nodeCount,
+                                 const unsigned int* order, const std::size_t orderCount) {
+    const std::uint64_t value = SceneCache::hash(reinterpret_cast<const char*>(nodes), nodeCount * sizeof(BVHNode), 0);
+    return SceneCache::hash(reinterpret_cast<const char*>(order), orderCount * sizeof(std::uint32_t), value);
+}
+
+/**
+ * @brief validHierarchy walks the nodes from the root, so that a corrupted cache cannot be traversed:
+ *        every node must be reached exactly once, no deeper than BVH_MAX_DEPTH which traversal stacks are sized for,
+ *        and the leaves must cover every entry of order exactly once, each referencing an existing triangle
+ *
+ * @param depth set to the depth of the deepest node, the root being at depth 1
+ */
+static bool validHierarchy(const std::vector<BVHNode>& nodes,
+                           const std::vector<unsigned int>& order,
+                           const std::uint64_t triangleCount,
+                           unsigned int& depth) {
+    std::vector<bool> reached(nodes.size(), false);
+    std::vector<bool> covered(order.size(), false);
+    std::size_t reachedCount = 0;
+    std::size_t coveredCount = 0;
+    depth = 0;
+
+    // Nodes left to visit, with their depth
+    std::vector<std::pair<unsigned int, unsigned int>> stack = {{0, 1}};
+
+    while (!stack.empty()) {
+        const unsigned int index = stack.back().first;
+        const unsigned int nodeDepth = stack.back().second;
+        stack.pop_back();
+
+        // A node reached twice is shared by two parents, or its own ancestor
+        if (nodeDepth > BVH_MAX_DEPTH || reached[index]) {
+            return false;
+        }
+        reached[index] = true;
+        reachedCount++;
+        depth = std::max(depth, nodeDepth);
+
+        const BVHNode& node = nodes[index];
+
+        if (!node.isLeaf()) {
+            if (node.leftFirst >= nodes.size() - 1) {
+                return false;
+            }
+            stack.emplace_back(node.leftFirst + 1, nodeDepth + 1);
+            stack.emplace_back(node.leftFirst, nodeDepth + 1);
+            continue;
+        }
+
+        if (node.leftFirst > order.size() || node.count > order.size() - node.leftFirst) {
+            return false;
+        }
+        for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+            if (covered[i] || order[i] >= triangleCount) {
+                return false;
+            }
+            covered[i] = true;
+        }
+        coveredCount += node.count;
+    }
+
+    return reachedCount == nodes.size() && coveredCount == order.size();
+}
+
+/**
+ * @brief BVHCache::hash identifies the geometry a hierarchy is built over: the vertices of the triangles,
+ *        in the order the model is triangulated in, and the builder
+ */
+std::uint64_t BVHCache::hash(const std::vector<Triangle>& triangles, const BVHBuilder builder) {
+    std::uint64_t value = SceneCache::hash(nullptr, 0, BVH_CACHE_VERSION * 16 + static_cast<std::uint64_t>(builder));
+
+    for (const Triangle& triangle : triangles) {
+        value = SceneCache::hash(reinterpret_cast<const char*>(triangle.vertices.data()), sizeof(triangle.vertices), value);
+    }
+
+    return value;
+}
+
+std::string BVHCache::directoryFor(const std::string& geometryPath) {
+    return geometryPath + BVH_CACHE_DIRECTORY_SUFFIX;
+}
+
+std::string BVHCache::pathFor(const std::string& directory, const std::uint64_t geometryHash) {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(geometryHash));
+    return (std::filesystem::path(directory) / (name + std::string(BVH_CACHE_EXTENSION))).string();
+}
+
+/**
+ * @brief BVHCache::read loads a hierarchy stored in a cache file
+ *
+ * @param cachePath path of the cache file
+ * @param geometryHash hash of the triangles, the cache must have been written for the same ones
+ * @param triangleCount triangles of the model the hierarchy is for
+ * @param bvh set to the cached hierarchy when the cache is loaded, untouched otherwise
+ * @param order set to the index in the model of every triangle of the leaves when the cache is loaded
+ *
+ * @return Loaded on success, otherwise why the cache cannot be used
+ */
+BVHCache::Status BVHCache::read(const std::string& cachePath,
+                                const std::uint64_t geometryHash,
+                                const std::size_t triangleCount,
+                                BVH& bvh,
+                                std::vector<unsigned int>& order) {
+    MappedFile file(cachePath);
+
+    if (!file.isOpen()) {
+        return Status::Missing;
+    }
+
+    BVHCacheHeader header{};
+    if (file.size() < sizeof(header)) {
+        return Status::Invalid;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, BVH_CACHE_MAGIC, sizeof(BVH_CACHE_MAGIC)) != 0) {
+        return Status::Invalid;
+    }
+
+    if (header.version != BVH_CACHE_VERSION
+        || header.byteOrder != BVH_CACHE_BYTE_ORDER
+        || header.geometryHash != geometryHash
+        || header.triangleCount != triangleCount) {
+        return Status::Stale;
+    }
+
+    const std::uint64_t fileSize = file.size();
+
+    if (header.fileSize != fileSize
+        || !sectionFits(header.nodes, sizeof(BVHNode), fileSize)
+        || !sectionFits(header.order, sizeof(std::uint32_t), fileSize)
+        || header.nodes.count == 0
+        || header.order.count != triangleCount + header.duplicates) {
+        return Status::Invalid;
+    }
+
+    std::vector<BVHNode> nodes(header.nodes.count);
+    std::vector<unsigned int> cachedOrder(header.order.count);
+    std::memcpy(nodes.data(), file.data() + header.nodes.offset, nodes.size() * sizeof(BVHNode));
+    std::memcpy(cachedOrder.data(), file.data() + header.order.offset, cachedOrder.size() * sizeof(std::uint32_t));
+
+    if (contentHash(nodes.data(), nodes.size(), cachedOrder.data(), cachedOrder.size()) != header.contentHash) {
+        return Status::Invalid;
+    }
+
+    // The depth is measured rather than taken from the header, traversal relies on it
+    unsigned int depth;
+    if (!validHierarchy(nodes, cachedOrder, triangleCount, depth)) {
+        return Status::Invalid;
+    }
+
+    bvh.restore(nodes, depth, header.duplicates);
+    order.swap(cachedOrder);
+    return Status::Loaded;
+}
+
+/**
+ * @brief BVHCache::write stores a hierarchy in a cache file, creating its directory if need be.
+ *        The file is written next to its final path then renamed, so a reader never sees a partial cache.
+ *
+ * @param order index in the model of every triangle of the leaves, see BVH::build
+ *
+ * @return whether the cache was written
+ */
+bool BVHCache::write(const std::string& cachePath,
+                     const std::uint64_t geometryHash,
+                     const std::size_t triangleCount,
+                     const BVH& bvh,
+                     const std::vector<unsigned int>& order) {
+    if (bvh.nodes.empty()) {
+        return false;
+    }
+
+    BVHCacheHeader header{};
+    std::memcpy(header.magic, BVH_CACHE_MAGIC, sizeof(BVH_CACHE_MAGIC));
+    header.version = BVH_CACHE_VERSION;
+    header.byteOrder = BVH_CACHE_BYTE_ORDER;
+    header.geometryHash = geometryHash;
+    header.triangleCount = triangleCount;
+    header.depth = bvh.depth();
+    header.duplicates = bvh.duplicates();
+
+    header.nodes.offset = alignOffset(sizeof(header));
+    header.nodes.count = bvh.nodes.size();
+    header.order.offset = alignOffset(header.nodes.offset + bvh.nodes.size() * sizeof(BVHNode));
+    header.order.count = order.size();
+    header.fileSize = alignOffset(header.order.offset + order.size() * sizeof(std::uint32_t));
+    header.contentHash = contentHash(bvh.nodes.data(), bvh.nodes.size(), order.data(), order.size());
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+
+    // Meshes sharing their geometry may be built by several threads or processes at once,
+    // each writes a file of its own
+    const std::string temporaryPath = SceneCache::temporaryPathFor(cachePath);
+    std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+
+    if (!stream.good()) {
+        std::cout << "BVH cache: cannot write " << cachePath << std::endl;
+        return false;
+    }
+
+    // Pads with zeros up to the start of the next section
+    std::uint64_t written = 0;
+    auto append = [&stream, &written](std::uint64_t sectionOffset, const void* bytes, std::size_t size) {
+        static const char zeros[BVH_CACHE_ALIGNMENT] = {};
+        stream.write(zeros, static_cast<std::streamsize>(sectionOffset - written));
+        stream.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+        written = sectionOffset + size;
+    };
+
+    append(0, &header, sizeof(header));
+    append(header.nodes.offset, bvh.nodes.data(), bvh.nodes.size() * sizeof(BVHNode));
+    append(header.order.offset, order.data(), order.size() * sizeof(std::uint32_t));
+    append(header.fileSize, nullptr, 0);
+    stream.close();
+
+    if (!stream.good() || std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        std::cout << "BVH cache: cannot write " << cachePath << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+const char* BVHCache::statusName(const Status status) {
+    switch (status) {
+        case Status::Loaded:
+            return "loaded";
+        case Status::Missing:
+            return "missing";
+        case Status::Stale:
+            return "stale";
+        case Status::Invalid:
+            return "invalid";
+    }
+    return "unknown";
+}
@@ -0,0 +1,60 @@
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BVH.h"
+#include "Triangle.h"
+
+// Bumped whenever the layout of the cache file or the output of a builder changes, older caches are then rebuilt
+#define BVH_CACHE_VERSION 2
+// Given to the cache files, named after the hash of the geometry of their mesh
+#define BVH_CACHE_EXTENSION ".stbvh"
+// Appended to the path of the .obj file to name the directory its hierarchies are cached in by default
+#define BVH_CACHE_DIRECTORY_SUFFIX ".bvhcache"
+
+/*
+ * Binary image of the bottom level hierarchy of a mesh
+ * The file is a fixed header followed by 8 byte aligned sections holding the nodes of the hierarchy and,
+ * for every triangle of its leaves, the index of the triangle it is in the triangulation of the model.
+ * The header records a hash of both sections, a file whose contents were altered is ignored.
+ * Files are named after a hash of the triangles and of the builder, so meshes with the same geometry share one.
+ * Loading it is two bulk copies out of a MappedFile, the triangles are then put in the order of the leaves.
+ */
+class BVHCache {
+public:
+    enum class Status {
+        Loaded,
+        // there is no cache file
+        Missing,
+        // the cache was written for other triangles, by another version, or on a machine of another byte order
+        Stale,
+        // the cache file is truncated or does not hold a well formed hierarchy
+        Invalid
+    };
+
+    static std::uint64_t hash(const std::vector<Triangle>& triangles, BVHBuilder builder);
+
+    static std::string directoryFor(const std::string& geometryPath);
+
+    static std::string pathFor(const std::string& directory, std::uint64_t geometryHash);
+
+    static Status read(const std::string& cachePath,
+                       std::uint64_t geometryHash,
+                       std::size_t triangleCount,
+                       BVH& bvh,
+                       std::vector<unsigned int>& order);
+
+    static bool write(const std::string& cachePath,
+                      std::uint64_t geometryHash,
+                      std::size_t triangleCount,
+                      const BVH& bvh,
+                      const std::vector<unsigned int>& order);
+
+    static const char* statusName(Status status);
+};
+
+#endif // BVH_CACHE_H
@@ -0,0 +1,168 @@
+#ifndef BVH_LEAVES_H
+#define BVH_LEAVES_H
+
+#include <vector>
+
+#include "BVH.h"
+#include "CollisionInfo.h"
+#include "Ray.h"
+#include "Triangle.h"
+#include "TrianglePacket.h"
+
+/*
+ * Tests of a ray against the triangles of a leaf of the binary BVH, shared by the binary and wide traversals
+ * Leaves are identified by their node in the binary BVH, wide hierarchies keep the leaves of the binary one
+ */
+
+// Leaves tested one triangle at a time, with intersect(triangle, barycentric)
+template<typename Intersect>
+struct TriangleLeaves {
+    const std::vector<Triangle>& triangles;
+    Intersect intersect;
+
+    /**
+     * @brief closest keeps in closest the closest hit of the leaf in front of t, and its distance in t
+     */
+    void closest(unsigned int, const BVHNode& node, float& t, CollisionInfo& closest) const {
+        for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+            glm::vec3 barycentric;
+            float triangleT = intersect(triangles[i], barycentric);
+
+            if (0.0f < triangleT && triangleT < t) {
+                closest = CollisionInfo(&triangles[i], triangleT, barycentric);
+                t = triangleT;
+            }
+        }
+    }
+
+    /**
+     * @brief occluding keeps in closestTransparent the closest non-opaque hit of the leaf in front of t,
+     *        see BVH::occludingHitWith
+     *
+     * @return true as soon as an opaque hit is found, it is then in closestTransparent
+     */
+    bool occluding(unsigned int, const BVHNode& node, float& t, CollisionInfo& closestTransparent) const {
+        for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+            const Material* material = triangles[i].sharedMaterial;
+
+            if (material->isLight()) {
+                continue;
+            }
+
+            glm::vec3 barycentric;
+            float triangleT = intersect(triangles[i], barycentric);
+
+            if (triangleT <= 0.0f || triangleT >= t) {
+                continue;
+            }
+
+            closestTransparent = CollisionInfo(&triangles[i], triangleT, barycentric);
+            if (material->isPhong()) {
+                return true;
+            }
+
+            // Only keep looking for opaque triangles in front of the transparent one
+            t = triangleT;
+        }
+        return false;
+    }
+};
+
+template<typename Intersect>
+TriangleLeaves<Intersect> triangleLeaves(const std::vector<Triangle>& triangles, const Intersect& intersect) {
+    return TriangleLeaves<Intersect>{triangles, intersect};
+}
+
+// Leaves tested a packet at a time, the lanes hit are then walked in order
+// Lanes are visited like the triangles of TriangleLeaves, so both find the same hits
+struct PacketLeaves {
+    const std::vector<Triangle>& triangles;
+    const PackedTriangles& packed;
+    const Ray& ray;
+    PacketIntersector intersect;
+
+    void closest(unsigned int nodeIndex, const BVHNode& node, float& t, CollisionInfo& closest) const {
+        const unsigned int first = packed.nodePackets[nodeIndex];
+        PacketHits hits;
+
+        for (unsigned int p = first; p < first + PackedTriangles::packetCount(node.count); p++) {
+            const TrianglePacket& packet = packed.packets[p];
+
+            for (unsigned int mask = intersect(ray, packet, t, hits); mask != 0; mask &= mask - 1) {
+                const unsigned int lane = __builtin_ctz(mask);
+
+                if (hits.t[lane] < t) {
+                    t = hits.t[lane];
+                    closest = CollisionInfo(&triangles[packet.first + lane], t,
+                                            glm::vec3(1.0f - hits.u[lane] - hits.v[lane], hits.u[lane], hits.v[lane]));
+                }
+            }
+        }
+    }
+
+    bool occluding(unsigned int nodeIndex, const BVHNode& node, float& t, CollisionInfo& closestTransparent) const {
+        const unsigned int first = packed.nodePackets[nodeIndex];
+        PacketHits hits;
+
+        for (unsigned int p = first; p < first + PackedTriangles::packetCount(node.count); p++) {
+            const TrianglePacket& packet = packed.packets[p];
+
+            for (unsigned int mask = intersect(ray, packet, t, hits); mask != 0; mask &= mask - 1) {
+                const unsigned int lane = __builtin_ctz(mask);
+                const Triangle& triangle = triangles[packet.first + lane];
+
+                if (triangle.sharedMaterial->isLight() || hits.t[lane] >= t) {
+                    continue;
+                }
+
+                closestTransparent = CollisionInfo(&triangle, hits.t[lane],
+                                                   glm::vec3(1.0f - hits.u[lane] - hits.v[lane],
+                                                             hits.u[lane], hits.v[lane]));
+                if (triangle.sharedMaterial->isPhong()) {
+                    return true;
+                }
+
+                // Only keep looking for opaque triangles in front of the transparent one
+                t = hits.t[lane];
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * @brief visitLeaves calls visit with the leaf test of kernel. The kernel is picked once per ray
+ *        rather than once per triangle.
+ *
+ * @param packed the triangles packed leaf by leaf, tested by the SIMD kernel
+ *
+ * @return whatever visit returns
+ */
+template<typename Visit>
+CollisionInfo visitLeaves(const Ray& ray,
+                          const std::vector<Triangle>& triangles,
+                          const PackedTriangles& packed,
+                          const IntersectionKernel kernel,
+                          const Visit& visit) {
+    switch (kernel) {
+        case IntersectionKernel::MollerTrumbore:
+            return visit(triangleLeaves(triangles, [&ray](const Triangle& triangle, glm::vec3& barycentric) {
+                return triangle.intersectMollerTrumbore(ray, barycentric);
+            }));
+        case IntersectionKernel::Watertight: {
+            const WatertightRay watertightRay(ray);
+            return visit(triangleLeaves(triangles, [&watertightRay](const Triangle& triangle, glm::vec3& barycentric) {
+                return triangle.intersectWatertight(watertightRay, barycentric);
+            }));
+        }
+        case IntersectionKernel::Simd:
+            return visit(PacketLeaves{triangles, packed, ray, PackedTriangles::intersector(PackedTriangles::bestIsa())});
+        case IntersectionKernel::Planar:
+        default:
+            return visit(triangleLeaves(triangles, [&ray](const Triangle& triangle, glm::vec3& barycentric) {
+                return triangle.intersect(ray, barycentric);
+            }));
+    }
+}
+
+#endif // BVH_LEAVES_H
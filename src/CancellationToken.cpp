@@ -0,0 +1,13 @@
+#include "CancellationToken.h"
+
+CancellationToken::CancellationToken()
+    : cancelled(std::make_shared<std::atomic<bool>>(false)) {
+}
+
+void CancellationToken::cancel() const {
+    cancelled->store(true, std::memory_order_relaxed);
+}
+
+bool CancellationToken::isCancelled() const {
+    return cancelled->load(std::memory_order_relaxed);
+}
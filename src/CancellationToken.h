@@ -0,0 +1,24 @@
+#ifndef CANCELLATION_TOKEN_H
+#define CANCELLATION_TOKEN_H
+
+#include <atomic>
+#include <memory>
+
+/*
+ * Shared flag used to ask a render to stop early
+ * Copies share the same flag, so the owner of a job can cancel it while the job polls its own copy
+ * A default constructed token is never cancelled unless cancel is called on it or on one of its copies
+ */
+class CancellationToken {
+public:
+    CancellationToken();
+
+    void cancel() const;
+
+    bool isCancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled;
+};
+
+#endif // CANCELLATION_TOKEN_H
@@ -0,0 +1,25 @@
+#include "CollisionInfo.h"
+
+#include "Math.h"
+
+CollisionInfo::CollisionInfo()
+    : triangle(nullptr)
+      , instance(nullptr)
+      , barycentric(0.0f)
+      , t(NO_INTERSECT) {
+}
+
+CollisionInfo::CollisionInfo(const Triangle* triangle, const float t, const glm::vec3& barycentric)
+    : triangle(triangle)
+      , instance(nullptr)
+      , barycentric(barycentric)
+      , t(t) {
+}
+
+bool CollisionInfo::isHit() const {
+    return triangle != nullptr && t > 0.0f;
+}
+
+bool CollisionInfo::isShadowHit() const {
+    return isHit() && !triangle->sharedMaterial->isLight();
+}
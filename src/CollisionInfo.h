@@ -0,0 +1,29 @@
+#ifndef COLLISION_INFO_H
+#define COLLISION_INFO_H
+
+#include <glm/vec3.hpp>
+
+#include "Triangle.h"
+
+struct Instance;
+
+// Hit record of a ray against the scene
+// Refers to the triangle hit instead of copying it, along with the barycentrics computed while intersecting
+struct CollisionInfo {
+    const Triangle* triangle;
+    // placement of the mesh the triangle belongs to, the triangle is in the object space of the mesh
+    const Instance* instance;
+    glm::vec3 barycentric;
+    float t;
+
+    // No collision
+    CollisionInfo();
+
+    CollisionInfo(const Triangle* triangle, float t, const glm::vec3& barycentric);
+
+    bool isHit() const;
+
+    bool isShadowHit() const;
+};
+
+#endif // COLLISION_INFO_H
@@ -0,0 +1,60 @@
+#include "Instance.h"
+
+#include <glm/matrix.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+Instance::Instance(const unsigned int mesh, const glm::mat4& transform)
+    : mesh(mesh) {
+    setTransform(transform);
+}
+
+/**
+ * @brief Instance::setTransform moves the instance, the bounds have to be updated afterwards
+ */
+void Instance::setTransform(const glm::mat4& newTransform) {
+    transform = newTransform;
+    inverseTransform = glm::inverse(newTransform);
+    normalTransform = glm::transpose(glm::mat3(inverseTransform));
+    identity = newTransform == glm::identity<glm::mat4>();
+}
+
+/**
+ * @brief Instance::updateBounds sets bounds to the box around the 8 transformed corners of the mesh bounds
+ */
+void Instance::updateBounds(const AABB& meshBounds) {
+    bounds = AABB();
+
+    if (meshBounds.isEmpty()) {
+        return;
+    }
+
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec4 point{
+            corner & 1 ? meshBounds.max.x : meshBounds.min.x,
+            corner & 2 ? meshBounds.max.y : meshBounds.min.y,
+            corner & 4 ? meshBounds.max.z : meshBounds.min.z,
+            1.0f
+        };
+        bounds.extend(glm::vec3(transform * point));
+    }
+}
+
+/**
+ * @return ray in the object space of the mesh. The direction is not renormalised,
+ *         so distances along the ray are the same in both spaces.
+ */
+Ray Instance::toObject(const Ray& ray) const {
+    if (identity) {
+        return ray;
+    }
+
+    return Ray(inverseTransform * glm::vec4(ray.origin, 1.0f), inverseTransform * glm::vec4(ray.direction, 0.0f));
+}
+
+glm::vec3 Instance::normalToScene(const glm::vec3& normal) const {
+    if (identity) {
+        return normal;
+    }
+
+    return normalTransform * normal;
+}
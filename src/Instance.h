@@ -0,0 +1,38 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "AABB.h"
+#include "Ray.h"
+
+// Placement of a mesh in the scene
+// Rays are taken into the object space of the mesh rather than copying its triangles
+struct Instance {
+    // index of the mesh in the scene
+    unsigned int mesh;
+
+    // from the object space of the mesh to the scene
+    glm::mat4 transform;
+    glm::mat4 inverseTransform;
+    // inverse transpose of transform, takes normals to the scene
+    glm::mat3 normalTransform;
+    // the mesh is placed as is, rays and normals need no transformation
+    bool identity;
+
+    // bounds of the transformed mesh, empty if the mesh has no triangles
+    AABB bounds;
+
+    Instance(unsigned int mesh, const glm::mat4& transform);
+
+    void setTransform(const glm::mat4& newTransform);
+
+    void updateBounds(const AABB& meshBounds);
+
+    Ray toObject(const Ray& ray) const;
+
+    glm::vec3 normalToScene(const glm::vec3& normal) const;
+};
+
+#endif // INSTANCE_H
@@ -12,9 +12,10 @@ Light::Light(LightType type, glm::vec4 color, glm::vec4 pos, glm::vec4 dir, glm:
     enabled = false;
 }
 
-glm::vec4 Light::sampledPosition() const {
-    const float u = (static_cast<float>(random()) / static_cast<float>(RAND_MAX) - 0.5f) * 0.5f;
-    const float v = (static_cast<float>(random()) / static_cast<float>(RAND_MAX) - 0.5f) * 0.5f;
+glm::vec4 Light::sampledPosition(Sampler& sampler) const {
+    const glm::vec2 sample = sampler.next2D();
+    const float u = (sample.x - 0.5f) * 0.5f;
+    const float v = (sample.y - 0.5f) * 0.5f;
 
     return lightPosition + (u * tangent1 + v * tangent2);
 }
@@ -3,6 +3,8 @@
 
 #include <glm/vec4.hpp>
 
+#include "Sampler.h"
+
 class Light {
 public:
     glm::vec4 lightPosition;
@@ -31,7 +33,7 @@ public:
 
     bool enabled;
 
-    glm::vec4 sampledPosition() const;
+    glm::vec4 sampledPosition(Sampler& sampler) const;
 };
 
 #endif // LIGHT_H
@@ -0,0 +1,84 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+    : opened(false),
+      bytes(nullptr),
+      length(0),
+      mapped(false) {
+#ifdef MAPPED_FILE_MMAP
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return;
+    }
+
+    struct stat status{};
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        return;
+    }
+
+    length = static_cast<std::size_t>(status.st_size);
+
+    // Mapping an empty file fails, but it is a valid (empty) file
+    if (length > 0) {
+        void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+        if (address == MAP_FAILED) {
+            close(descriptor);
+            length = 0;
+            return;
+        }
+
+        // The file is read front to back, let the kernel read ahead
+        madvise(address, length, MADV_SEQUENTIAL);
+
+        bytes = static_cast<const char*>(address);
+        mapped = true;
+    }
+
+    // The mapping stays valid once the descriptor is closed
+    close(descriptor);
+    opened = true;
+#else
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.good()) {
+        return;
+    }
+
+    buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    bytes = buffer.data();
+    length = buffer.size();
+    opened = true;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef MAPPED_FILE_MMAP
+    if (mapped) {
+        munmap(const_cast<char*>(bytes), length);
+    }
+#endif
+}
+
+bool MappedFile::isOpen() const {
+    return opened;
+}
+
+const char* MappedFile::data() const {
+    return bytes;
+}
+
+std::size_t MappedFile::size() const {
+    return length;
+}
@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * Read-only view of a whole file
+ * Memory-mapped on POSIX systems, read into memory elsewhere
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    bool isOpen() const;
+
+    const char* data() const;
+
+    std::size_t size() const;
+
+private:
+    bool opened;
+
+    const char* bytes;
+    std::size_t length;
+
+    // true when bytes is a mapping to release, false when it points into buffer
+    bool mapped;
+    std::vector<char> buffer;
+};
+
+#endif // MAPPED_FILE_H
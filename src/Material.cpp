@@ -128,3 +128,13 @@ std::vector<Material*> Material::readMaterials(std::istream& materialStream) {
 bool Material::isLight() const {
     return name.find("light") != std::string::npos;
 }
+
+/**
+ * @return whether the material neither reflects nor refracts rays, i.e.: it is opaque
+ */
+bool Material::isPhong() const {
+    // clang-format off
+    return reflectivity == 0.0f &&
+           transparency == 0.0f;
+    // clang-format on
+}
@@ -26,6 +26,8 @@ public:
 
     bool isLight() const;
 
+    bool isPhong() const;
+
     Material();
 
     Material(glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, glm::vec3 emissive, float shininess,
@@ -0,0 +1,144 @@
+#include "Mesh.h"
+
+/**
+ * @brief Mesh::build fans every face of object into triangles and builds the hierarchy over them
+ *
+ * @param object to triangulate
+ * @param defaultMaterial given to the triangles if object has no material
+ * @param builder algorithm the hierarchy is built with
+ * @param cacheDirectory where hierarchies are cached between runs, none if empty
+ *
+ * @return Loaded if the hierarchy was read from the cache, otherwise why it had to be built
+ */
+BVHCache::Status Mesh::build(const ThreeDModel& object,
+                             Material* defaultMaterial,
+                             const BVHBuilder builder,
+                             const std::string& cacheDirectory) {
+    triangles.clear(); // Clear the list so it can be populated again
+
+    typedef unsigned int uint;
+
+    // A face of n corners is fanned into n - 2 triangles
+    triangles.reserve(object.faceVertices.size() - 2 * object.faceCount());
+
+    for (uint face = 0; face < object.faceCount(); face++) {
+        const uint first = object.faceStarts[face];
+
+        // Triangle fan around the first corner of the face
+        for (uint triangle = 0; triangle < object.faceSize(face) - 2; triangle++) {
+            Triangle t;
+
+            for (uint vertex = 0; vertex < 3; vertex++) {
+                uint faceVertex = first;
+                if (vertex != 0) {
+                    faceVertex = first + triangle + vertex;
+                }
+
+                auto v = glm::vec4(
+                    object.pool->vertices[object.faceVertices[faceVertex]].x,
+                    object.pool->vertices[object.faceVertices[faceVertex]].y,
+                    object.pool->vertices[object.faceVertices[faceVertex]].z,
+                    1.0f);
+                t.vertices[vertex] = v;
+
+                auto n = glm::vec4(
+                    object.pool->normals[object.faceNormals[faceVertex]].x,
+                    object.pool->normals[object.faceNormals[faceVertex]].y,
+                    object.pool->normals[object.faceNormals[faceVertex]].z,
+                    0.0f);
+                t.normals[vertex] = n;
+
+                auto tex = glm::vec3(
+                    object.pool->textureCoords[object.faceTexCoords[faceVertex]].x,
+                    object.pool->textureCoords[object.faceTexCoords[faceVertex]].y,
+                    0.0f);
+                t.uvs[vertex] = tex;
+
+                t.colors[vertex] = {0.7f, 0.7f, 0.7f, 1.0f};
+            }
+
+            if (object.material == nullptr) {
+                t.sharedMaterial = defaultMaterial;
+            } else {
+                t.sharedMaterial = object.material;
+            }
+
+            t.computePlanarValues();
+            triangles.push_back(t);
+        }
+    }
+
+    BVHCache::Status status = BVHCache::Status::Missing;
+
+    if (cacheDirectory.empty()) {
+        bvh.build(triangles, builder);
+    } else {
+        const std::uint64_t geometryHash = BVHCache::hash(triangles, builder);
+        const std::string cachePath = BVHCache::pathFor(cacheDirectory, geometryHash);
+        const std::size_t triangleCount = triangles.size();
+        std::vector<unsigned int> order;
+
+        status = BVHCache::read(cachePath, geometryHash, triangleCount, bvh, order);
+        if (status == BVHCache::Status::Loaded) {
+            BVH::reorder(triangles, order);
+        } else {
+            bvh.build(triangles, builder, &order);
+            BVHCache::write(cachePath, geometryHash, triangleCount, bvh, order);
+        }
+    }
+
+    packed.build(triangles, bvh);
+    bvh4.collapse(bvh);
+    bvh8.collapse(bvh);
+
+    return status;
+}
+
+/**
+ * @return the bounds of the triangles in object space, empty if there are none
+ */
+AABB Mesh::bounds() const {
+    return bvh.nodes.empty() ? AABB() : bvh.nodes[0].bounds;
+}
+
+/**
+ * @brief Mesh::closestHit finds the closest triangle hit by ray, in object space, through the hierarchy of
+ *        the given layout, see BVH::closestHit
+ */
+CollisionInfo Mesh::closestHit(const Ray& ray, const IntersectionKernel kernel, const BVHLayout layout, float maxT,
+                               TraversalStatistics* statistics) const {
+    switch (layout) {
+        case BVHLayout::Wide4:
+            return bvh4.closestHit(ray, bvh, triangles, packed, kernel, maxT, statistics);
+        case BVHLayout::Wide8:
+            return bvh8.closestHit(ray, bvh, triangles, packed, kernel, maxT, statistics);
+        case BVHLayout::Binary:
+        default:
+            return bvh.closestHit(ray, triangles, packed, kernel, maxT, statistics);
+    }
+}
+
+/**
+ * @brief Mesh::occludingHit looks for an occluder along ray, in object space, through the hierarchy of
+ *        the given layout, see BVH::occludingHit
+ */
+CollisionInfo Mesh::occludingHit(const Ray& ray, const IntersectionKernel kernel, const BVHLayout layout, float maxT,
+                                 TraversalStatistics* statistics) const {
+    switch (layout) {
+        case BVHLayout::Wide4:
+            return bvh4.occludingHit(ray, bvh, triangles, packed, kernel, maxT, statistics);
+        case BVHLayout::Wide8:
+            return bvh8.occludingHit(ray, bvh, triangles, packed, kernel, maxT, statistics);
+        case BVHLayout::Binary:
+        default:
+            return bvh.occludingHit(ray, triangles, packed, kernel, maxT, statistics);
+    }
+}
+
+/**
+ * @return the memory taken by what is derived from the triangles and their BVH: the packets and the wide hierarchies
+ */
+std::size_t Mesh::derivedBytes() const {
+    return packed.packets.size() * sizeof(TrianglePacket) + packed.nodePackets.size() * sizeof(unsigned int)
+           + bvh4.bytes() + bvh8.bytes();
+}
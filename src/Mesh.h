@@ -0,0 +1,50 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "AABB.h"
+#include "BVH.h"
+#include "Material.h"
+#include "CollisionInfo.h"
+#include "Ray.h"
+#include "BVHCache.h"
+#include "ThreeDModel.h"
+#include "Triangle.h"
+#include "TrianglePacket.h"
+#include "WideBVH.h"
+
+// Triangles of one object in its own object space, with their bottom level hierarchies
+// Shared by every Instance of the object
+class Mesh {
+public:
+    std::vector<Triangle> triangles;
+
+    BVH bvh;
+
+    // triangles packed leaf by leaf for the SIMD kernel
+    PackedTriangles packed;
+
+    // bvh collapsed into 4 and 8 wide nodes, sharing its leaves
+    WideBVH<4> bvh4;
+    WideBVH<8> bvh8;
+
+    BVHCache::Status build(const ThreeDModel& object,
+                           Material* defaultMaterial,
+                           BVHBuilder builder = BVHBuilder::BinnedSAH,
+                           const std::string& cacheDirectory = "");
+
+    AABB bounds() const;
+
+    CollisionInfo closestHit(const Ray& ray, IntersectionKernel kernel, BVHLayout layout, float maxT,
+                             TraversalStatistics* statistics = nullptr) const;
+
+    CollisionInfo occludingHit(const Ray& ray, IntersectionKernel kernel, BVHLayout layout, float maxT,
+                               TraversalStatistics* statistics = nullptr) const;
+
+    std::size_t derivedBytes() const;
+};
+
+#endif // MESH_H
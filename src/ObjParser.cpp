@@ -0,0 +1,365 @@
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <omp.h>
+#include <glm/geometric.hpp>
+
+// Smallest chunk of text given to a thread, small files are parsed by fewer threads
+#define OBJ_MIN_CHUNK_SIZE (1 << 16)
+// Chunks per thread, so that threads finishing early pick up the slack
+#define OBJ_CHUNKS_PER_THREAD 4
+// Longest mantissa computed exactly in double, anything longer goes through strtof
+#define OBJ_MAX_MANTISSA_DIGITS 15
+// Powers of ten exactly representable in double
+#define OBJ_MAX_EXACT_EXPONENT 22
+
+// usemtl found in a chunk, along with the number of faces read in the chunk before it
+struct MaterialSwitch {
+    std::string name;
+    std::size_t faces;
+};
+
+// Everything read from a chunk, the faces are stored flat
+struct ObjChunk {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> textureCoords;
+
+    std::vector<unsigned int> faceVertices;
+    std::vector<unsigned int> faceNormals;
+    std::vector<unsigned int> faceTexCoords;
+
+    // offset of every face into the flat arrays, followed by their size
+    std::vector<unsigned int> faceStarts;
+
+    std::vector<MaterialSwitch> switches;
+
+    std::size_t faceCount() const {
+        return faceStarts.size() - 1;
+    }
+};
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* skipToken(const char* p, const char* end) {
+    while (p < end && !isBlank(*p)) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * @brief parseFloat reads a decimal number at p, skipping leading blanks
+ *        Short mantissas are scaled by an exact power of ten in double, so they round like strtof
+ *        but for double rounding ties. Longer mantissas and large exponents fall back to strtof.
+ *
+ * @param p start of the number, advanced past it on success
+ * @param end of the line
+ * @param value set to the number read
+ *
+ * @return false if there is no number at p
+ */
+static bool parseFloat(const char*& p, const char* end, float& value) {
+    const char* start = skipBlanks(p, end);
+    const char* q = start;
+
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+        negative = *q == '-';
+        q++;
+    }
+
+    std::uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigit = false;
+    bool exact = true;
+
+    for (; q < end && isDigit(*q); q++) {
+        anyDigit = true;
+        if (digits == 0 && *q == '0') {
+            continue;
+        }
+        if (digits < OBJ_MAX_MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(*q - '0');
+            digits++;
+        } else {
+            exact = false;
+        }
+    }
+
+    if (q < end && *q == '.') {
+        for (q++; q < end && isDigit(*q); q++) {
+            anyDigit = true;
+            if (digits == 0 && *q == '0') {
+                exponent--;
+                continue;
+            }
+            if (digits < OBJ_MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + static_cast<std::uint64_t>(*q - '0');
+                digits++;
+                exponent--;
+            } else {
+                exact = false;
+            }
+        }
+    }
+
+    if (!anyDigit) {
+        return false;
+    }
+
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        const char* e = q + 1;
+        if (e < end && *e == '+') {
+            e++;
+        }
+
+        int exponentValue = 0;
+        auto [next, error] = std::from_chars(e, end, exponentValue);
+        // Without digits the 'e' is not part of the number
+        if (error == std::errc()) {
+            exponent += exponentValue;
+            q = next;
+        }
+    }
+
+    if (exact && exponent >= -OBJ_MAX_EXACT_EXPONENT && exponent <= OBJ_MAX_EXACT_EXPONENT) {
+        static const double powersOfTen[OBJ_MAX_EXACT_EXPONENT + 1] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        double result = static_cast<double>(mantissa);
+        result = exponent < 0 ? result / powersOfTen[-exponent] : result * powersOfTen[exponent];
+        value = static_cast<float>(negative ? -result : result);
+    } else {
+        value = std::strtof(std::string(start, q).c_str(), nullptr);
+    }
+
+    p = q;
+    return true;
+}
+
+static bool parseIndex(const char*& p, const char* end, unsigned int& index) {
+    auto [next, error] = std::from_chars(p, end, index);
+    if (error != std::errc()) {
+        return false;
+    }
+
+    p = next;
+    return true;
+}
+
+static glm::vec3 parseVector(const char* p, const char* end, int components) {
+    glm::vec3 vector(0.0f);
+
+    for (int i = 0; i < components; i++) {
+        float value;
+        if (!parseFloat(p, end, value)) {
+            break;
+        }
+        vector[i] = value;
+    }
+
+    return vector;
+}
+
+/**
+ * @brief parseFace reads the vertex/texture/normal index triples of a face, ignoring corners
+ *        written in any other form. Faces with fewer than 3 corners are discarded.
+ */
+static void parseFace(const char* p, const char* end, ObjChunk& chunk) {
+    const std::size_t first = chunk.faceVertices.size();
+
+    for (p = skipBlanks(p, end); p < end; p = skipBlanks(skipToken(p, end), end)) {
+        unsigned int vertexID;
+        unsigned int texCoordID;
+        unsigned int normalID;
+
+        const char* q = p;
+        if (!parseIndex(q, end, vertexID) || q == end || *q++ != '/'
+            || !parseIndex(q, end, texCoordID) || q == end || *q++ != '/'
+            || !parseIndex(q, end, normalID)) {
+            continue;
+        }
+
+        // .obj uses 1-based numbering, where our arrays use 0-based
+        chunk.faceVertices.push_back(vertexID - 1);
+        chunk.faceTexCoords.push_back(texCoordID - 1);
+        chunk.faceNormals.push_back(normalID - 1);
+    }
+
+    if (chunk.faceVertices.size() - first > 2) {
+        chunk.faceStarts.push_back(static_cast<unsigned int>(chunk.faceVertices.size()));
+    } else {
+        chunk.faceVertices.resize(first);
+        chunk.faceTexCoords.resize(first);
+        chunk.faceNormals.resize(first);
+    }
+}
+
+static bool startsWith(const char* p, const char* end, const char* keyword) {
+    const std::size_t length = std::strlen(keyword);
+    return static_cast<std::size_t>(end - p) > length && std::memcmp(p, keyword, length) == 0 && isBlank(p[length]);
+}
+
+static void parseChunk(const char* begin, const char* end, ObjChunk& chunk) {
+    chunk.faceStarts.push_back(0);
+
+    for (const char* line = begin; line < end;) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+
+        const char* p = skipBlanks(line, lineEnd);
+
+        if (startsWith(p, lineEnd, "v")) {
+            chunk.vertices.push_back(parseVector(p + 1, lineEnd, 3));
+        } else if (startsWith(p, lineEnd, "vn")) {
+            chunk.normals.push_back(glm::normalize(parseVector(p + 2, lineEnd, 3)));
+        } else if (startsWith(p, lineEnd, "vt")) {
+            chunk.textureCoords.push_back(parseVector(p + 2, lineEnd, 2));
+        } else if (startsWith(p, lineEnd, "f")) {
+            parseFace(p + 1, lineEnd, chunk);
+        } else if (startsWith(p, lineEnd, "usemtl")) {
+            const char* name = skipBlanks(p + 6, lineEnd);
+            chunk.switches.push_back({std::string(name, skipToken(name, lineEnd)), chunk.faceCount()});
+        }
+
+        line = lineEnd + 1;
+    }
+}
+
+/**
+ * @brief stitch concatenates the chunks in order and splits the faces into models on material switches
+ */
+static std::vector<ThreeDModel> stitch(const std::vector<ObjChunk>& chunks, const std::vector<Material*>& materials) {
+    // Vertex data is shared between everyone
+    std::shared_ptr<VertexPool> pool = std::make_shared<VertexPool>();
+
+    std::size_t vertexCount = 0;
+    std::size_t normalCount = 0;
+    std::size_t textureCoordCount = 0;
+    for (const ObjChunk& chunk : chunks) {
+        vertexCount += chunk.vertices.size();
+        normalCount += chunk.normals.size();
+        textureCoordCount += chunk.textureCoords.size();
+    }
+
+    pool->vertices.reserve(vertexCount);
+    pool->normals.reserve(normalCount);
+    pool->textureCoords.reserve(textureCoordCount);
+
+    for (const ObjChunk& chunk : chunks) {
+        pool->vertices.insert(pool->vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+        pool->normals.insert(pool->normals.end(), chunk.normals.begin(), chunk.normals.end());
+        pool->textureCoords.insert(pool->textureCoords.end(), chunk.textureCoords.begin(), chunk.textureCoords.end());
+    }
+
+    std::vector<ThreeDModel> result;
+    Material* material = nullptr;
+    ThreeDModel model;
+    model.pool = pool;
+
+    // Appends a range of faces of chunk to the model, their starts follow the corners already in the model
+    auto addFaces = [&model](const ObjChunk& chunk, std::size_t first, std::size_t last) {
+        auto begin = static_cast<long>(chunk.faceStarts[first]);
+        auto end = static_cast<long>(chunk.faceStarts[last]);
+
+        model.faceVertices.insert(model.faceVertices.end(), chunk.faceVertices.begin() + begin, chunk.faceVertices.begin() + end);
+        model.faceNormals.insert(model.faceNormals.end(), chunk.faceNormals.begin() + begin, chunk.faceNormals.begin() + end);
+        model.faceTexCoords.insert(model.faceTexCoords.end(), chunk.faceTexCoords.begin() + begin, chunk.faceTexCoords.begin() + end);
+
+        for (std::size_t face = first; face < last; face++) {
+            model.faceStarts.push_back(model.faceStarts.back() + chunk.faceStarts[face + 1] - chunk.faceStarts[face]);
+        }
+    };
+
+    for (const ObjChunk& chunk : chunks) {
+        std::size_t face = 0;
+
+        for (const MaterialSwitch& materialSwitch : chunk.switches) {
+            addFaces(chunk, face, materialSwitch.faces);
+            face = materialSwitch.faces;
+
+            for (Material* candidate : materials) {
+                if (candidate->name != materialSwitch.name) {
+                    continue;
+                }
+
+                if (material == nullptr) {
+                    material = candidate;
+                    model.material = material;
+                    break;
+                }
+
+                result.push_back(std::move(model));
+                model = ThreeDModel();
+                model.pool = pool;
+                material = candidate;
+                model.material = material;
+            }
+        }
+
+        addFaces(chunk, face, chunk.faceCount());
+    }
+
+    model.material = material;
+    result.push_back(std::move(model));
+
+    return result;
+}
+
+/**
+ * @brief ObjParser::parse reads the models in the .obj text [data, data + size)
+ *
+ * @param materials the models may refer to through usemtl
+ *
+ * @return the models, split on every switch to a known material
+ */
+std::vector<ThreeDModel> ObjParser::parse(const char* data, std::size_t size, const std::vector<Material*>& materials) {
+    const std::size_t chunkCount = std::max<std::size_t>(1, std::min<std::size_t>(
+        static_cast<std::size_t>(omp_get_max_threads()) * OBJ_CHUNKS_PER_THREAD,
+        size / OBJ_MIN_CHUNK_SIZE));
+
+    // Chunks start right after a newline, so no line is split between two chunks
+    std::vector<const char*> bounds{data};
+    for (std::size_t c = 1; c < chunkCount; c++) {
+        const char* bound = std::max(data + size * c / chunkCount, bounds.back());
+        const void* newline = std::memchr(bound, '\n', static_cast<std::size_t>(data + size - bound));
+
+        bounds.push_back(newline != nullptr ? static_cast<const char*>(newline) + 1 : data + size);
+    }
+    bounds.push_back(data + size);
+
+    std::vector<ObjChunk> chunks(chunkCount);
+
+    // clang-format off
+#pragma omp parallel for schedule(dynamic)
+    // clang-format on
+    for (int c = 0; c < static_cast<int>(chunkCount); c++) {
+        parseChunk(bounds[c], bounds[c + 1], chunks[c]);
+    }
+
+    return stitch(chunks, materials);
+}
@@ -0,0 +1,21 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "Material.h"
+#include "ThreeDModel.h"
+
+/*
+ * Parser for .obj geometry held in memory, typically a MappedFile
+ * The text is split into chunks on line boundaries which are parsed in parallel, then stitched in order.
+ * Produces the same models as ThreeDModel::readObjectStreamMaterial:
+ * one model per usemtl switch to a known material, all sharing one vertex pool.
+ */
+class ObjParser {
+public:
+    static std::vector<ThreeDModel> parse(const char* data, std::size_t size, const std::vector<Material*>& materials);
+};
+
+#endif // OBJ_PARSER_H
@@ -1,49 +1,66 @@
 #include "Random.h"
 
-#include <random>
-#include <glm/ext/matrix_transform.hpp>
-#include <glm/ext/quaternion_geometric.hpp>
-
-glm::vec3 randomMonteCarloDirection(const glm::vec3& normal) {
-    float randomCos = static_cast<float>(random()) / static_cast<float>(RAND_MAX) * 2.0f - 1.0f;
-    float randomPhi = static_cast<float>(random()) / static_cast<float>(RAND_MAX);
-
-    // Generate a random direction in the hemisphere
-    float theta = std::acos(randomCos);
-    float phi = 2.0 * M_PI * randomPhi;
-
-    // Convert spherical coordinates to Cartesian coordinates
-    float x = std::sin(theta) * std::cos(phi);
-    float y = std::sin(theta) * std::sin(phi);
-    float z = std::cos(theta);
-
-    // Compute axes of rotation matrix
-    glm::vec3 n = glm::normalize(normal);
-    glm::vec3 nt = glm::vec3(n.z, 0, -n.x);
-    // Case in which n = (0, 1, 0)
-    if (std::abs(glm::length(nt)) < std::numeric_limits<float>::epsilon()) {
-        nt = glm::vec3(1.0f, 0.0f, 0.0f);
-    }
-    glm::vec3 ns = glm::cross(nt, n);
+#include <algorithm>
+#include <cmath>
 
-    // Create rotation matrix
-    auto r = glm::identity<glm::mat3>();
+OrthonormalBasis::OrthonormalBasis(const glm::vec3& normal)
+    : normal(normal) {
+    // +1 or -1 depending on the hemisphere of the normal, copysign compiles to a bit operation
+    const float sign = std::copysign(1.0f, normal.z);
+    const float a = -1.0f / (sign + normal.z);
+    const float b = normal.x * normal.y * a;
 
-    // Set nt as first column
-    r[0][0] = nt[0];
-    r[1][0] = nt[1];
-    r[2][0] = nt[2];
+    tangent = glm::vec3(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+    bitangent = glm::vec3(b, sign + normal.y * normal.y * a, -normal.y);
+}
 
-    // Set n as second column
-    r[0][1] = n[0];
-    r[1][1] = n[1];
-    r[2][1] = n[2];
+/**
+ * @return local, given with z along the normal, in the frame the normal is given in
+ */
+glm::vec3 OrthonormalBasis::toWorld(const glm::vec3& local) const {
+    return local.x * tangent + local.y * bitangent + local.z * normal;
+}
 
-    // Set ns as third column
-    r[0][2] = ns[0];
-    r[1][2] = ns[1];
-    r[2][2] = ns[2];
+/**
+ * @brief sampleCosineHemisphere projects a uniform point of the unit disc onto the hemisphere (Malley's method)
+ *
+ * @param u uniform in [0..1)^2
+ *
+ * @return a direction around z with density cos(theta) / pi
+ */
+DirectionSample sampleCosineHemisphere(const glm::vec2& u) {
+    const float radius = std::sqrt(u.x);
+    const float phi = 2.0f * static_cast<float>(M_PI) * u.y;
+    const float cosTheta = std::sqrt(std::max(0.0f, 1.0f - u.x));
+
+    return {
+        glm::vec3(radius * std::cos(phi), radius * std::sin(phi), cosTheta),
+        cosTheta / static_cast<float>(M_PI)
+    };
+}
 
-    // Transform the direction to the local coordinate system
-    return r * glm::vec3(x, y, z);
+/**
+ * @param u uniform in [0..1)^2
+ *
+ * @return a direction with density 1 / (4 pi), below the surface half of the time
+ */
+DirectionSample sampleUniformSphere(const glm::vec2& u) {
+    const float cosTheta = 1.0f - 2.0f * u.x;
+    const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    const float phi = 2.0f * static_cast<float>(M_PI) * u.y;
+
+    return {
+        glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta),
+        1.0f / (4.0f * static_cast<float>(M_PI))
+    };
+}
+
+DirectionSample sampleDirection(const HemisphereSampling sampling, const glm::vec2& u) {
+    switch (sampling) {
+        case HemisphereSampling::UniformSphere:
+            return sampleUniformSphere(u);
+        case HemisphereSampling::Cosine:
+        default:
+            return sampleCosineHemisphere(u);
+    }
 }
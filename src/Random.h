@@ -1,8 +1,44 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
-glm::vec3 randomMonteCarloDirection(const glm::vec3& normal);
+#include "Sampler.h"
+
+// Distribution the directions of the indirect lighting samples are drawn from
+enum class HemisphereSampling {
+    // proportional to the cosine with the normal over the hemisphere, matching the Lambertian term
+    Cosine,
+    // uniform over the whole sphere, half the directions point into the surface and contribute nothing
+    UniformSphere
+};
+
+// Direction in the local frame of a surface, z along the normal, with its probability density per solid angle
+struct DirectionSample {
+    glm::vec3 direction;
+    float pdf;
+};
+
+/*
+ * Orthonormal basis around a unit normal, built once per shading point
+ * Uses the branchless construction of Duff et al., "Building an Orthonormal Basis, Revisited" (2017):
+ * no square root, no normalisation and no special case for normals along an axis
+ */
+struct OrthonormalBasis {
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    glm::vec3 normal;
+
+    explicit OrthonormalBasis(const glm::vec3& normal);
+
+    glm::vec3 toWorld(const glm::vec3& local) const;
+};
+
+DirectionSample sampleCosineHemisphere(const glm::vec2& u);
+
+DirectionSample sampleUniformSphere(const glm::vec2& u);
+
+DirectionSample sampleDirection(HemisphereSampling sampling, const glm::vec2& u);
 
 #endif // RANDOM_H
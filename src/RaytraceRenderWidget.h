@@ -3,15 +3,14 @@
 
 #include <mutex>
 #include <vector>
-#include <thread>
 
 #include <QMouseEvent>
 #include <QOpenGLWidget>
 
-#include "Ray.h"
+#include "CancellationToken.h"
+#include "Raytracer.h"
+#include "RenderJob.h"
 #include "RenderParameters.h"
-#include "Scene.h"
-#include "SurfaceElement.h"
 #include "ThreeDModel.h"
 
 // Render widget with arcball linked to an arcball widget
@@ -23,16 +22,23 @@ private:
 
     RenderParameters* renderParameters;
 
+    // Image on display, guarded by frameBufferMutex as it is resized by Qt and published to by the render job
     RGBAImage frameBuffer;
+    std::mutex frameBufferMutex;
 
-    // Separate thread to trigger re-rendering
-    std::thread raytracingThread;
+    // Image being rendered, only touched by the render job
+    RGBAImage renderBuffer;
 
-    Scene scene;
+    Raytracer raytracer;
+
+    // Declared last so the job is stopped before the buffers it writes to are destroyed
+    RenderJob renderJob;
 
     void forceRepaint();
 
-    void RaytraceMultithreaded();
+    void RaytraceMultithreaded(const CancellationToken& token);
+
+    void publishRenderBuffer();
 
 public:
     // constructor
@@ -46,6 +52,8 @@ public:
 
     void Raytrace();
 
+    void Stop();
+
     // destructor
     ~RaytraceRenderWidget();
 
@@ -67,36 +75,12 @@ protected:
     virtual void mouseReleaseEvent(QMouseEvent* event);
 
 private:
-    glm::mat4 modelView;
-
     float aspectRatio() const;
 
     float widgetWidth() const;
 
     float widgetHeight() const;
 
-    bool isCorner(int x, int y) const;
-
-    std::pair<float, float> sampledPixel(float i, float j) const;
-
-    Ray rayToPixel(float pixelX, float pixelY, float aspectRatio) const;
-
-    glm::vec4 raytraceColour(const Ray& ray, float refractiveIndex, int bounces) const;
-
-    glm::vec4 pathtraceColour(const Ray& ray, float refractiveIndex, int bounces) const;
-
-    glm::vec4 traceColour(const Ray& ray, float refractiveIndex, int bounces, bool isPrimaryRay) const;
-
-    glm::vec4 surfaceColour(const SurfaceElement& surfel, const glm::vec3& eye) const;
-
-    glm::vec4 directLightingColour(const SurfaceElement& surfel, const glm::vec3& eye) const;
-
-    glm::vec4 shadowModulation(const glm::vec3& point, const Light* light) const;
-
-    bool isShadowHit(const glm::vec3& lightPosition, const glm::vec3& point) const;
-
-    float reflectance(const Ray& ray, const SurfaceElement& surfel, float mediumRefractiveIndex) const;
-
 signals:
     // these are general purpose signals, which scale the drag to
     // the notional unit sphere and pass it to the controller for handling
@@ -106,6 +90,11 @@ signals:
     void continueScaledDrag(float x, float y);
 
     void endScaledDrag(float x, float y);
+
+    // emitted from the render job, connections to it are queued
+    void raytraceFinished(double milliseconds, double raysPerSecond);
+
+    void progressivePassFinished(unsigned int samples, double elapsedMilliseconds);
 };
 
 #endif
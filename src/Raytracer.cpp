@@ -0,0 +1,1105 @@
+#include "Raytracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <omp.h>
+#include <ext/matrix_transform.hpp>
+#include <gtx/string_cast.hpp>
+
+#include "Instance.h"
+#include "Random.h"
+#include "TileScheduler.h"
+
+#define N_LOOPS 100
+#define N_AA_SAMPLES 10
+#define N_SS_SAMPLES 20
+// Rays traced along a path before Russian roulette may end it
+#define ROULETTE_DEPTH 2
+// Samples added to the pixels that have not converged by every round of adaptive sampling
+#define ADAPTIVE_STEP 4
+
+constexpr glm::vec3 camera{0.0f};
+constexpr float collisionBias = 0.001f;
+constexpr float airRefractiveIndex = 1.0003f;
+
+constexpr glm::vec4 NoColour{0.0f};
+
+double PathStatistics::averageLength() const {
+    return paths > 0 ? static_cast<double>(rays) / static_cast<double>(paths) : 0.0;
+}
+
+TraceContext::TraceContext(const std::uint64_t seed, const SampleSequence sequence, const unsigned int samplesPerPixel)
+    : sampler(seed, sequence, samplesPerPixel),
+      rays(0),
+      depth(0),
+      pathStatistics{} {
+}
+
+double RenderStatistics::raysPerSecond() const {
+    return renderMilliseconds > 0.0 ? static_cast<double>(rays) / (renderMilliseconds / 1000.0) : 0.0;
+}
+
+double HitStatistics::nanosecondsPerRay() const {
+    return rays > 0 ? milliseconds * 1.0e6 / static_cast<double>(rays) : 0.0;
+}
+
+Raytracer::Raytracer(
+    std::vector<ThreeDModel>* objects,
+    RenderParameters* renderParameters)
+    : scene(objects, renderParameters),
+      renderParameters(renderParameters),
+      inverseModelView(glm::identity<glm::mat4>()),
+      imageWidth(0),
+      imageHeight(0) {
+}
+
+/**
+ * @return the samples per pixel the sample sequence is laid out for: renderParameters->sequenceSamples if set,
+ *         otherwise the anti-aliasing samples of a Monte Carlo render, at most adaptiveMaxSamples with adaptive sampling
+ */
+unsigned int Raytracer::samplesPerPixel() const {
+    if (renderParameters->sequenceSamples > 0) {
+        return renderParameters->sequenceSamples;
+    }
+
+    if (!renderParameters->monteCarloEnabled) {
+        return 1;
+    }
+
+    return renderParameters->adaptiveThreshold > 0.0f ? renderParameters->adaptiveMaxSamples : N_AA_SAMPLES;
+}
+
+/**
+ * @return true if adaptive sampling is done with pixel (i, j): it has adaptiveMaxSamples samples,
+ *         or at least adaptiveMinSamples and its mean is known within adaptiveThreshold
+ */
+bool Raytracer::isConverged(const int i, const int j) const {
+    const unsigned int count = accumulation.sampleCount(j, i);
+
+    if (count >= renderParameters->adaptiveMaxSamples) {
+        return true;
+    }
+
+    return count >= renderParameters->adaptiveMinSamples
+           && accumulation.converged(j, i, renderParameters->adaptiveThreshold);
+}
+
+/**
+ * @brief Raytracer::findSampledPixels marks the pixels adaptive sampling adds samples to: those under
+ *        adaptiveMaxSamples with a pixel that has not converged in their 3x3 neighbourhood, themselves included.
+ *        A few samples may all agree by chance, at the edge of a shadow for instance, so a pixel only stops
+ *        once its neighbours agree too. Every pixel is marked without adaptive sampling.
+ *
+ * @param sampled set to 1 for every marked pixel and 0 for the others, row by row
+ *
+ * @return the number of marked pixels
+ */
+unsigned long long Raytracer::findSampledPixels(std::vector<unsigned char>& sampled) const {
+    sampled.assign(static_cast<unsigned long>(imageWidth * imageHeight), 1);
+
+    if (renderParameters->adaptiveThreshold <= 0.0f) {
+        return sampled.size();
+    }
+
+    std::vector<unsigned char> converged(sampled.size());
+    unsigned long long marked = 0;
+    const int threads = static_cast<int>(std::max(1u, renderParameters->threads));
+
+    // clang-format off
+#pragma omp parallel for num_threads(threads)
+    // clang-format on
+    for (int j = 0; j < imageHeight; j++) {
+        for (int i = 0; i < imageWidth; i++) {
+            converged[j * imageWidth + i] = isConverged(i, j);
+        }
+    }
+
+    // clang-format off
+#pragma omp parallel for num_threads(threads) reduction(+ : marked)
+    // clang-format on
+    for (int j = 0; j < imageHeight; j++) {
+        for (int i = 0; i < imageWidth; i++) {
+            bool isSampled = false;
+
+            if (accumulation.sampleCount(j, i) < renderParameters->adaptiveMaxSamples) {
+                for (int y = std::max(0, j - 1); y <= std::min<int>(imageHeight - 1, j + 1); y++) {
+                    for (int x = std::max(0, i - 1); x <= std::min<int>(imageWidth - 1, i + 1); x++) {
+                        isSampled = isSampled || !converged[y * imageWidth + x];
+                    }
+                }
+            }
+
+            sampled[j * imageWidth + i] = isSampled;
+            marked += isSampled;
+        }
+    }
+
+    return marked;
+}
+
+bool Raytracer::isCorner(int x, int y) const {
+    // clang-format off
+    return (x == 0 && y == 0) ||
+           (x == 0 && y == imageHeight - 1) ||
+           (x == imageWidth - 1 && y == 0) ||
+           (x == imageWidth - 1 && y == imageHeight - 1);
+    // clang-format on
+}
+
+/**
+ * @param pixelX location of the pixel in x-axis
+ * @param pixelY location of the pixel in y-axis
+ * @param aspectRatio of the image
+ *
+ * @return a Ray with origin at camera and direction pointing towards the pixel (x, y),
+ *         in the object space of the scene
+ */
+Ray Raytracer::rayToPixel(
+    const float pixelX,
+    const float pixelY,
+    const float aspectRatio
+) const {
+    float xNdcs = (pixelX / static_cast<float>(imageWidth) - 0.5f) * 2.0f;
+    float yNdcs = (pixelY / static_cast<float>(imageHeight) - 0.5f) * 2.0f;
+
+    float x;
+    float y;
+
+    if (aspectRatio > 1.0f) {
+        // Landscape case, x-axis is stretched
+        x = xNdcs * aspectRatio;
+        y = yNdcs;
+    } else {
+        // Portrait case, y-axis is stretched
+        x = xNdcs;
+        y = yNdcs / aspectRatio;
+    }
+
+    if (renderParameters->orthoProjection) {
+        return Ray(
+            inverseModelView * glm::vec4(x, y, 0.0f, 1.0f),
+            inverseModelView * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f));
+    }
+
+    glm::vec3 direction = glm::normalize(glm::vec3(
+            x - camera.x,
+            y - camera.y,
+            // Camera plane is at (-1) given that Z+ points outside the screen
+            -1.0f - camera.z)
+    );
+
+    if (isCorner(pixelX, pixelY)) {
+        std::cout << std::endl;
+        std::cout << "Ray to pixel -> (" << pixelX << ", " << pixelY << ")" << std::endl;
+
+        std::cout << "Origin: " << glm::to_string(camera) << std::endl;
+        std::cout << "Direction: " << glm::to_string(direction) << std::endl;
+    }
+
+    return Ray(inverseModelView * glm::vec4(camera, 1.0f), inverseModelView * glm::vec4(direction, 0.0f));
+}
+
+std::pair<float, float> Raytracer::sampledPixel(const float i, const float j, TraceContext& context) const {
+    const glm::vec2 jitter = context.sampler.next2D() - 0.5f;
+
+    return {std::clamp(i + jitter.x, 0.0f, static_cast<float>(imageWidth)), std::clamp(j + jitter.y, 0.0f, static_cast<float>(imageHeight))};
+}
+
+/**
+ * @brief Raytracer::pixelSample traces one anti-aliased sample of pixel (i, j)
+ *
+ * @param sampleIndex index of the sample within the pixel, selects the sample sequence
+ *
+ * @return the linear colour of the sample
+ */
+glm::vec4 Raytracer::pixelSample(
+    const int i,
+    const int j,
+    const unsigned int sampleIndex,
+    const float aspectRatio,
+    TraceContext& context
+) const {
+    context.sampler.startPixelSample(i, j, sampleIndex);
+    const auto [si, sj] = sampledPixel(i, j, context);
+    const Ray rayForPixel = rayToPixel(si, sj, aspectRatio);
+
+    return raytraceColour(rayForPixel, airRefractiveIndex, renderParameters->maxBounces, context);
+}
+
+/**
+ * @brief Raytracer::traceTiles calls shade on every pixel of the image from renderParameters->threads threads.
+ *        Pixels are handed out in tiles of renderParameters->tileSize by a work-stealing TileScheduler.
+ *
+ * @param shade called as shade(i, j, context) for every pixel, with the context of the calling thread
+ * @param token polled once per tile, tiles left when it is cancelled are skipped
+ * @param threadStatistics set to the busy and idle time and the tile counts of every thread
+ * @param pathStatistics set to the lengths of the paths traced
+ *
+ * @return the number of rays cast
+ */
+template<typename PixelFunction>
+unsigned long long Raytracer::traceTiles(
+    const PixelFunction& shade,
+    const CancellationToken& token,
+    std::vector<ThreadStatistics>& threadStatistics,
+    PathStatistics& pathStatistics
+) const {
+    const int threads = static_cast<int>(std::max(1u, renderParameters->threads));
+
+    TileScheduler scheduler(imageWidth, imageHeight, static_cast<int>(renderParameters->tileSize), threads);
+    threadStatistics.assign(threads, ThreadStatistics{});
+
+    unsigned long long rays = 0;
+    unsigned long long paths = 0;
+    unsigned long long pathRays = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // clang-format off
+#pragma omp parallel num_threads(threads) reduction(+ : rays, paths, pathRays)
+    // clang-format on
+    {
+        const int thread = omp_get_thread_num();
+        ThreadStatistics& statistics = threadStatistics[thread];
+
+        // Thread-local state, the generator is re-seeded for every pixel sample
+        TraceContext context(renderParameters->seed, renderParameters->sampleSequence, samplesPerPixel());
+
+        Tile tile{};
+        bool stolen = false;
+
+        while (!token.isCancelled() && scheduler.next(thread, tile, stolen)) {
+            auto tileStart = std::chrono::steady_clock::now();
+
+            for (int j = tile.y0; j < tile.y1; j++) {
+                for (int i = tile.x0; i < tile.x1; i++) {
+                    shade(i, j, context);
+                }
+            }
+
+            statistics.busyMilliseconds +=
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tileStart).count();
+            statistics.tiles++;
+            if (stolen) {
+                statistics.stolenTiles++;
+            }
+        }
+
+        rays += context.rays;
+        paths += context.pathStatistics.paths;
+        pathRays += context.pathStatistics.rays;
+    }
+
+    pathStatistics.paths = paths;
+    pathStatistics.rays = pathRays;
+
+    // Threads are idle whenever they are not tracing, including while waiting for the last tile
+    auto end = std::chrono::steady_clock::now();
+    const double frameMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    for (ThreadStatistics& statistics : threadStatistics) {
+        statistics.idleMilliseconds = std::max(0.0, frameMilliseconds - statistics.busyMilliseconds);
+    }
+
+    return rays;
+}
+
+/**
+ * @brief Raytracer::prepare updates the scene to the current view and adopts the resolution of image.
+ *        Only the camera moves with the view, the scene stays in object space.
+ */
+void Raytracer::prepare(const RGBAImage& image) {
+    inverseModelView = glm::inverse(scene.modelView());
+    scene.updateScene();
+
+    imageWidth = image.width;
+    imageHeight = image.height;
+}
+
+/**
+ * @brief Raytracer::render updates the scene and traces every pixel of image, in parallel.
+ *
+ * @param image target of the render, its size determines the resolution
+ * @param token polled once per tile, tiles left when it is cancelled are skipped
+ *
+ * @return the timings and ray counts of the frame
+ */
+RenderStatistics Raytracer::render(RGBAImage& image, const CancellationToken& token) {
+    std::cout << "Start Raytracing..." << std::endl;
+
+    RenderStatistics statistics{};
+    statistics.threads = static_cast<int>(std::max(1u, renderParameters->threads));
+
+    auto start = std::chrono::steady_clock::now();
+
+    prepare(image);
+
+    auto sceneEnd = std::chrono::steady_clock::now();
+
+    auto aspectRatio = static_cast<float>(imageWidth) / static_cast<float>(imageHeight);
+    std::cout << "Aspect Ratio: " << aspectRatio << std::endl;
+
+    image.clear(RGBAValue(0.0f, 0.0f, 0.0f, 1.0f));
+    accumulation.resize(imageWidth, imageHeight);
+
+    auto shade = [&](const int i, const int j, TraceContext& context) {
+        if (renderParameters->monteCarloEnabled) {
+            // Anti-aliasing
+            for (unsigned int s = 0; s < N_AA_SAMPLES; s++) {
+                accumulation.add(j, i, glm::vec3(pixelSample(i, j, s, aspectRatio, context)));
+            }
+        } else {
+            // No anti-aliasing
+            context.sampler.startPixelSample(i, j, 0);
+            const Ray rayForPixel = rayToPixel(i, j, aspectRatio);
+            accumulation.add(j, i, glm::vec3(raytraceColour(rayForPixel, airRefractiveIndex,
+                                                            renderParameters->maxBounces, context)));
+        }
+
+        image[j][i] = toneMap(accumulation.mean(j, i));
+    };
+
+    unsigned long long rays = 0;
+    if (renderParameters->monteCarloEnabled && renderParameters->adaptiveThreshold > 0.0f) {
+        rays = traceAdaptive(aspectRatio, token, statistics.threadStatistics, statistics.pathStatistics);
+
+        // clang-format off
+#pragma omp parallel for num_threads(statistics.threads)
+        // clang-format on
+        for (int j = 0; j < imageHeight; j++) {
+            for (int i = 0; i < imageWidth; i++) {
+                image[j][i] = toneMap(accumulation.mean(j, i));
+            }
+        }
+    } else {
+        rays = traceTiles(shade, token, statistics.threadStatistics, statistics.pathStatistics);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    statistics.sceneMilliseconds = std::chrono::duration<double, std::milli>(sceneEnd - start).count();
+    statistics.renderMilliseconds = std::chrono::duration<double, std::milli>(end - sceneEnd).count();
+    statistics.rays = rays;
+    statistics.samples = accumulation.totalSamples();
+    statistics.cancelled = token.isCancelled();
+
+    if (statistics.cancelled) {
+        std::cout << std::endl << "Raytracing cancelled after " << statistics.rays << " rays" << std::endl;
+        return statistics;
+    }
+
+    std::cout << std::endl
+            << "Done Raytracing in " << statistics.sceneMilliseconds + statistics.renderMilliseconds << " ms"
+            << " on " << statistics.threads << " threads!"
+            << std::endl
+            << "Scene: " << statistics.sceneMilliseconds << " ms "
+            << "(BVH build " << scene.buildMillisecondsPerMillionTriangles() << " ms per million triangles), "
+            << "Render: " << statistics.renderMilliseconds << " ms, "
+            << statistics.rays << " rays, "
+            << statistics.raysPerSecond() << " rays/s, "
+            << static_cast<double>(statistics.samples) / static_cast<double>(imageWidth * imageHeight)
+            << " samples per pixel, "
+            << "average path length " << statistics.pathStatistics.averageLength()
+            << std::endl;
+
+    for (unsigned int t = 0; t < statistics.threadStatistics.size(); t++) {
+        const ThreadStatistics& thread = statistics.threadStatistics[t];
+        std::cout << "Thread " << t << ": "
+                << "busy " << thread.busyMilliseconds << " ms, "
+                << "idle " << thread.idleMilliseconds << " ms, "
+                << thread.tiles << " tiles (" << thread.stolenTiles << " stolen)"
+                << std::endl;
+    }
+
+    return statistics;
+}
+
+/**
+ * @brief Raytracer::traceAdaptive samples every pixel of the accumulation buffer adaptively, in rounds:
+ *        adaptiveMinSamples samples for every pixel first, then ADAPTIVE_STEP more on every round
+ *        for the pixels marked by findSampledPixels, until none is left.
+ *
+ * @param token polled once per tile, rounds left when it is cancelled are skipped
+ * @param threadStatistics set to the busy and idle time and the tile counts of every thread, over all the rounds
+ * @param pathStatistics set to the lengths of the paths traced
+ *
+ * @return the number of rays cast
+ */
+unsigned long long Raytracer::traceAdaptive(
+    const float aspectRatio,
+    const CancellationToken& token,
+    std::vector<ThreadStatistics>& threadStatistics,
+    PathStatistics& pathStatistics
+) {
+    std::vector<unsigned char> sampled(static_cast<unsigned long>(imageWidth * imageHeight), 1);
+    unsigned int roundSamples = renderParameters->adaptiveMinSamples;
+    unsigned long long rays = 0;
+
+    pathStatistics = PathStatistics{};
+
+    do {
+        auto shade = [&](const int i, const int j, TraceContext& context) {
+            if (!sampled[j * imageWidth + i]) {
+                return;
+            }
+
+            const unsigned int count = accumulation.sampleCount(j, i);
+            const unsigned int end = std::min(count + roundSamples, renderParameters->adaptiveMaxSamples);
+            for (unsigned int s = count; s < end; s++) {
+                accumulation.add(j, i, glm::vec3(pixelSample(i, j, s, aspectRatio, context)));
+            }
+        };
+
+        std::vector<ThreadStatistics> roundThreadStatistics;
+        PathStatistics roundPathStatistics{};
+        rays += traceTiles(shade, token, roundThreadStatistics, roundPathStatistics);
+
+        pathStatistics.paths += roundPathStatistics.paths;
+        pathStatistics.rays += roundPathStatistics.rays;
+
+        threadStatistics.resize(roundThreadStatistics.size(), ThreadStatistics{});
+        for (unsigned int t = 0; t < roundThreadStatistics.size(); t++) {
+            threadStatistics[t].busyMilliseconds += roundThreadStatistics[t].busyMilliseconds;
+            threadStatistics[t].idleMilliseconds += roundThreadStatistics[t].idleMilliseconds;
+            threadStatistics[t].tiles += roundThreadStatistics[t].tiles;
+            threadStatistics[t].stolenTiles += roundThreadStatistics[t].stolenTiles;
+        }
+
+        roundSamples = ADAPTIVE_STEP;
+    } while (!token.isCancelled() && findSampledPixels(sampled) > 0);
+
+    return rays;
+}
+
+/**
+ * @brief Raytracer::startProgressive updates the scene and discards the samples accumulated so far.
+ *        The image is refined by calling renderPass until the quality or time budget is met.
+ *
+ * @param image target of the render, its size determines the resolution
+ */
+void Raytracer::startProgressive(RGBAImage& image) {
+    std::cout << "Start Progressive Raytracing..." << std::endl;
+
+    progressiveStart = std::chrono::steady_clock::now();
+
+    prepare(image);
+    accumulation.resize(imageWidth, imageHeight);
+
+    image.clear(RGBAValue(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+/**
+ * @brief Raytracer::renderPass adds one anti-aliased sample to every pixel of the accumulation buffer,
+ *        in parallel, then tone-maps the running average into image.
+ *        The k-th sample of a pixel uses sample index k, so after N_AA_SAMPLES passes the image matches
+ *        a Monte Carlo render. With adaptive sampling, only the pixels marked by findSampledPixels are sampled.
+ *
+ * @param image target of the render, of the size given to startProgressive
+ * @param token polled once per tile. A cancelled pass leaves the accumulation buffer partially updated,
+ *              so the progressive render has to be restarted with startProgressive.
+ *
+ * @return the number of samples per pixel so far and the timings of the pass
+ */
+PassStatistics Raytracer::renderPass(RGBAImage& image, const CancellationToken& token) {
+    PassStatistics statistics{};
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto aspectRatio = static_cast<float>(imageWidth) / static_cast<float>(imageHeight);
+
+    std::vector<unsigned char> sampled;
+    statistics.sampledPixels = findSampledPixels(sampled);
+
+    // Adaptive sampling has stopped on every pixel, the render is complete
+    if (statistics.sampledPixels == 0) {
+        statistics.samples = accumulation.samples;
+        statistics.elapsedMilliseconds =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - progressiveStart).count();
+        std::cout << "Adaptive sampling stopped on every pixel after " << statistics.samples << " passes" << std::endl;
+        return statistics;
+    }
+
+    auto shade = [&](const int i, const int j, TraceContext& context) {
+        if (sampled[j * imageWidth + i]) {
+            const unsigned int sampleIndex = accumulation.sampleCount(j, i);
+            accumulation.add(j, i, glm::vec3(pixelSample(i, j, sampleIndex, aspectRatio, context)));
+        }
+    };
+
+    std::vector<ThreadStatistics> threadStatistics;
+    unsigned long long rays = traceTiles(shade, token, threadStatistics, statistics.pathStatistics);
+
+    statistics.cancelled = token.isCancelled();
+
+    // Keep the image of the last complete pass
+    if (!statistics.cancelled) {
+        accumulation.samples++;
+        accumulation.toneMap(image);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    statistics.samples = accumulation.samples;
+    statistics.passMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    statistics.elapsedMilliseconds = std::chrono::duration<double, std::milli>(end - progressiveStart).count();
+    statistics.rays = rays;
+
+    if (statistics.cancelled) {
+        std::cout << "Pass " << statistics.samples + 1 << " cancelled" << std::endl;
+        return statistics;
+    }
+
+    std::cout << "Pass " << statistics.samples << ": "
+            << statistics.passMilliseconds << " ms, "
+            << statistics.elapsedMilliseconds << " ms elapsed, "
+            << statistics.rays << " rays, "
+            << statistics.sampledPixels << " pixels sampled, "
+            << "average path length " << statistics.pathStatistics.averageLength()
+            << std::endl;
+
+    return statistics;
+}
+
+/**
+ * @return the samples of the last render, or accumulated by the progressive render so far
+ */
+const AccumulationBuffer& Raytracer::accumulated() const {
+    return accumulation;
+}
+
+/**
+ * @return SurfaceElement resulting from the barycentric interpolation of the collision of ray
+ */
+SurfaceElement barycentricInterpolation(
+    const CollisionInfo& collision,
+    const Ray& ray
+) {
+    const glm::vec3 collisionPoint = ray.origin + collision.t * ray.direction;
+
+    // The triangle is in the object space of its instance
+    glm::vec3 normal = collision.triangle->weightedNormal(collision.barycentric);
+    if (collision.instance != nullptr) {
+        normal = collision.instance->normalToScene(normal);
+    }
+
+    return SurfaceElement(*collision.triangle, collisionPoint, normal);
+}
+
+/**
+ * @brief Raytracer::traceHits times the work every camera ray does before it is shaded: finding its closest hit
+ *        and interpolating the surface element there. Traces the ray through every pixel of image passes times,
+ *        on the calling thread only, and writes nothing to image.
+ */
+HitStatistics Raytracer::traceHits(const RGBAImage& image, const unsigned int passes) {
+    prepare(image);
+
+    const auto aspectRatio = static_cast<float>(imageWidth) / static_cast<float>(imageHeight);
+
+    HitStatistics statistics{};
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned int pass = 0; pass < passes; pass++) {
+        for (int j = 0; j < imageHeight; j++) {
+            for (int i = 0; i < imageWidth; i++) {
+                const Ray ray = rayToPixel(i, j, aspectRatio);
+                const CollisionInfo collision = scene.closestTriangle(ray);
+                statistics.rays++;
+
+                if (collision.isHit()) {
+                    const SurfaceElement surfel = barycentricInterpolation(collision, ray);
+                    statistics.hits++;
+                    statistics.normalSum += surfel.normal;
+                }
+            }
+        }
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    statistics.milliseconds = elapsed.count();
+
+    return statistics;
+}
+
+/**
+ * @return Ray reflected on surface
+ */
+Ray reflect(const Ray& ray, const SurfaceElement& surfel) {
+    // Bias origin in the direction of the normal to avoid self intersections
+    glm::vec3 reflectionOrigin = surfel.point + collisionBias * surfel.normal;
+    glm::vec3 reflectedDirection = ray.direction - 2.0f * glm::dot(ray.direction, surfel.normal) * surfel.normal;
+
+    return Ray(reflectionOrigin, reflectedDirection);
+}
+
+/**
+ * @return Ray refracted over surface, reflected in case of total internal reflection
+ */
+Ray refract(const Ray& ray, float mediumRefractiveIndex, const SurfaceElement& surfel) {
+    float n1 = mediumRefractiveIndex;
+    float n2 = surfel.indexOfRefraction();
+
+    float cosTheta1 = -glm::dot(ray.direction, surfel.normal);
+
+    // Ray is coming out of the object, it was already refracted
+    if (cosTheta1 < 0.0f) {
+        return Ray(surfel.point + collisionBias * surfel.normal, ray.direction);
+    }
+
+    // Bias origin to avoid refraction self intersection
+    glm::vec3 refractionOrigin = surfel.point - collisionBias * surfel.normal;
+
+    float n = n1 / n2;
+
+    float sinTheta2Squared = n * n * (1.0f - cosTheta1 * cosTheta1);
+
+    // Total internal reflection => reflect
+    // Note: x^2 in [0..1] => x in [0..1]
+    if (sinTheta2Squared > 1.0f) {
+        return reflect(ray, surfel);
+    }
+
+    float cosTheta2 = std::sqrt(1.0f - sinTheta2Squared);
+    glm::vec3 refractedDirection = n * ray.direction + (n * cosTheta1 - cosTheta2) * surfel.normal;
+
+    return Ray(refractionOrigin, refractedDirection);
+}
+
+/**
+ * @return the raytraced colour, capped by a maximum number of bounces on reflective surfaces
+ *         estimated by the integrator of renderParameters
+ */
+glm::vec4 Raytracer::raytraceColour(
+    const Ray& ray,
+    float refractiveIndex,
+    int bounces,
+    TraceContext& context
+) const {
+    if (renderParameters->integrator == Integrator::Path) {
+        return pathColour(ray, context);
+    }
+
+    return traceColour(ray, refractiveIndex, bounces, true, 1.0f, context);
+}
+
+/**
+ * @brief Raytracer::pathColour follows a single path from cameraRay, in a loop, until it leaves the scene,
+ *        is renderParameters->maxBounces rays long or is ended by Russian roulette.
+ *        Every hit continues the path along one ray: glass reflects with the probability of its reflectance and
+ *        refracts otherwise, diffuse surfaces add their direct lighting and scatter in a sampled direction.
+ *        The throughput of the path weights what it finds, so a path costs one ray per bounce and no stack.
+ *
+ * @return the colour found along the path
+ */
+glm::vec4 Raytracer::pathColour(const Ray& cameraRay, TraceContext& context) const {
+    Ray ray = cameraRay;
+    float refractiveIndex = airRefractiveIndex;
+    glm::vec3 throughput{1.0f};
+    glm::vec3 colour{0.0f};
+    // Emission is only seen before the first diffuse bounce, lights are reached through direct lighting after
+    bool scattered = false;
+    unsigned int length = 0;
+
+    const unsigned int depth = context.depth;
+    // Every ray of the path draws from dimensions of its own
+    const Sampler::Dimensions cameraDimensions = context.sampler.enterBounce();
+
+    while (length < static_cast<unsigned int>(renderParameters->maxBounces)) {
+        CollisionInfo collision = scene.closestTriangle(ray);
+        context.rays++;
+        length++;
+
+        if (!collision.isHit()) {
+            break;
+        }
+
+        SurfaceElement surfel = barycentricInterpolation(collision, ray);
+
+        if (renderParameters->interpolationRendering) {
+            colour = glm::abs(surfel.normal);
+            break;
+        }
+
+        if (!surfel.isPhong()) {
+            // Picking a branch with the probability of its weight leaves the throughput unchanged
+            if (context.sampler.next1D() < reflectance(ray, surfel, refractiveIndex)) {
+                ray = reflect(ray, surfel);
+            } else {
+                ray = refract(ray, refractiveIndex, surfel);
+                refractiveIndex = surfel.indexOfRefraction();
+            }
+        } else {
+            glm::vec4 direct = directLightingColour(surfel, ray.origin, context);
+            if (!scattered) {
+                direct = direct + surfel.emissive();
+            }
+            colour += throughput * glm::vec3(direct);
+
+            const DirectionSample sample = sampleDirection(renderParameters->hemisphereSampling,
+                                                           context.sampler.next2D());
+            const float cosTheta = sample.direction.z;
+
+            // Directions into the surface receive no light
+            if (cosTheta <= 0.0f || sample.pdf <= 0.0f) {
+                break;
+            }
+
+            // Lambertian BRDF diffuse / pi, the cosine and the pdf cancel out with cosine sampling
+            const OrthonormalBasis basis(glm::normalize(surfel.normal));
+            const float weight = cosTheta / (static_cast<float>(M_PI) * sample.pdf);
+            throughput *= surfel.triangle.sharedMaterial->diffuse * weight;
+
+            ray = Ray(surfel.point + collisionBias * surfel.normal, basis.toWorld(sample.direction));
+            refractiveIndex = surfel.indexOfRefraction();
+            scattered = true;
+        }
+
+        context.depth = depth + length;
+        const float survival = roulette(std::max({throughput.r, throughput.g, throughput.b}), context);
+        if (survival <= 0.0f) {
+            break;
+        }
+        throughput *= survival;
+
+        context.sampler.enterBounce();
+    }
+
+    context.depth = depth;
+    context.sampler.leaveBounce(cameraDimensions);
+    context.pathStatistics.paths++;
+    context.pathStatistics.rays += length;
+
+    return {colour, 1.0f};
+}
+
+/**
+ * @return the pathtraced colour, capped by a maximum number of bounces on reflective surfaces
+ */
+glm::vec4 Raytracer::pathtraceColour(
+    const Ray& ray,
+    float refractiveIndex,
+    int bounces,
+    float throughput,
+    TraceContext& context
+) const {
+    return traceColour(ray, refractiveIndex, bounces, false, throughput, context);
+}
+
+/**
+ * @brief Raytracer::roulette plays Russian roulette on a path about to be extended by a ray.
+ *        Paths whose throughput is below renderParameters->rouletteThreshold survive with probability
+ *        throughput / threshold, and what survivors carry is scaled up so that the estimate stays unbiased.
+ *        Only Monte Carlo and path traced renders play, and only once the path is ROULETTE_DEPTH rays long.
+ *
+ * @param throughput the fraction of the light found by the ray that reaches the camera
+ *
+ * @return 0 if the path ends, otherwise the inverse of the survival probability, to weight the ray by
+ */
+float Raytracer::roulette(const float throughput, TraceContext& context) const {
+    const float threshold = renderParameters->rouletteThreshold;
+
+    if ((!renderParameters->monteCarloEnabled && renderParameters->integrator != Integrator::Path)
+        || threshold <= 0.0f
+        || context.depth < ROULETTE_DEPTH
+        || throughput >= threshold) {
+        return 1.0f;
+    }
+
+    const float survival = throughput / threshold;
+    return context.sampler.next1D() < survival ? 1.0f / survival : 0.0f;
+}
+
+/**
+ * @return if Fresnel rendering is enabled, the Schlick's approximation reflectance of a surface
+ *         otherwise, the reflectivity of the triangle, or 1.0 if the triangle has no transparency
+ *         the result is guaranteed to be in [0..1], therefore transmittance = 1 - reflectance
+ */
+float Raytracer::reflectance(
+    const Ray& ray,
+    const SurfaceElement& surfel,
+    const float mediumRefractiveIndex
+) const {
+    if (renderParameters->fresnelRendering) {
+        return surfel.schlick(ray, mediumRefractiveIndex);
+    }
+
+    float reflectivity = surfel.triangle.sharedMaterial->transparency > 0.0f
+                             ? surfel.triangle.sharedMaterial->reflectivity
+                             : 1.0f;
+    return reflectivity;
+}
+
+/**
+ * @return the traced colour, capped by a maximum number of bounces on reflective surfaces
+ *         if isPrimaryRay then account for all contributions, otherwise just direct lighting contributions
+ *
+ * @param throughput the fraction of the light found by the ray that reaches the camera, drives Russian roulette
+ */
+glm::vec4 Raytracer::traceColour(
+    const Ray& ray,
+    float refractiveIndex,
+    int bounces,
+    bool isPrimaryRay,
+    float throughput,
+    TraceContext& context
+) const {
+    if (bounces <= 0) {
+        return NoColour;
+    }
+
+    // A path ends at this ray if it spawns no other, it is then counted with all the rays leading to it
+    const unsigned long long endedPaths = context.pathStatistics.paths;
+    context.depth++;
+    const Sampler::Dimensions parentDimensions = context.sampler.enterBounce();
+
+    const glm::vec4 colour = shadeHit(ray, refractiveIndex, bounces, isPrimaryRay, throughput, context);
+
+    if (context.pathStatistics.paths == endedPaths) {
+        context.pathStatistics.paths++;
+        context.pathStatistics.rays += context.depth;
+    }
+    context.sampler.leaveBounce(parentDimensions);
+    context.depth--;
+
+    return colour;
+}
+
+/**
+ * @brief Raytracer::shadeHit traces ray and shades what it hits, see traceColour
+ */
+glm::vec4 Raytracer::shadeHit(
+    const Ray& ray,
+    float refractiveIndex,
+    int bounces,
+    bool isPrimaryRay,
+    float throughput,
+    TraceContext& context
+) const {
+    CollisionInfo collision = scene.closestTriangle(ray);
+    context.rays++;
+
+    if (!collision.isHit()) {
+        return NoColour;
+    }
+
+    SurfaceElement surfel = barycentricInterpolation(collision, ray);
+
+    if (renderParameters->interpolationRendering) {
+        return {std::abs(surfel.normal.x), std::abs(surfel.normal.y), std::abs(surfel.normal.z), 1.0f};
+    }
+
+    // Reflect + Refract colour
+    if (!surfel.isPhong()) {
+        auto colour = NoColour;
+
+        const float reflectivity = reflectance(ray, surfel, refractiveIndex);
+        const float refractivity = 1.0f - reflectivity;
+
+        // Add reflection colour contribution, if needed
+        const float reflectionWeight = reflectivity > 0.0f ? reflectivity * roulette(throughput * reflectivity, context)
+                                                           : 0.0f;
+        if (reflectionWeight > 0.0f) {
+            const Ray reflectionRay = reflect(ray, surfel);
+            const auto& reflection = traceColour(reflectionRay, refractiveIndex, bounces - 1, isPrimaryRay,
+                                                 throughput * reflectionWeight, context);
+            colour = colour + reflectionWeight * reflection;
+        }
+
+        // Add refraction colour contribution, if needed
+        const float refractionWeight = refractivity > 0.0f ? refractivity * roulette(throughput * refractivity, context)
+                                                           : 0.0f;
+        if (refractionWeight > 0.0f) {
+            const Ray refractionRay = refract(ray, refractiveIndex, surfel);
+            const auto& refraction = traceColour(refractionRay, surfel.indexOfRefraction(), bounces - 1, isPrimaryRay,
+                                                 throughput * refractionWeight, context);
+            colour = colour + refractionWeight * refraction;
+        }
+
+        return colour;
+    }
+
+    // Only direct lighting contribution for secondary rays
+    if (!isPrimaryRay) {
+        return directLightingColour(surfel, ray.origin, context);
+    }
+
+    // Colour of all contributions for primary rays
+    return surfaceColour(surfel, ray.origin, throughput, context);
+}
+
+/**
+ * @return the blinn-phong colour resulting of all contributions on the surface
+ */
+glm::vec4 Raytracer::surfaceColour(
+    const SurfaceElement& surfel,
+    const glm::vec3& eye,
+    const float throughput,
+    TraceContext& context
+) const {
+    auto colour = directLightingColour(surfel, eye, context);
+    glm::vec3 biasedOrigin = surfel.point + collisionBias * surfel.normal;
+
+    // Emission is independent of shadow, compute contribution
+    colour = colour + surfel.emissive();
+
+    // Compute indirect lighting contribution
+    if (renderParameters->monteCarloEnabled) {
+        const unsigned int samples = std::max(1u, renderParameters->monteCarloSamples);
+        // Sample directions are drawn around z, the basis takes them around the normal
+        const OrthonormalBasis basis(glm::normalize(surfel.normal));
+        const glm::vec4 diffuse{surfel.triangle.sharedMaterial->diffuse, 1.0f};
+        const float albedo = std::max({diffuse.r, diffuse.g, diffuse.b});
+
+        auto indirectLightingColour = NoColour;
+        for (unsigned int i = 0; i < samples; i++) {
+            const DirectionSample sample = sampleDirection(renderParameters->hemisphereSampling,
+                                                           context.sampler.next2D());
+            const float cosTheta = sample.direction.z;
+
+            // Directions into the surface receive no light
+            if (cosTheta <= 0.0f || sample.pdf <= 0.0f) {
+                continue;
+            }
+
+            // Lambertian BRDF diffuse / pi, the cosine and the pdf cancel out with cosine sampling
+            float weight = cosTheta / (static_cast<float>(M_PI) * sample.pdf);
+            weight *= roulette(throughput * albedo * weight, context);
+            if (weight <= 0.0f) {
+                continue;
+            }
+
+            Ray monteCarloRay = Ray(biasedOrigin, basis.toWorld(sample.direction));
+            const auto& incoming = pathtraceColour(monteCarloRay, surfel.indexOfRefraction(),
+                                                   renderParameters->maxBounces, throughput * albedo * weight, context);
+            indirectLightingColour = indirectLightingColour + incoming * weight;
+        }
+        colour = colour + diffuse * indirectLightingColour / static_cast<float>(samples);
+    } else {
+        colour = colour + surfel.indirectLighting();
+    }
+
+    return {
+        std::clamp(colour.r, 0.0f, 1.0f),
+        std::clamp(colour.g, 0.0f, 1.0f),
+        std::clamp(colour.b, 0.0f, 1.0f),
+        std::clamp(colour.a, 0.0f, 1.0f)
+    };
+}
+
+/**
+ * @return the blinn-phong colour resulting only from direct lighting contributions on the surface
+ */
+glm::vec4 Raytracer::directLightingColour(
+    const SurfaceElement& surfel,
+    const glm::vec3& eye,
+    TraceContext& context
+) const {
+    // Bias the origin in the direction of the normal to avoid issues with self-intersection
+    // E.g.: Shadow acne
+    glm::vec3 biasedPoint = surfel.point + collisionBias * surfel.normal;
+    auto colour = NoColour;
+
+    for (const auto& light : renderParameters->lights) {
+        if (!light->enabled) {
+            continue;
+        }
+
+        glm::vec4 lightPosition = light->lightPosition;
+        glm::vec4 lightColour = light->lightColor;
+
+        auto directColour = surfel.directLighting(lightPosition, lightColour, {eye, 1.0f});
+
+        if (renderParameters->shadowsEnabled) {
+            directColour = directColour * shadowModulation(biasedPoint, light, context);
+        }
+
+        colour = colour + directColour;
+    }
+
+    return {
+        std::clamp(colour.r, 0.0f, 1.0f),
+        std::clamp(colour.g, 0.0f, 1.0f),
+        std::clamp(colour.b, 0.0f, 1.0f),
+        std::clamp(colour.a, 0.0f, 1.0f)
+    };
+}
+
+/**
+ * @return the modulation factors of the shadow of a light on a point
+ *         guaranteed to be of the form (sf, sf, sf, 1), to only alter (r, g, b)
+ */
+glm::vec4 Raytracer::shadowModulation(
+    const glm::vec3& point,
+    const Light* light,
+    TraceContext& context
+) const {
+    float shadowFactor;
+
+    if (renderParameters->areaLightsEnabled) {
+        // Soft shadows
+        unsigned int hits = 0;
+
+        for (unsigned int i = 0; i < N_SS_SAMPLES; i++) {
+            const glm::vec3 lightPosition = light->sampledPosition(context.sampler);
+
+            hits += isShadowHit(lightPosition, point, context) ? 1 : 0;
+        }
+
+        // shadowFactor = 1 - % of shadow hits = % of non-shadow hits
+        shadowFactor = 1.0f - hits / static_cast<float>(N_SS_SAMPLES);
+    } else {
+        // Sharp shadows
+        glm::vec3 lightPosition = light->lightPosition;
+        // shadowFactor = either full or no shadow
+        shadowFactor = isShadowHit(lightPosition, point, context) ? 0.0f : 1.0f;
+    }
+
+    return glm::vec4(shadowFactor, shadowFactor, shadowFactor, 1.0f);
+}
+
+bool Raytracer::isShadowHit(
+    const glm::vec3& lightPosition,
+    const glm::vec3& point,
+    TraceContext& context
+) const {
+    const glm::vec3 toLight = lightPosition - point;
+    const float lightDistance = glm::length(toLight);
+    Ray shadowRay(point, toLight / lightDistance);
+
+    // Any opaque hit between the point and the light is enough, no need to find the closest
+    CollisionInfo collision = scene.occludingTriangle(shadowRay, lightDistance - collisionBias);
+    context.rays++;
+
+    if (!collision.isShadowHit()) {
+        return false;
+    }
+
+    if (collision.triangle->sharedMaterial->isPhong()) {
+        return true;
+    }
+
+    float refractiveIndex = airRefractiveIndex;
+
+    // A transparent surface was hit first
+    // Follow ray along refractions until shadow hit is confirmed or ray is exhausted
+    while (collision.isShadowHit()) {
+        SurfaceElement shadowSurfel = barycentricInterpolation(collision, shadowRay);
+
+        if (shadowSurfel.isPhong()) {
+            return true;
+        }
+
+        float refractivity = 1.0f - reflectance(shadowRay, shadowSurfel, refractiveIndex);
+
+        if (refractivity <= 0.0f) {
+            return false;
+        }
+
+        shadowRay = refract(shadowRay, refractiveIndex, shadowSurfel);
+        refractiveIndex = shadowSurfel.indexOfRefraction();
+
+        collision = scene.closestTriangle(shadowRay);
+        context.rays++;
+    }
+
+    return false;
+}
@@ -0,0 +1,181 @@
+#ifndef RAYTRACER_H
+#define RAYTRACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <glm/matrix.hpp>
+
+#include "AccumulationBuffer.h"
+#include "CancellationToken.h"
+#include "Light.h"
+#include "Ray.h"
+#include "RenderParameters.h"
+#include "RGBAImage.h"
+#include "Sampler.h"
+#include "Scene.h"
+#include "SurfaceElement.h"
+#include "ThreeDModel.h"
+
+// Lengths of the paths traced from the camera, shadow rays aside
+// Every chain of rays from a camera ray to a ray that spawns no other is one path
+struct PathStatistics {
+    unsigned long long paths;
+    // rays along all the paths, a ray that branches is counted once for every path through it
+    unsigned long long rays;
+
+    double averageLength() const;
+};
+
+// Per-thread state threaded through the trace functions
+struct TraceContext {
+    Sampler sampler;
+
+    // number of rays cast against the scene
+    unsigned long long rays;
+
+    // rays traced so far along the current path, and the paths ended
+    unsigned int depth;
+    PathStatistics pathStatistics;
+
+    TraceContext(std::uint64_t seed, SampleSequence sequence, unsigned int samplesPerPixel);
+};
+
+// Share of a frame spent by one render thread
+struct ThreadStatistics {
+    double busyMilliseconds;
+    double idleMilliseconds;
+    unsigned int tiles;
+    // tiles taken from the queue of another thread
+    unsigned int stolenTiles;
+};
+
+// Timings and counters of a rendered frame
+struct RenderStatistics {
+    double sceneMilliseconds;
+    double renderMilliseconds;
+    unsigned long long rays;
+    // samples traced over all the pixels
+    unsigned long long samples;
+    PathStatistics pathStatistics;
+    int threads;
+    // the render was cancelled before every tile was traced
+    bool cancelled;
+    std::vector<ThreadStatistics> threadStatistics;
+
+    double raysPerSecond() const;
+};
+
+// Timings and counters of a single pass of a progressive render
+struct PassStatistics {
+    // samples per pixel accumulated so far, including this pass
+    unsigned int samples;
+    double passMilliseconds;
+    // time since the progressive render was started
+    double elapsedMilliseconds;
+    unsigned long long rays;
+    // pixels this pass added a sample to, 0 once adaptive sampling has stopped on every pixel
+    unsigned long long sampledPixels;
+    PathStatistics pathStatistics;
+    // the pass was cancelled and discarded, samples is unchanged
+    bool cancelled;
+};
+
+// Cost of finding what camera rays hit, before any shading, see Raytracer::traceHits
+struct HitStatistics {
+    unsigned long long rays;
+    unsigned long long hits;
+    double milliseconds;
+    // sum of the shading normals of the hits, comparable across runs, and keeps the work from being optimised away
+    glm::vec3 normalSum;
+
+    double nanosecondsPerRay() const;
+};
+
+// Tracing core, independent of any window or OpenGL context
+class Raytracer {
+public:
+    Scene scene;
+
+    Raytracer(
+        // the geometric objects to trace
+        std::vector<ThreeDModel>* objects,
+        // the render parameters to use
+        RenderParameters* renderParameters);
+
+    RenderStatistics render(RGBAImage& image, const CancellationToken& token = CancellationToken());
+
+    void startProgressive(RGBAImage& image);
+
+    PassStatistics renderPass(RGBAImage& image, const CancellationToken& token = CancellationToken());
+
+    // the samples of the last render, or accumulated by the progressive render so far
+    const AccumulationBuffer& accumulated() const;
+
+    HitStatistics traceHits(const RGBAImage& image, unsigned int passes);
+
+private:
+    RenderParameters* renderParameters;
+
+    // takes camera space rays into the object space of the scene
+    glm::mat4 inverseModelView;
+
+    long imageWidth;
+    long imageHeight;
+
+    // HDR sums of the samples of the last render, or of the progressive render
+    AccumulationBuffer accumulation;
+    std::chrono::steady_clock::time_point progressiveStart;
+
+    void prepare(const RGBAImage& image);
+
+    template<typename PixelFunction>
+    unsigned long long traceTiles(const PixelFunction& shade, const CancellationToken& token,
+                                  std::vector<ThreadStatistics>& threadStatistics,
+                                  PathStatistics& pathStatistics) const;
+
+    unsigned int samplesPerPixel() const;
+
+    bool isConverged(int i, int j) const;
+
+    unsigned long long findSampledPixels(std::vector<unsigned char>& sampled) const;
+
+    unsigned long long traceAdaptive(float aspectRatio, const CancellationToken& token,
+                                     std::vector<ThreadStatistics>& threadStatistics, PathStatistics& pathStatistics);
+
+    bool isCorner(int x, int y) const;
+
+    std::pair<float, float> sampledPixel(float i, float j, TraceContext& context) const;
+
+    Ray rayToPixel(float pixelX, float pixelY, float aspectRatio) const;
+
+    glm::vec4 pixelSample(int i, int j, unsigned int sampleIndex, float aspectRatio, TraceContext& context) const;
+
+    glm::vec4 raytraceColour(const Ray& ray, float refractiveIndex, int bounces, TraceContext& context) const;
+
+    glm::vec4 pathColour(const Ray& cameraRay, TraceContext& context) const;
+
+    glm::vec4 pathtraceColour(const Ray& ray, float refractiveIndex, int bounces, float throughput,
+                              TraceContext& context) const;
+
+    glm::vec4 traceColour(const Ray& ray, float refractiveIndex, int bounces, bool isPrimaryRay, float throughput,
+                          TraceContext& context) const;
+
+    glm::vec4 shadeHit(const Ray& ray, float refractiveIndex, int bounces, bool isPrimaryRay, float throughput,
+                       TraceContext& context) const;
+
+    float roulette(float throughput, TraceContext& context) const;
+
+    glm::vec4 surfaceColour(const SurfaceElement& surfel, const glm::vec3& eye, float throughput,
+                            TraceContext& context) const;
+
+    glm::vec4 directLightingColour(const SurfaceElement& surfel, const glm::vec3& eye, TraceContext& context) const;
+
+    glm::vec4 shadowModulation(const glm::vec3& point, const Light* light, TraceContext& context) const;
+
+    bool isShadowHit(const glm::vec3& lightPosition, const glm::vec3& point, TraceContext& context) const;
+
+    float reflectance(const Ray& ray, const SurfaceElement& surfel, float mediumRefractiveIndex) const;
+};
+
+#endif // RAYTRACER_H
@@ -87,6 +87,10 @@ RenderController::RenderController(
                      SIGNAL(stateChanged(int)),
                      this,
                      SLOT(orthographicBoxChanged(int)));
+    QObject::connect(renderWindow->progressiveBox,
+                     SIGNAL(stateChanged(int)),
+                     this,
+                     SLOT(progressiveBoxChanged(int)));
 
     // Connect Raytrace Button
     QObject::connect(renderWindow->raytraceButton,
@@ -94,6 +98,22 @@ RenderController::RenderController(
                      this,
                      SLOT(raytraceCalled()));
 
+    // Connect Stop Button
+    QObject::connect(renderWindow->stopButton,
+                     SIGNAL(released()),
+                     this,
+                     SLOT(stopCalled()));
+
+    // signals for raytrace widget to report finished renders
+    QObject::connect(renderWindow->raytraceRenderWidget,
+                     SIGNAL(raytraceFinished(double, double)),
+                     this,
+                     SLOT(raytraceFinished(double, double)));
+    QObject::connect(renderWindow->raytraceRenderWidget,
+                     SIGNAL(progressivePassFinished(unsigned int, double)),
+                     this,
+                     SLOT(progressivePassFinished(unsigned int, double)));
+
     // copy the rotation matrix from the widgets to the model
     renderParameters->rotationMatrix = renderWindow->modelRotator->rotationMatrix();
 }
@@ -179,10 +199,29 @@ void RenderController::orthographicBoxChanged(int state) const {
     renderWindow->resetInterface();
 }
 
+void RenderController::progressiveBoxChanged(int state) const {
+    renderParameters->progressiveRendering = (state == Qt::Checked);
+    renderWindow->resetInterface();
+}
+
 void RenderController::raytraceCalled() const {
     renderWindow->handleRaytrace();
 }
 
+void RenderController::stopCalled() const {
+    renderWindow->handleStop();
+}
+
+void RenderController::raytraceFinished(double milliseconds, double raysPerSecond) const {
+    renderWindow->raytraceStatusLabel->setText(
+        QString("%1 ms, %2 Mrays/s").arg(milliseconds, 0, 'f', 0).arg(raysPerSecond / 1.0e6, 0, 'f', 2));
+}
+
+void RenderController::progressivePassFinished(unsigned int samples, double elapsedMilliseconds) const {
+    renderWindow->raytraceStatusLabel->setText(
+        QString("%1 spp, %2 ms").arg(samples).arg(elapsedMilliseconds, 0, 'f', 0));
+}
+
 // slots for responding to arcball manipulations
 // these are general purpose signals which pass the mouse moves to the controller
 // after scaling to the notional unit sphere
@@ -49,8 +49,17 @@ public slots:
 
     void orthographicBoxChanged(int state) const;
 
+    void progressiveBoxChanged(int state) const;
+
     void raytraceCalled() const;
 
+    void stopCalled() const;
+
+    // slots for responding to the render job
+    void raytraceFinished(double milliseconds, double raysPerSecond) const;
+
+    void progressivePassFinished(unsigned int samples, double elapsedMilliseconds) const;
+
     // slots for responding to arcball manipulations
     // these are general purpose signals which pass the mouse moves to the controller
     // after scaling to the notional unit sphere
@@ -0,0 +1,42 @@
+#include "RenderJob.h"
+
+RenderJob::RenderJob()
+    : running(false) {
+}
+
+RenderJob::~RenderJob() {
+    cancel();
+    wait();
+}
+
+/**
+ * @brief RenderJob::start cancels the job in flight, waits for it to stop and runs work on a new thread
+ *
+ * @param work to run, expected to poll the token it is given and return early once it is cancelled
+ */
+void RenderJob::start(const std::function<void(const CancellationToken&)>& work) {
+    cancel();
+    wait();
+
+    token = CancellationToken();
+    running = true;
+
+    thread = std::thread([this, work, jobToken = token]() {
+        work(jobToken);
+        running = false;
+    });
+}
+
+void RenderJob::cancel() {
+    token.cancel();
+}
+
+void RenderJob::wait() {
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+bool RenderJob::isRunning() const {
+    return running;
+}
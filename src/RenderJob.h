@@ -0,0 +1,41 @@
+#ifndef RENDER_JOB_H
+#define RENDER_JOB_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "CancellationToken.h"
+
+/*
+ * A render running on its own thread, at most one at a time
+ * Starting a job cancels and joins the one in flight, so jobs never overlap
+ */
+class RenderJob {
+public:
+    RenderJob();
+
+    RenderJob(const RenderJob&) = delete;
+
+    RenderJob& operator=(const RenderJob&) = delete;
+
+    // cancels and joins the job in flight
+    ~RenderJob();
+
+    void start(const std::function<void(const CancellationToken&)>& work);
+
+    void cancel();
+
+    void wait();
+
+    bool isRunning() const;
+
+private:
+    std::thread thread;
+
+    CancellationToken token;
+
+    std::atomic<bool> running;
+};
+
+#endif // RENDER_JOB_H
@@ -1,5 +1,7 @@
 #include "RenderParameters.h"
 
+#include <algorithm>
+
 RenderParameters::RenderParameters()
     : xTranslate(0.0)
       , yTranslate(0.0)
@@ -10,8 +12,25 @@ RenderParameters::RenderParameters()
       , fresnelRendering(false)
       , areaLightsEnabled(false)
       , monteCarloEnabled(false)
+      , monteCarloSamples(N_MC_SAMPLES)
+      , hemisphereSampling(HemisphereSampling::Cosine)
+      , integrator(Integrator::Whitted)
+      , sampleSequence(SampleSequence::Independent)
+      , sequenceSamples(0)
+      , adaptiveThreshold(0.0f)
+      , adaptiveMinSamples(ADAPTIVE_MIN_SAMPLES)
+      , adaptiveMaxSamples(ADAPTIVE_MAX_SAMPLES)
+      , maxBounces(N_BOUNCES)
+      , rouletteThreshold(TERMINATION_FACTOR)
+      , progressiveRendering(false)
       , centreObject(false)
-      , orthoProjection(false) {
+      , orthoProjection(false)
+      , seed(0)
+      , threads(N_THREADS)
+      , tileSize(TILE_SIZE)
+      , intersectionKernel(IntersectionKernel::Planar)
+      , bvhLayout(BVHLayout::Wide8)
+      , bvhBuilder(BVHBuilder::BinnedSAH) {
 }
 
 void RenderParameters::findLights(const std::vector<ThreeDModel>& objects) {
@@ -19,29 +38,32 @@ void RenderParameters::findLights(const std::vector<ThreeDModel>& objects) {
         // find objects that have a "light" material
         if (obj.material->isLight()) {
             // if the object has exactly 2 triangles, its a rectangular area light.
-            if (obj.faceVertices.size() == 2) {
+            if (obj.faceCount() == 2) {
+                const unsigned int* firstFace = &obj.faceVertices[obj.faceStarts[0]];
+                const unsigned int* secondFace = &obj.faceVertices[obj.faceStarts[1]];
+
                 for (unsigned int i = 0; i < 3; i++) {
-                    unsigned int vid = obj.faceVertices[0][i];
+                    unsigned int vid = firstFace[i];
                     bool found = false;
                     for (unsigned int j = 0; j < 3; j++) {
-                        if (vid == obj.faceVertices[1][j]) {
+                        if (vid == secondFace[j]) {
                             found = true;
                             break;
                         }
                     }
 
                     if (!found) {
-                        unsigned int id1 = obj.faceVertices[0][i];
-                        unsigned int id2 = obj.faceVertices[0][(i + 1) % 3];
-                        unsigned int id3 = obj.faceVertices[0][(i + 2) % 3];
-                        glm::vec3 v1 = obj.vertices[id1];
-                        glm::vec3 v2 = obj.vertices[id2];
-                        glm::vec3 v3 = obj.vertices[id3];
+                        unsigned int id1 = firstFace[i];
+                        unsigned int id2 = firstFace[(i + 1) % 3];
+                        unsigned int id3 = firstFace[(i + 2) % 3];
+                        glm::vec3 v1 = obj.pool->vertices[id1];
+                        glm::vec3 v2 = obj.pool->vertices[id2];
+                        glm::vec3 v3 = obj.pool->vertices[id3];
                         glm::vec3 vecA = v2 - v1;
                         glm::vec3 vecB = v3 - v1;
                         glm::vec4 color = {obj.material->emissive, 1.0f};
                         glm::vec4 pos{v1 + vecA / 2.0f + vecB / 2.0f, 1.0f};
-                        glm::vec4 normal{obj.normals[obj.faceNormals[0][0]], 0.0f};
+                        glm::vec4 normal{obj.pool->normals[obj.faceNormals[obj.faceStarts[0]]], 0.0f};
                         Light* l = new Light(Light::Area, color, pos, normal, {vecA, 0.0f}, {vecB, 0.0f});
                         l->enabled = true;
                         lights.push_back(l);
@@ -50,11 +72,16 @@ void RenderParameters::findLights(const std::vector<ThreeDModel>& objects) {
             } else {
                 glm::vec3 center{0.0f};
 
-                for (const auto& vertex : obj.vertices) {
-                    center = center + vertex;
+                // The vertex pool is shared with the other models, only average the vertices of this one
+                std::vector<unsigned int> vertexIDs(obj.faceVertices);
+                std::sort(vertexIDs.begin(), vertexIDs.end());
+                vertexIDs.erase(std::unique(vertexIDs.begin(), vertexIDs.end()), vertexIDs.end());
+
+                for (unsigned int vertexID : vertexIDs) {
+                    center = center + obj.pool->vertices[vertexID];
                 }
 
-                center = center / static_cast<float>(obj.vertices.size());
+                center = center / static_cast<float>(vertexIDs.size());
                 Light* l = new Light(
                     Light::Point,
                     {obj.material->emissive, 1.0f},
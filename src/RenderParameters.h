@@ -1,12 +1,25 @@
 #ifndef RENDER_PARAMETERS_H
 #define RENDER_PARAMETERS_H
 
+#include <string>
 #include <vector>
 #include <glm/matrix.hpp>
 #include <glm/ext/matrix_transform.hpp>
 
+#include "BVH.h"
 #include "Light.h"
+#include "Random.h"
 #include "ThreeDModel.h"
+#include "Triangle.h"
+
+// How the colour of a pixel sample is estimated
+enum class Integrator {
+    // recursive, glass traces both its reflection and its refraction, and with Monte Carlo enabled
+    // the first diffuse hit traces monteCarloSamples paths of its own
+    Whitted,
+    // iterative, a single path picks one ray at every hit and carries its throughput along
+    Path
+};
 
 class RenderParameters {
 public:
@@ -20,10 +33,53 @@ public:
     bool areaLightsEnabled;
     bool monteCarloEnabled;
 
+    // directions traced for the indirect lighting of every shading point, and how they are drawn
+    unsigned int monteCarloSamples;
+    HemisphereSampling hemisphereSampling;
+
+    Integrator integrator;
+
+    // sequence the samples are drawn from, and the samples per pixel it is laid out for,
+    // 0 for the anti-aliasing samples of a Monte Carlo render
+    SampleSequence sampleSequence;
+    unsigned int sequenceSamples;
+
+    // pixels are sampled until the 95% confidence interval of their luminance is within adaptiveThreshold of its mean,
+    // with at least and at most this many samples, 0 to give every pixel the same samples
+    float adaptiveThreshold;
+    unsigned int adaptiveMinSamples;
+    unsigned int adaptiveMaxSamples;
+
+    // rays traced along a path at most, and the throughput under which Russian roulette may end it, 0 to never
+    int maxBounces;
+    float rouletteThreshold;
+
+    // refine the image one sample per pixel at a time until stopped
+    bool progressiveRendering;
+
     bool centreObject;
 
     bool orthoProjection;
 
+    // seed of the per-pixel sample generators, fixed so renders are reproducible
+    unsigned int seed;
+
+    // number of render threads and side of the tiles they trace, in pixels
+    unsigned int threads;
+    unsigned int tileSize;
+
+    // algorithm used to intersect rays with triangles
+    IntersectionKernel intersectionKernel;
+
+    // hierarchy the meshes are traversed through
+    BVHLayout bvhLayout;
+
+    // algorithm the hierarchies of the meshes are built with
+    BVHBuilder bvhBuilder;
+
+    // where the hierarchies of the meshes are cached between runs, not cached if empty
+    std::string bvhCacheDirectory;
+
     std::vector<Light*> lights;
 
     RenderParameters();
@@ -50,6 +106,21 @@ public:
 #define SPECULAR_EXPONENT_MIN 0.01f
 #define SPECULAR_EXPONENT_MAX 100.0f
 
+// default number of indirect lighting samples per shading point
+#define N_MC_SAMPLES 2
+
+// default bounds on the samples of a pixel with adaptive sampling
+#define ADAPTIVE_MIN_SAMPLES 4
+#define ADAPTIVE_MAX_SAMPLES 64
+
+// default length of the paths, and throughput under which Monte Carlo paths are ended by Russian roulette
+#define N_BOUNCES 5
+#define TERMINATION_FACTOR 0.35f
+
+// default render thread count & tile size
+#define N_THREADS 16
+#define TILE_SIZE 16
+
 // this is to scale to/from integer values
 #define PARAMETER_SCALING 100
 
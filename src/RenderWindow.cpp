@@ -30,9 +30,11 @@ RenderWindow::RenderWindow(
     monteCarloBox = new QCheckBox("Monte-Carlo", this);
     areaLightsBox = new QCheckBox("Area Lights", this);
     orthographicBox = new QCheckBox("Orthographic", this);
+    progressiveBox = new QCheckBox("Progressive", this);
 
     // buttons
     raytraceButton = new QPushButton("Raytrace", this);
+    stopButton = new QPushButton("Stop", this);
 
     // spatial sliders
     xTranslateSlider = new QSlider(Qt::Horizontal, this);
@@ -44,6 +46,7 @@ RenderWindow::RenderWindow(
     modelRotatorLabel = new QLabel("Model", this);
     yTranslateLabel = new QLabel("Y", this);
     zoomLabel = new QLabel("Zm", this);
+    raytraceStatusLabel = new QLabel(this);
 
     // add all of the widgets to the grid Row --- Column --- Row Span --- Column Span
 
@@ -64,9 +67,11 @@ RenderWindow::RenderWindow(
     windowLayout->addWidget(monteCarloBox, 5, 3, 1, 1);
     windowLayout->addWidget(areaLightsBox, 6, 3, 1, 1);
     windowLayout->addWidget(orthographicBox, 7, 3, 1, 1);
+    windowLayout->addWidget(progressiveBox, 8, 3, 1, 1);
 
-    // Raytrace Button
-    windowLayout->addWidget(raytraceButton, 0, 6, nStacked, 1);
+    // Raytrace & Stop Buttons
+    windowLayout->addWidget(raytraceButton, 0, 6, nStacked - 1, 1);
+    windowLayout->addWidget(stopButton, nStacked - 1, 6, 1, 1);
 
     // Translate Slider Row
     windowLayout->addWidget(xTranslateSlider, nStacked, 1, 1, 1);
@@ -74,6 +79,7 @@ RenderWindow::RenderWindow(
     // nothing in column 3
     windowLayout->addWidget(zoomLabel, nStacked, 4, 1, 1);
     windowLayout->addWidget(secondXTranslateSlider, nStacked, 5, 1, 1);
+    windowLayout->addWidget(raytraceStatusLabel, nStacked, 6, 1, 1);
 
     // now reset all of the control elements to match the render parameters passed in
     resetInterface();
@@ -89,6 +95,7 @@ void RenderWindow::resetInterface() const {
     monteCarloBox->setChecked(renderParameters->monteCarloEnabled);
     areaLightsBox->setChecked(renderParameters->areaLightsEnabled);
     orthographicBox->setChecked(renderParameters->orthoProjection);
+    progressiveBox->setChecked(renderParameters->progressiveRendering);
 
     // set sliders
     // x & y translate are scaled to notional unit sphere in render widgets
@@ -126,8 +133,13 @@ void RenderWindow::resetInterface() const {
     monteCarloBox->update();
     areaLightsBox->update();
     orthographicBox->update();
+    progressiveBox->update();
 }
 
 void RenderWindow::handleRaytrace() const {
     raytraceRenderWidget->Raytrace();
 }
+
+void RenderWindow::handleStop() const {
+    raytraceRenderWidget->Stop();
+}
@@ -33,6 +33,7 @@ private:
     QCheckBox* monteCarloBox;
     QCheckBox* areaLightsBox;
     QCheckBox* orthographicBox;
+    QCheckBox* progressiveBox;
 
     // check boxes for modelling options
     QCheckBox* centreObjectBox;
@@ -50,11 +51,17 @@ private:
     QLabel* yTranslateLabel;
     QLabel* zoomLabel;
 
-    // button for raytracing
+    // label for the statistics of the last raytrace
+    QLabel* raytraceStatusLabel;
+
+    // buttons for raytracing
     QPushButton* raytraceButton;
+    QPushButton* stopButton;
 
     void handleRaytrace() const;
 
+    void handleStop() const;
+
 public:
     RenderWindow(
         std::vector<ThreeDModel>* newTexturedObject,
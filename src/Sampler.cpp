@@ -0,0 +1,283 @@
+#include "Sampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define PCG_MULTIPLIER 6364136223846793005ULL
+
+// Second component of the generator of the rank-1 lattice, the first is 1
+// From the extensible lattice rules of Cools, Kuo and Nuyens, good for any power of 2 of points up to 2^20
+#define RANK1_GENERATOR 182667u
+
+// Steps of the R2 sequence of Roberts, 1 / g and 1 / g^2 for the plastic number g, in 32 bit fixed point
+// Stepping through it pixel by pixel gives a blue-noise mask
+#define R2_STEP_X 3242174889u
+#define R2_STEP_Y 2447445414u
+
+// Largest float below 1
+#define ONE_MINUS_EPSILON 0x1.fffffep-1f
+
+/**
+ * @return a well mixed 64 bit value derived from value (SplitMix64 finaliser)
+ */
+std::uint64_t splitMix64(std::uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+/**
+ * @return a well mixed 32 bit value derived from value (lowbias32 of Wellons)
+ */
+static std::uint32_t hash32(std::uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352du;
+    value ^= value >> 15;
+    value *= 0x846ca68bu;
+    value ^= value >> 16;
+    return value;
+}
+
+static std::uint32_t reverseBits(std::uint32_t value) {
+    value = (value << 16) | (value >> 16);
+    value = ((value & 0x00ff00ffu) << 8) | ((value & 0xff00ff00u) >> 8);
+    value = ((value & 0x0f0f0f0fu) << 4) | ((value & 0xf0f0f0f0u) >> 4);
+    value = ((value & 0x33333333u) << 2) | ((value & 0xccccccccu) >> 2);
+    value = ((value & 0x55555555u) << 1) | ((value & 0xaaaaaaaau) >> 1);
+    return value;
+}
+
+/**
+ * @return the 32 bit fixed point fraction bits as a float in [0..1)
+ */
+static float toUnit(const std::uint32_t bits) {
+    // Top 24 bits map exactly onto the float mantissa, result is strictly below 1
+    return static_cast<float>(bits >> 8) * 0x1p-24f;
+}
+
+/**
+ * @brief nestedUniformScramble Owen scrambles the fraction bits of value: every bit is flipped or not
+ *        depending on the bits above it, through the Laine-Karras hash as improved by Burley (2020)
+ */
+static std::uint32_t nestedUniformScramble(std::uint32_t value, const std::uint32_t seed) {
+    value = reverseBits(value);
+    value += seed;
+    value ^= value * 0x6c50b47cu;
+    value ^= value * 0xb82f1e52u;
+    value ^= value * 0xc7afe638u;
+    value ^= value * 0x8d22f6e6u;
+    return reverseBits(value);
+}
+
+/**
+ * @return the second dimension of the Sobol' sequence at index, as fraction bits, the first is reverseBits(index)
+ */
+static std::uint32_t sobolSecondDimension(std::uint32_t index) {
+    std::uint32_t result = 0;
+
+    for (std::uint32_t direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1) {
+        if (index & 1u) {
+            result ^= direction;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @return the image of i by a pseudo-random permutation of [0..length), picked by pattern (Kensler 2013)
+ */
+static unsigned int permute(unsigned int i, const unsigned int length, const unsigned int pattern) {
+    unsigned int mask = length - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+
+    // Permutes [0..mask], values outside [0..length) are permuted again until they fall inside
+    do {
+        i ^= pattern;
+        i *= 0xe170893du;
+        i ^= pattern >> 16;
+        i ^= (i & mask) >> 4;
+        i ^= pattern >> 8;
+        i *= 0x0929eb3fu;
+        i ^= pattern >> 23;
+        i ^= (i & mask) >> 1;
+        i *= 1u | pattern >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & mask) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & mask) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & mask) >> 2;
+        i *= 0xc860a3dfu;
+        i &= mask;
+        i ^= i >> 5;
+    } while (i >= length);
+
+    return (i + pattern) % length;
+}
+
+/**
+ * @return a pseudo-random value in [0..1) for i, picked by pattern (Kensler 2013)
+ */
+static float jitter(unsigned int i, const unsigned int pattern) {
+    i ^= pattern;
+    i ^= i >> 17;
+    i ^= i >> 10;
+    i *= 0xb36534e5u;
+    i ^= i >> 12;
+    i ^= i >> 21;
+    i *= 0x93fc4795u;
+    i ^= 0xdf6e307fu;
+    i ^= i >> 17;
+    i *= 1u | pattern >> 18;
+    return toUnit(i);
+}
+
+Sampler::Sampler(const std::uint64_t seed, const SampleSequence sequence, const unsigned int samplesPerPixel)
+    : seed(seed),
+      state(0),
+      increment(1),
+      sequence(sequence),
+      samplesPerPixel(std::max(1u, samplesPerPixel)),
+      pixelX(0),
+      pixelY(0),
+      sampleIndex(0),
+      dimensions{0, 0} {
+    startPixelSample(0, 0, 0);
+}
+
+/**
+ * @brief Sampler::startPixelSample re-seeds the generator for the given pixel sample.
+ *        The stream only depends on the seed, the pixel and the sample index.
+ */
+void Sampler::startPixelSample(unsigned int x, unsigned int y, unsigned int sampleIndex) {
+    std::uint64_t pixel = (static_cast<std::uint64_t>(y) << 32) | x;
+
+    state = 0;
+    // Increment must be odd
+    increment = (splitMix64(seed ^ splitMix64(sampleIndex)) << 1) | 1;
+    nextUInt();
+    state += splitMix64(seed + splitMix64(pixel));
+    nextUInt();
+
+    pixelX = x;
+    pixelY = y;
+    this->sampleIndex = sampleIndex;
+    dimensions = {static_cast<std::uint32_t>(splitMix64(seed)), 0};
+}
+
+/**
+ * @brief Sampler::enterBounce moves to the dimensions of a ray spawned by the current one.
+ *        The new ray is told apart from its siblings by the draw of its parent it is spawned at.
+ *
+ * @return the dimensions of the parent, given back to leaveBounce once the ray is traced
+ */
+Sampler::Dimensions Sampler::enterBounce() {
+    Dimensions parent = dimensions;
+    parent.next++;
+
+    dimensions.key = hash32(dimensions.key ^ hash32(dimensions.next + 0x9e3779b9u));
+    dimensions.next = 0;
+
+    return parent;
+}
+
+void Sampler::leaveBounce(const Dimensions& parent) {
+    dimensions = parent;
+}
+
+/**
+ * @return the next 32 bits of the PCG-XSH-RR stream
+ */
+std::uint32_t Sampler::nextUInt() {
+    std::uint64_t previous = state;
+    state = previous * PCG_MULTIPLIER + increment;
+
+    auto xorShifted = static_cast<std::uint32_t>(((previous >> 18) ^ previous) >> 27);
+    auto rotation = static_cast<std::uint32_t>(previous >> 59);
+
+    return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+}
+
+float Sampler::next1D() {
+    if (sequence == SampleSequence::Independent) {
+        return toUnit(nextUInt());
+    }
+
+    // The first dimension of every sequence is stratified on its own
+    return sequence2D().x;
+}
+
+glm::vec2 Sampler::next2D() {
+    if (sequence == SampleSequence::Independent) {
+        float u = next1D();
+        float v = next1D();
+        return {u, v};
+    }
+
+    return sequence2D();
+}
+
+/**
+ * @brief Sampler::sequence2D draws the point of the pixel sample in the next pair of dimensions of the ray.
+ *        Every pair of dimensions is scrambled or shifted differently, and so is every pixel.
+ */
+glm::vec2 Sampler::sequence2D() {
+    // The same in every pixel
+    const std::uint32_t dimension = hash32(dimensions.key ^ hash32(dimensions.next++));
+    const std::uint32_t pixelSeed = hash32(dimension ^ hash32(pixelX ^ hash32(pixelY)));
+
+    switch (sequence) {
+        case SampleSequence::Stratified: {
+            // Columns and rows of strata, exactly samplesPerPixel of them and as square as its divisors allow,
+            // a partly filled row would be sampled less than the others
+            unsigned int columns = static_cast<unsigned int>(std::sqrt(static_cast<float>(samplesPerPixel)));
+            while (samplesPerPixel % columns != 0) {
+                columns--;
+            }
+            const unsigned int rows = samplesPerPixel / columns;
+
+            // Samples past samplesPerPixel are laid out over a new set of strata
+            const std::uint32_t pattern = hash32(pixelSeed + sampleIndex / samplesPerPixel);
+            const unsigned int s = permute(sampleIndex % samplesPerPixel, samplesPerPixel, pattern * 0x51633e2du);
+
+            const unsigned int column = s % columns;
+            const unsigned int row = s / columns;
+            const unsigned int subColumn = permute(column, columns, pattern * 0xa511e9b3u);
+            const unsigned int subRow = permute(row, rows, pattern * 0x63d83595u);
+
+            const float x = (static_cast<float>(column)
+                             + (static_cast<float>(subRow) + jitter(s, pattern * 0xa399d265u)) / rows) / columns;
+            const float y = (static_cast<float>(row)
+                             + (static_cast<float>(subColumn) + jitter(s, pattern * 0x711ad6a5u)) / columns) / rows;
+            return {std::min(x, ONE_MINUS_EPSILON), std::min(y, ONE_MINUS_EPSILON)};
+        }
+        case SampleSequence::Sobol: {
+            // Shuffling the index decorrelates the dimensions, which all use the same 2D Sobol' points
+            const std::uint32_t index = nestedUniformScramble(sampleIndex, pixelSeed);
+            return {
+                toUnit(nestedUniformScramble(reverseBits(index), hash32(pixelSeed ^ 0xa511e9b3u))),
+                toUnit(nestedUniformScramble(sobolSecondDimension(index), hash32(pixelSeed ^ 0x63d83595u)))
+            };
+        }
+        case SampleSequence::Rank1: {
+            // Neighbouring pixels are shifted far apart, so that the error is blue noise over the image
+            const std::uint32_t shiftX = R2_STEP_X * pixelX + R2_STEP_Y * pixelY + dimension;
+            const std::uint32_t shiftY = R2_STEP_Y * pixelX + R2_STEP_X * pixelY + hash32(dimension);
+            // Radical inverse of the index, the first 2^m points are the lattice of 2^m points
+            const std::uint32_t radicalInverse = reverseBits(sampleIndex);
+            return {toUnit(radicalInverse + shiftX), toUnit(radicalInverse * RANK1_GENERATOR + shiftY)};
+        }
+        case SampleSequence::Independent:
+        default: {
+            float u = toUnit(nextUInt());
+            float v = toUnit(nextUInt());
+            return {u, v};
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <glm/vec2.hpp>
+
+// Sequence the samples of a pixel are drawn from
+enum class SampleSequence {
+    // independent uniform draws from the PCG32 stream
+    Independent,
+    // correlated multi-jittered sampling (Kensler 2013), stratified in 2D and along each axis
+    Stratified,
+    // 2D Sobol' points with hash-based Owen scrambling (Burley 2020), shuffled differently in every dimension
+    Sobol,
+    // extensible rank-1 lattice, shifted in every pixel by a blue-noise mask
+    Rank1
+};
+
+/*
+ * Sample generator, one instance per thread
+ * Re-seeded for every pixel sample from (seed, pixel, sample index),
+ * so renders are reproducible regardless of how pixels are scheduled on threads
+ *
+ * Independent draws come from a small PCG32 pseudo-random generator.
+ * The other sequences give the n-th sample of a pixel the n-th point of a sequence spread over the pixel samples,
+ * one pair of dimensions per draw. Every ray draws from dimensions of its own, see enterBounce,
+ * so the dimensions of a bounce do not depend on how many draws were made before it.
+ */
+class Sampler {
+public:
+    // Dimensions a ray draws from: a key identifying the ray within the pixel sample, and the next draw of the ray
+    struct Dimensions {
+        std::uint32_t key;
+        std::uint32_t next;
+    };
+
+    explicit Sampler(std::uint64_t seed = 0,
+                     SampleSequence sequence = SampleSequence::Independent,
+                     unsigned int samplesPerPixel = 1);
+
+    void startPixelSample(unsigned int x, unsigned int y, unsigned int sampleIndex);
+
+    Dimensions enterBounce();
+
+    void leaveBounce(const Dimensions& parent);
+
+    std::uint32_t nextUInt();
+
+    // uniform in [0..1)
+    float next1D();
+
+    // uniform in [0..1)^2
+    glm::vec2 next2D();
+
+private:
+    std::uint64_t seed;
+    std::uint64_t state;
+    std::uint64_t increment;
+
+    SampleSequence sequence;
+    // the stratified sequence lays its strata out for this many samples
+    unsigned int samplesPerPixel;
+
+    unsigned int pixelX;
+    unsigned int pixelY;
+    unsigned int sampleIndex;
+    Dimensions dimensions;
+
+    glm::vec2 sequence2D();
+};
+
+#endif // SAMPLER_H
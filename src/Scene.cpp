@@ -1,6 +1,8 @@
 #include "Scene.h"
 
 #include "Math.h"
+#include <algorithm>
+#include <chrono>
 #include <limits>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
@@ -8,6 +10,14 @@
 Scene::Scene(std::vector<ThreeDModel>* texobjs, RenderParameters* renderp) {
     objects = texobjs;
     rp = renderp;
+    geometryChanged = true;
+    instancesChanged = true;
+    geometryMilliseconds = 0.0;
+    geometryTriangles = 0;
+
+    for (unsigned int i = 0; i < objects->size(); i++) {
+        instances.emplace_back(i, glm::identity<glm::mat4>());
+    }
 
     glm::vec3 ambient = glm::vec3(0.5f, 0.5f, 0.5f);
     glm::vec3 diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
@@ -27,62 +37,173 @@ void printModelView(const glm::mat4& modelView) {
             << std::endl;
 }
 
+/**
+ * @brief Scene::updateScene prepares the scene for a render from the current view.
+ *        The geometry only depends on the objects, so changing the view does not rebuild it.
+ *        Moving instances only rebuilds the top level.
+ */
 void Scene::updateScene() {
-    triangles.clear(); // Clear the list so it can be populated again
-
-    typedef unsigned int uint;
-
-    glm::mat4 modelView = this->modelView();
-
-    printModelView(modelView);
-
-    for (const auto& object : *objects) {
-        for (uint face = 0; face < object.faceVertices.size(); face++) {
-            for (uint triangle = 0; triangle < object.faceVertices[face].size() - 2; triangle++) {
-                Triangle t;
-
-                for (uint vertex = 0; vertex < 3; vertex++) {
-                    uint faceVertex = 0;
-                    if (vertex != 0) {
-                        faceVertex = triangle + vertex;
-                    }
-
-                    auto v = glm::vec4(
-                        object.vertices[object.faceVertices[face][faceVertex]].x,
-                        object.vertices[object.faceVertices[face][faceVertex]].y,
-                        object.vertices[object.faceVertices[face][faceVertex]].z,
-                        1.0f);
-                    t.vertices[vertex] = modelView * v;
-
-                    auto n = glm::vec4(
-                        object.normals[object.faceNormals[face][faceVertex]].x,
-                        object.normals[object.faceNormals[face][faceVertex]].y,
-                        object.normals[object.faceNormals[face][faceVertex]].z,
-                        0.0f);
-                    t.normals[vertex] = modelView * n;
-
-                    auto tex = glm::vec3(
-                        object.textureCoords[object.faceTexCoords[face][faceVertex]].x,
-                        object.textureCoords[object.faceTexCoords[face][faceVertex]].y,
-                        0.0f);
-                    t.uvs[vertex] = tex;
-
-                    t.colors[vertex] = {0.7f, 0.7f, 0.7f, 1.0f};
-                }
-
-                if (object.material == nullptr) {
-                    t.sharedMaterial = defaultMaterial;
-                } else {
-                    t.sharedMaterial = object.material;
-                }
-
-                t.computePlanarValues();
-                triangles.push_back(t);
-            }
+    printModelView(modelView());
+
+    if (geometryChanged) {
+        buildGeometry();
+        geometryChanged = false;
+        instancesChanged = true;
+    }
+
+    if (instancesChanged) {
+        buildTopLevel();
+        instancesChanged = false;
+    }
+}
+
+/**
+ * @brief Scene::addInstance places another copy of an object in the scene, sharing its triangles
+ *
+ * @param object index of the object in objects
+ * @param transform from the object space of the object to the scene
+ *
+ * @return the index of the new instance
+ */
+unsigned int Scene::addInstance(const unsigned int object, const glm::mat4& transform) {
+    instances.emplace_back(object, transform);
+    instancesChanged = true;
+
+    return static_cast<unsigned int>(instances.size() - 1);
+}
+
+/**
+ * @brief Scene::setInstanceTransform moves an instance, only the top level is rebuilt on the next update
+ */
+void Scene::setInstanceTransform(const unsigned int instance, const glm::mat4& transform) {
+    instances[instance].setTransform(transform);
+    instancesChanged = true;
+}
+
+unsigned int Scene::instanceCount() const {
+    return static_cast<unsigned int>(instances.size());
+}
+
+/**
+ * @brief Scene::buildMillisecondsPerMillionTriangles the speed of the last rebuild of the meshes,
+ *        comparable across scenes of any size
+ *
+ * @return 0 if there were no triangles
+ */
+double Scene::buildMillisecondsPerMillionTriangles() const {
+    if (geometryTriangles == 0) {
+        return 0.0;
+    }
+    return geometryMilliseconds * 1.0e6 / static_cast<double>(geometryTriangles);
+}
+
+/**
+ * @brief Scene::buildGeometry triangulates every object, in object space, and builds its bottom level hierarchy
+ */
+void Scene::buildGeometry() {
+    auto start = std::chrono::steady_clock::now();
+
+    meshes.assign(objects->size(), Mesh());
+    std::vector<BVHCache::Status> cacheStatus(objects->size());
+
+    // One task per mesh, rather than a loop, so that the tasks a large mesh splits its build into
+    // run on the threads left idle by the small ones. Builds use the threads the render is given.
+    const int threads = static_cast<int>(std::max(1u, rp->threads));
+    // clang-format off
+#pragma omp parallel num_threads(threads)
+#pragma omp single
+    // clang-format on
+    for (unsigned int i = 0; i < objects->size(); i++) {
+        // clang-format off
+#pragma omp task firstprivate(i)
+        // clang-format on
+        cacheStatus[i] = meshes[i].build((*objects)[i], defaultMaterial, rp->bvhBuilder, rp->bvhCacheDirectory);
+    }
+
+    instances.erase(std::remove_if(instances.begin(), instances.end(), [this](const Instance& instance) {
+        return instance.mesh >= meshes.size();
+    }), instances.end());
+
+    std::size_t triangles = 0;
+    std::size_t nodes = 0;
+    std::size_t duplicates = 0;
+    std::size_t derivedBytes = 0;
+    unsigned int depth = 0;
+    // SAH costs are relative to the root of each mesh, weighed by its area to sum them over the scene
+    double sahCost = 0.0;
+    double area = 0.0;
+    for (const Mesh& mesh : meshes) {
+        triangles += mesh.triangles.size();
+        duplicates += mesh.bvh.duplicates();
+        nodes += mesh.bvh.nodes.size();
+        derivedBytes += mesh.derivedBytes();
+        depth = std::max(depth, mesh.bvh.depth());
+        sahCost += mesh.bvh.sahCost() * mesh.bounds().surfaceArea();
+        area += mesh.bounds().surfaceArea();
+    }
+
+    std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - start;
+
+    const std::size_t bytes = triangles * sizeof(Triangle) + nodes * sizeof(BVHNode) + derivedBytes;
+
+    geometryMilliseconds = buildTime.count();
+    geometryTriangles = triangles - duplicates;
+
+    std::cout << std::endl
+            << "Meshes: " << meshes.size() << ", "
+            << triangles << " triangles (" << duplicates << " duplicated by spatial splits), "
+            << nodes << " nodes, "
+            << "depth " << depth << ", "
+            << "SAH cost " << (area > 0.0 ? sahCost / area : 0.0) << ", "
+            << bytes / 1024 << " KB, "
+            << "built in " << buildTime.count() << " ms, "
+            << buildMillisecondsPerMillionTriangles() << " ms per million triangles"
+            << std::endl;
+
+    if (!rp->bvhCacheDirectory.empty()) {
+        const BVHCache::Status statuses[] = {BVHCache::Status::Loaded, BVHCache::Status::Missing,
+                                             BVHCache::Status::Stale, BVHCache::Status::Invalid};
+
+        std::cout << "BVH cache: " << rp->bvhCacheDirectory;
+        for (BVHCache::Status status : statuses) {
+            std::cout << ", " << std::count(cacheStatus.begin(), cacheStatus.end(), status)
+                    << " " << BVHCache::statusName(status);
         }
+        std::cout << std::endl;
     }
 }
 
+/**
+ * @brief Scene::buildTopLevel rebuilds the hierarchy over the instances, leaving the meshes untouched
+ */
+void Scene::buildTopLevel() {
+    auto start = std::chrono::steady_clock::now();
+
+    // Run in a team of the render threads, which a build over many instances joins rather than starting its own
+    const int threads = static_cast<int>(std::max(1u, rp->threads));
+    // clang-format off
+#pragma omp parallel num_threads(threads)
+#pragma omp single
+    // clang-format on
+    topLevel.build(instances, meshes);
+
+    std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - start;
+
+    std::size_t instancedTriangles = 0;
+    for (const Instance& instance : instances) {
+        instancedTriangles += meshes[instance.mesh].triangles.size();
+    }
+
+    const std::size_t bytes = instances.size() * sizeof(Instance) + topLevel.nodeCount() * sizeof(BVHNode);
+
+    std::cout << "Instances: " << instances.size() << ", "
+            << instancedTriangles << " instanced triangles, "
+            << topLevel.nodeCount() << " nodes, "
+            << bytes / 1024 << " KB, "
+            << "built in " << buildTime.count() << " ms"
+            << std::endl;
+}
+
 glm::mat4 Scene::modelView() const {
     glm::mat4 rotation = rp->rotationMatrix;
     // Offset scene z by (-1) to mimic RenderWidget
@@ -94,32 +215,17 @@ glm::mat4 Scene::modelView() const {
 }
 
 CollisionInfo Scene::closestTriangle(const Ray& ray) const {
-    const Triangle* closestTriangle = nullptr;
-    float minT = std::numeric_limits<float>::infinity();
-
-    for (auto& triangle : triangles) {
-        float t = triangle.intersect(ray);
-
-        if (0.0f < t && t < minT) {
-            closestTriangle = &triangle;
-            minT = t;
-        }
-    }
-
-    return closestTriangle != nullptr
-               ? CollisionInfo(*closestTriangle, minT)
-               : CollisionInfo(Triangle(), NO_INTERSECT);
-}
-
-CollisionInfo::CollisionInfo(const Triangle& triangle, float t)
-    : triangle(triangle)
-      , t(t) {
-}
-
-bool CollisionInfo::isHit() const {
-    return t > 0.0f;
+    return topLevel.closestHit(ray, instances, meshes, rp->intersectionKernel, rp->bvhLayout);
 }
 
-bool CollisionInfo::isShadowHit() const {
-    return isHit() && !triangle.sharedMaterial->isLight();
+/**
+ * @brief Scene::occludingTriangle any-hit query for shadow rays, see BVH::occludingHit
+ *
+ * @param ray with origin at the shaded point and direction towards the light
+ * @param maxDistance distance to the light, triangles beyond it do not occlude
+ *
+ * @return a hit on an opaque triangle if any, otherwise the closest hit on a non-opaque triangle, if any
+ */
+CollisionInfo Scene::occludingTriangle(const Ray& ray, float maxDistance) const {
+    return topLevel.occludingHit(ray, instances, meshes, rp->intersectionKernel, rp->bvhLayout, maxDistance);
 }
@@ -1,40 +1,63 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <cstddef>
+#include <vector>
+#include <glm/mat4x4.hpp>
+
+#include "CollisionInfo.h"
+#include "Instance.h"
+#include "Mesh.h"
 #include "Ray.h"
 #include "ThreeDModel.h"
-#include "Triangle.h"
+#include "TopLevelBVH.h"
 #include "RenderParameters.h"
 
-struct CollisionInfo;
-
 class Scene {
 private:
     Material* defaultMaterial;
 
+    // Two level hierarchy, kept in object space: rays are transformed into it rather than the other way round
+    // one mesh per object, shared by all of its instances
+    std::vector<Mesh> meshes;
+    // placements of the meshes, starting with one in place per object
+    std::vector<Instance> instances;
+    TopLevelBVH topLevel;
+
+    // the meshes are not built yet, build both levels on the next update
+    bool geometryChanged;
+    // instances were added or moved, rebuild the top level on the next update
+    bool instancesChanged;
+
+    // time taken by the last rebuild of the meshes, and the triangles it went through
+    double geometryMilliseconds;
+    std::size_t geometryTriangles;
+
+    void buildGeometry();
+
+    void buildTopLevel();
+
 public:
     std::vector<ThreeDModel>* objects;
     RenderParameters* rp;
-    std::vector<Triangle> triangles;
 
     Scene(std::vector<ThreeDModel>* texobjs, RenderParameters* renderp);
 
     void updateScene();
 
-    glm::mat4 modelView() const;
+    unsigned int addInstance(unsigned int object, const glm::mat4& transform);
 
-    CollisionInfo closestTriangle(const Ray& ray) const;
-};
+    void setInstanceTransform(unsigned int instance, const glm::mat4& transform);
 
-struct CollisionInfo {
-    Triangle triangle;
-    float t;
+    unsigned int instanceCount() const;
 
-    CollisionInfo(const Triangle& triangle, float t);
+    double buildMillisecondsPerMillionTriangles() const;
 
-    bool isHit() const;
+    glm::mat4 modelView() const;
+
+    CollisionInfo closestTriangle(const Ray& ray) const;
 
-    bool isShadowHit() const;
+    CollisionInfo occludingTriangle(const Ray& ray, float maxDistance) const;
 };
 
 #endif // SCENE_H
@@ -0,0 +1,495 @@
+#include "SceneCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define SCENE_CACHE_PROCESS_ID getpid()
+#else
+#include <process.h>
+#define SCENE_CACHE_PROCESS_ID _getpid()
+#endif
+
+#include "MappedFile.h"
+
+// First bytes of every cache file, including the terminating null
+#define SCENE_CACHE_MAGIC "STCACHE"
+// Written in the byte order of the machine, a cache from a machine with another byte order is stale
+#define SCENE_CACHE_BYTE_ORDER 0x01020304u
+// Every section starts on a multiple of this many bytes, so it can be used in place from a mapping
+#define SCENE_CACHE_ALIGNMENT 8
+
+#define HASH_PRIME_1 0x9e3779b185ebca87ULL
+#define HASH_PRIME_2 0xc2b2ae3d27d4eb4fULL
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be 3 packed floats");
+static_assert(sizeof(unsigned int) == sizeof(std::uint32_t), "face indices must be 32 bits");
+
+// Range of the file holding count elements
+struct CacheSection {
+    std::uint64_t offset;
+    std::uint64_t count;
+};
+
+struct CacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t sourceHash;
+    // size of the whole file, catches truncated writes
+    std::uint64_t fileSize;
+
+    CacheSection materials;
+    CacheSection models;
+    CacheSection vertices;
+    CacheSection normals;
+    CacheSection textureCoords;
+    CacheSection faceVertices;
+    CacheSection faceNormals;
+    CacheSection faceTexCoords;
+    CacheSection faceStarts;
+};
+
+struct CachedMaterial {
+    char name[SCENE_CACHE_NAME_LENGTH];
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float emissive[3];
+    float shininess;
+    float reflectivity;
+    float indexOfRefraction;
+    float transparency;
+    std::uint32_t setFromFile;
+    std::uint32_t padding;
+};
+
+struct CachedModel {
+    // index into the material table, -1 for none
+    std::int64_t material;
+    // range of the corners of the model in the face arrays
+    std::uint64_t firstCorner;
+    std::uint64_t cornerCount;
+    // the model has faceCount + 1 face starts, relative to its first corner
+    std::uint64_t firstFaceStart;
+    std::uint64_t faceCount;
+};
+
+static std::uint64_t alignOffset(std::uint64_t offset) {
+    return (offset + SCENE_CACHE_ALIGNMENT - 1) / SCENE_CACHE_ALIGNMENT * SCENE_CACHE_ALIGNMENT;
+}
+
+/**
+ * @return whether section lies within a file of fileSize bytes
+ */
+static bool sectionFits(const CacheSection& section, std::size_t elementSize, std::uint64_t fileSize) {
+    return section.offset % SCENE_CACHE_ALIGNMENT == 0
+           && section.offset <= fileSize
+           && section.count <= (fileSize - section.offset) / elementSize;
+}
+
+/**
+ * @brief copySection copies a section of the file into values, in a single allocation
+ */
+template<typename T>
+static void copySection(const char* data, const CacheSection& section, std::vector<T>& values) {
+    values.resize(section.count);
+    if (section.count > 0) {
+        std::memcpy(values.data(), data + section.offset, section.count * sizeof(T));
+    }
+}
+
+/**
+ * @brief copyIndices copies count indices into the pool array of size elements they refer to
+ *
+ * @return false if one of them is out of the bounds of that array
+ */
+static bool copyIndices(const std::uint32_t* source, const std::uint64_t count, const std::size_t size,
+                        std::vector<unsigned int>& indices) {
+    indices.resize(count);
+    bool inBounds = true;
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        indices[i] = source[i];
+        inBounds = inBounds && source[i] < size;
+    }
+
+    return inBounds;
+}
+
+static void copyVector(const glm::vec3& vector, float* destination) {
+    destination[0] = vector.x;
+    destination[1] = vector.y;
+    destination[2] = vector.z;
+}
+
+static glm::vec3 readVector(const float* source) {
+    return glm::vec3(source[0], source[1], source[2]);
+}
+
+std::string SceneCache::pathFor(const std::string& geometryPath) {
+    return geometryPath + SCENE_CACHE_EXTENSION;
+}
+
+/**
+ * @brief SceneCache::temporaryPathFor names a file to write a cache into before renaming it to cachePath
+ *        The name carries the process id and a per process counter, so concurrent writers of the same
+ *        cache, whether threads or other processes, never share a temporary file
+ */
+std::string SceneCache::temporaryPathFor(const std::string& cachePath) {
+    static std::atomic<unsigned long> counter{0};
+    return cachePath + ".tmp" + std::to_string(SCENE_CACHE_PROCESS_ID) + "." + std::to_string(counter++);
+}
+
+/**
+ * @brief SceneCache::hash is a fast non-cryptographic 64 bit hash of a block of memory,
+ *        good enough to tell whether a source file changed since its cache was written
+ *
+ * @param seed chains hashes of several blocks, pass the hash of the previous block
+ */
+std::uint64_t SceneCache::hash(const char* data, const std::size_t size, const std::uint64_t seed) {
+    auto mix = [](std::uint64_t value, std::uint64_t word) {
+        value ^= word * HASH_PRIME_2;
+        value = (value << 31) | (value >> 33);
+        return value * HASH_PRIME_1;
+    };
+
+    std::uint64_t value = seed ^ (static_cast<std::uint64_t>(size) * HASH_PRIME_1);
+
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        value = mix(value, word);
+    }
+
+    if (i < size) {
+        std::uint64_t tail = 0;
+        std::memcpy(&tail, data + i, size - i);
+        value = mix(value, tail);
+    }
+
+    // Avalanche, so that every input bit affects every output bit
+    value ^= value >> 33;
+    value *= HASH_PRIME_2;
+    value ^= value >> 29;
+    value *= HASH_PRIME_1;
+    return value ^ (value >> 32);
+}
+
+/**
+ * @brief SceneCache::read loads the models stored in a cache file, along with fresh copies of their materials
+ *
+ * @param cachePath path of the cache file
+ * @param sourceHash hash of the source files, the cache must have been written from the same sources
+ * @param models set to the cached models when the cache is loaded, untouched otherwise
+ *
+ * @return Loaded on success, otherwise why the cache cannot be used
+ */
+SceneCache::Status SceneCache::read(const std::string& cachePath,
+                                    const std::uint64_t sourceHash,
+                                    std::vector<ThreeDModel>& models) {
+    MappedFile file(cachePath);
+
+    if (!file.isOpen()) {
+        return Status::Missing;
+    }
+
+    CacheHeader header{};
+    if (file.size() < sizeof(header)) {
+        return Status::Invalid;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic)) != 0) {
+        return Status::Invalid;
+    }
+
+    if (header.version != SCENE_CACHE_VERSION
+        || header.byteOrder != SCENE_CACHE_BYTE_ORDER
+        || header.sourceHash != sourceHash) {
+        return Status::Stale;
+    }
+
+    const std::uint64_t fileSize = file.size();
+    const std::uint64_t corners = header.faceVertices.count;
+
+    if (header.fileSize != fileSize
+        || !sectionFits(header.materials, sizeof(CachedMaterial), fileSize)
+        || !sectionFits(header.models, sizeof(CachedModel), fileSize)
+        || !sectionFits(header.vertices, 3 * sizeof(float), fileSize)
+        || !sectionFits(header.normals, 3 * sizeof(float), fileSize)
+        || !sectionFits(header.textureCoords, 3 * sizeof(float), fileSize)
+        || !sectionFits(header.faceVertices, sizeof(std::uint32_t), fileSize)
+        || !sectionFits(header.faceNormals, sizeof(std::uint32_t), fileSize)
+        || !sectionFits(header.faceTexCoords, sizeof(std::uint32_t), fileSize)
+        || !sectionFits(header.faceStarts, sizeof(std::uint32_t), fileSize)
+        || header.faceNormals.count != corners
+        || header.faceTexCoords.count != corners) {
+        return Status::Invalid;
+    }
+
+    const char* data = file.data();
+
+    std::vector<CachedMaterial> cachedMaterials;
+    std::vector<CachedModel> cachedModels;
+    copySection(data, header.materials, cachedMaterials);
+    copySection(data, header.models, cachedModels);
+
+    // Materials are allocated like Material::readMaterials does, the models do not own them
+    std::vector<Material*> materials;
+    materials.reserve(cachedMaterials.size());
+    for (CachedMaterial& cached : cachedMaterials) {
+        auto material = new Material();
+        cached.name[SCENE_CACHE_NAME_LENGTH - 1] = '\0';
+        material->name = cached.name;
+        material->ambient = readVector(cached.ambient);
+        material->diffuse = readVector(cached.diffuse);
+        material->specular = readVector(cached.specular);
+        material->emissive = readVector(cached.emissive);
+        material->shininess = cached.shininess;
+        material->reflectivity = cached.reflectivity;
+        material->indexOfRefraction = cached.indexOfRefraction;
+        material->transparency = cached.transparency;
+        material->setFromFile = cached.setFromFile != 0;
+        materials.push_back(material);
+    }
+
+    auto pool = std::make_shared<VertexPool>();
+    copySection(data, header.vertices, pool->vertices);
+    copySection(data, header.normals, pool->normals);
+    copySection(data, header.textureCoords, pool->textureCoords);
+
+    auto faceArray = [data](const CacheSection& section) {
+        return reinterpret_cast<const std::uint32_t*>(data + section.offset);
+    };
+
+    std::vector<ThreeDModel> result(cachedModels.size());
+    bool valid = true;
+
+    for (unsigned int i = 0; i < cachedModels.size() && valid; i++) {
+        const CachedModel& cached = cachedModels[i];
+        ThreeDModel& model = result[i];
+
+        if (cached.material < -1
+            || cached.material >= static_cast<std::int64_t>(materials.size())
+            || cached.firstCorner > corners
+            || cached.cornerCount > corners - cached.firstCorner
+            || cached.firstFaceStart > header.faceStarts.count
+            || cached.faceCount >= header.faceStarts.count - cached.firstFaceStart) {
+            valid = false;
+            break;
+        }
+
+        model.pool = pool;
+        model.material = cached.material < 0 ? nullptr : materials[cached.material];
+
+        const std::uint32_t* vertices = faceArray(header.faceVertices) + cached.firstCorner;
+        const std::uint32_t* normals = faceArray(header.faceNormals) + cached.firstCorner;
+        const std::uint32_t* texCoords = faceArray(header.faceTexCoords) + cached.firstCorner;
+        const std::uint32_t* starts = faceArray(header.faceStarts) + cached.firstFaceStart;
+
+        // Corners index the pool unchecked once loaded, a corrupted index must not reach them
+        valid = copyIndices(vertices, cached.cornerCount, pool->vertices.size(), model.faceVertices)
+                && copyIndices(normals, cached.cornerCount, pool->normals.size(), model.faceNormals)
+                && copyIndices(texCoords, cached.cornerCount, pool->textureCoords.size(), model.faceTexCoords);
+        model.faceStarts.assign(starts, starts + cached.faceCount + 1);
+
+        // Face starts go from 0 to the number of corners without ever decreasing
+        valid = valid
+                && model.faceStarts.front() == 0
+                && model.faceStarts.back() == cached.cornerCount
+                && std::is_sorted(model.faceStarts.begin(), model.faceStarts.end());
+    }
+
+    if (!valid) {
+        for (Material* material : materials) {
+            delete material;
+        }
+        return Status::Invalid;
+    }
+
+    models.swap(result);
+    return Status::Loaded;
+}
+
+/**
+ * @brief SceneCache::write stores models and their material table in a cache file.
+ *        The file is written next to its final path then renamed, so a reader never sees a partial cache.
+ *
+ * @param cachePath path of the cache file
+ * @param sourceHash hash of the source files the models were read from
+ * @param materials every material read from the .mtl file, models may only use these
+ * @param models read from a single file, sharing one vertex pool
+ *
+ * @return whether the cache was written, models that cannot be cached are reported and skipped
+ */
+bool SceneCache::write(const std::string& cachePath,
+                       const std::uint64_t sourceHash,
+                       const std::vector<Material*>& materials,
+                       const std::vector<ThreeDModel>& models) {
+    if (models.empty()) {
+        return false;
+    }
+
+    CacheHeader header{};
+    std::memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_CACHE_VERSION;
+    header.byteOrder = SCENE_CACHE_BYTE_ORDER;
+    header.sourceHash = sourceHash;
+
+    std::vector<CachedMaterial> cachedMaterials(materials.size());
+    for (unsigned int i = 0; i < materials.size(); i++) {
+        const Material* material = materials[i];
+        CachedMaterial& cached = cachedMaterials[i];
+
+        // Texture maps live in files of their own, which the source hash does not cover
+        if (material->texture != nullptr) {
+            std::cout << "Scene cache: material " << material->name << " has a texture map, not cached" << std::endl;
+            return false;
+        }
+        if (material->name.size() >= SCENE_CACHE_NAME_LENGTH) {
+            std::cout << "Scene cache: material name " << material->name << " is too long, not cached" << std::endl;
+            return false;
+        }
+
+        std::memset(&cached, 0, sizeof(cached));
+        std::memcpy(cached.name, material->name.c_str(), material->name.size());
+        copyVector(material->ambient, cached.ambient);
+        copyVector(material->diffuse, cached.diffuse);
+        copyVector(material->specular, cached.specular);
+        copyVector(material->emissive, cached.emissive);
+        cached.shininess = material->shininess;
+        cached.reflectivity = material->reflectivity;
+        cached.indexOfRefraction = material->indexOfRefraction;
+        cached.transparency = material->transparency;
+        cached.setFromFile = material->setFromFile ? 1 : 0;
+    }
+
+    const VertexPool& pool = *models.front().pool;
+
+    std::vector<CachedModel> cachedModels(models.size());
+    std::uint64_t corners = 0;
+    std::uint64_t faceStarts = 0;
+
+    for (unsigned int i = 0; i < models.size(); i++) {
+        const ThreeDModel& model = models[i];
+        CachedModel& cached = cachedModels[i];
+
+        if (model.pool.get() != &pool) {
+            return false;
+        }
+
+        if (model.material == nullptr) {
+            cached.material = -1;
+        } else {
+            auto found = std::find(materials.begin(), materials.end(), model.material);
+            if (found == materials.end()) {
+                return false;
+            }
+            cached.material = found - materials.begin();
+        }
+
+        cached.firstCorner = corners;
+        cached.cornerCount = model.faceVertices.size();
+        cached.firstFaceStart = faceStarts;
+        cached.faceCount = model.faceCount();
+
+        corners += model.faceVertices.size();
+        faceStarts += model.faceStarts.size();
+    }
+
+    // Lay the sections out one after the other
+    std::uint64_t offset = alignOffset(sizeof(header));
+    auto place = [&offset](CacheSection& section, std::uint64_t count, std::size_t elementSize) {
+        section.offset = offset;
+        section.count = count;
+        offset = alignOffset(offset + count * elementSize);
+    };
+
+    place(header.materials, cachedMaterials.size(), sizeof(CachedMaterial));
+    place(header.models, cachedModels.size(), sizeof(CachedModel));
+    place(header.vertices, pool.vertices.size(), 3 * sizeof(float));
+    place(header.normals, pool.normals.size(), 3 * sizeof(float));
+    place(header.textureCoords, pool.textureCoords.size(), 3 * sizeof(float));
+    place(header.faceVertices, corners, sizeof(std::uint32_t));
+    place(header.faceNormals, corners, sizeof(std::uint32_t));
+    place(header.faceTexCoords, corners, sizeof(std::uint32_t));
+    place(header.faceStarts, faceStarts, sizeof(std::uint32_t));
+    header.fileSize = offset;
+
+    const std::string temporaryPath = temporaryPathFor(cachePath);
+    std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+
+    if (!stream.good()) {
+        std::cout << "Scene cache: cannot write " << cachePath << std::endl;
+        return false;
+    }
+
+    // Pads with zeros up to the start of the next section
+    std::uint64_t written = 0;
+    auto append = [&stream, &written](std::uint64_t sectionOffset, const void* bytes, std::size_t size) {
+        static const char zeros[SCENE_CACHE_ALIGNMENT] = {};
+        stream.write(zeros, static_cast<std::streamsize>(sectionOffset - written));
+        stream.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+        written = sectionOffset + size;
+    };
+
+    append(0, &header, sizeof(header));
+    append(header.materials.offset, cachedMaterials.data(), cachedMaterials.size() * sizeof(CachedMaterial));
+    append(header.models.offset, cachedModels.data(), cachedModels.size() * sizeof(CachedModel));
+    append(header.vertices.offset, pool.vertices.data(), pool.vertices.size() * sizeof(glm::vec3));
+    append(header.normals.offset, pool.normals.data(), pool.normals.size() * sizeof(glm::vec3));
+    append(header.textureCoords.offset, pool.textureCoords.data(), pool.textureCoords.size() * sizeof(glm::vec3));
+
+    const CacheSection* faceSections[] = {&header.faceVertices, &header.faceNormals, &header.faceTexCoords};
+    const std::vector<unsigned int> ThreeDModel::* faceArrays[] = {
+        &ThreeDModel::faceVertices, &ThreeDModel::faceNormals, &ThreeDModel::faceTexCoords
+    };
+
+    for (int array = 0; array < 3; array++) {
+        std::uint64_t sectionOffset = faceSections[array]->offset;
+        for (const ThreeDModel& model : models) {
+            const std::vector<unsigned int>& values = model.*faceArrays[array];
+            append(sectionOffset, values.data(), values.size() * sizeof(unsigned int));
+            sectionOffset += values.size() * sizeof(unsigned int);
+        }
+    }
+
+    std::uint64_t sectionOffset = header.faceStarts.offset;
+    for (const ThreeDModel& model : models) {
+        append(sectionOffset, model.faceStarts.data(), model.faceStarts.size() * sizeof(unsigned int));
+        sectionOffset += model.faceStarts.size() * sizeof(unsigned int);
+    }
+
+    append(header.fileSize, nullptr, 0);
+    stream.close();
+
+    if (!stream.good() || std::rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        std::cout << "Scene cache: cannot write " << cachePath << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+const char* SceneCache::statusName(const Status status) {
+    switch (status) {
+        case Status::Loaded:
+            return "loaded";
+        case Status::Missing:
+            return "missing";
+        case Status::Stale:
+            return "stale";
+        case Status::Invalid:
+            return "invalid";
+    }
+    return "unknown";
+}
@@ -0,0 +1,54 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Material.h"
+#include "ThreeDModel.h"
+
+// Bumped whenever the layout of the cache file changes, older caches are then rebuilt
+#define SCENE_CACHE_VERSION 1
+// Appended to the path of the .obj file to name its cache
+#define SCENE_CACHE_EXTENSION ".stcache"
+// Longest material name that fits in the material table, including the terminating null
+#define SCENE_CACHE_NAME_LENGTH 64
+
+/*
+ * Binary image of the models read from an .obj/.mtl pair
+ * The file is a fixed header followed by 8 byte aligned sections holding the material table,
+ * the model records, the shared vertex pool and the flat face arrays of all the models,
+ * in the same layout as in memory. Loading it is a handful of bulk copies out of a MappedFile.
+ * The header records a hash of the source files, a cache built from other sources is ignored.
+ */
+class SceneCache {
+public:
+    enum class Status {
+        Loaded,
+        // there is no cache file
+        Missing,
+        // the cache was built from different sources, or by another version
+        Stale,
+        // the cache file is truncated or inconsistent
+        Invalid
+    };
+
+    static std::string pathFor(const std::string& geometryPath);
+
+    static std::string temporaryPathFor(const std::string& cachePath);
+
+    static std::uint64_t hash(const char* data, std::size_t size, std::uint64_t seed);
+
+    static Status read(const std::string& cachePath, std::uint64_t sourceHash, std::vector<ThreeDModel>& models);
+
+    static bool write(const std::string& cachePath,
+                      std::uint64_t sourceHash,
+                      const std::vector<Material*>& materials,
+                      const std::vector<ThreeDModel>& models);
+
+    static const char* statusName(Status status);
+};
+
+#endif // SCENE_CACHE_H
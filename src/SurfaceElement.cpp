@@ -75,10 +75,7 @@ glm::vec4 SurfaceElement::indirectLighting() const {
  * @return whether rays should either refract and/or reflect on the surface
  */
 bool SurfaceElement::isPhong() const {
-    // clang-format off
-    return triangle.sharedMaterial->reflectivity == 0.0f &&
-           triangle.sharedMaterial->transparency == 0.0f;
-    // clang-format on
+    return triangle.sharedMaterial->isPhong();
 }
 
 float SurfaceElement::indexOfRefraction() const {
@@ -10,7 +10,7 @@ public:
         const glm::vec3& point,
         const glm::vec3& normal);
 
-    const Triangle triangle;
+    const Triangle& triangle;
     const glm::vec3 point;
     const glm::vec3 normal;
 
@@ -1,19 +1,47 @@
 #include "ThreeDModel.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iomanip>
+#include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <glm/geometric.hpp>
 
+#include "MappedFile.h"
 #include "Math.h"
+#include "ObjParser.h"
+#include "SceneCache.h"
 
 #define MAXIMUM_LINE_LENGTH 1024
 
-ThreeDModel::ThreeDModel() {
-    // TexturedObject()
-    vertices.resize(0);
-    normals.resize(0);
-    textureCoords.resize(0);
+std::size_t VertexPool::memoryUsage() const {
+    return (vertices.capacity() + normals.capacity() + textureCoords.capacity()) * sizeof(glm::vec3);
+}
+
+ThreeDModel::ThreeDModel()
+    : faceStarts{0} {
+}
+
+unsigned int ThreeDModel::faceCount() const {
+    return static_cast<unsigned int>(faceStarts.size() - 1);
+}
+
+unsigned int ThreeDModel::faceSize(const unsigned int face) const {
+    return faceStarts[face + 1] - faceStarts[face];
+}
+
+/**
+ * @brief ThreeDModel::addFace appends a polygon, given the 0-based IDs of each of its corners
+ */
+void ThreeDModel::addFace(const std::vector<unsigned int>& vertexIDs,
+                          const std::vector<unsigned int>& normalIDs,
+                          const std::vector<unsigned int>& texCoordIDs) {
+    faceVertices.insert(faceVertices.end(), vertexIDs.begin(), vertexIDs.end());
+    faceNormals.insert(faceNormals.end(), normalIDs.begin(), normalIDs.end());
+    faceTexCoords.insert(faceTexCoords.end(), texCoordIDs.begin(), texCoordIDs.end());
+    faceStarts.push_back(static_cast<unsigned int>(faceVertices.size()));
 }
 
 std::vector<ThreeDModel> ThreeDModel::readObjectStreamMaterial(std::istream& geometryStream,
@@ -25,9 +53,8 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStreamMaterial(std::istream& geo
     ThreeDModel model;
 
     // Vertex data is shared between everyone
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec3> textureCoords;
+    std::shared_ptr<VertexPool> pool = std::make_shared<VertexPool>();
+    model.pool = pool;
 
     while (true) {
         char readBuffer[MAXIMUM_LINE_LENGTH];
@@ -57,14 +84,14 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStreamMaterial(std::istream& geo
                     case ' ': {
                         glm::vec3 vertex;
                         geometryStream >> vertex;
-                        vertices.push_back(vertex);
+                        pool->vertices.push_back(vertex);
                         break;
                     }
                     // n indicates normal vector
                     case 'n': {
                         glm::vec3 normal;
                         geometryStream >> normal;
-                        normals.push_back(glm::normalize(normal));
+                        pool->normals.push_back(glm::normalize(normal));
                         break;
                     }
                     // t indicates texture coords
@@ -77,7 +104,7 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStreamMaterial(std::istream& geo
                         geometryStream >> v;
                         texCoord.x = u;
                         texCoord.y = v;
-                        textureCoords.push_back(texCoord);
+                        pool->textureCoords.push_back(texCoord);
                         break;
                     }
                     default:
@@ -134,9 +161,7 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStreamMaterial(std::istream& geo
 
                 // as long as the face has at least three vertices, add to the master list
                 if (faceVertexSet.size() > 2) {
-                    model.faceVertices.push_back(faceVertexSet);
-                    model.faceNormals.push_back(faceNormalSet);
-                    model.faceTexCoords.push_back(faceTexCoordSet);
+                    model.addFace(faceVertexSet, faceNormalSet, faceTexCoordSet);
                 }
 
                 break;
@@ -157,11 +182,9 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStreamMaterial(std::istream& geo
                             model.material = material;
                             break;
                         } else {
-                            model.vertices.assign(vertices.begin(), vertices.end());
-                            model.normals.assign(normals.begin(), normals.end());
-                            model.textureCoords.assign(textureCoords.begin(), textureCoords.end());
                             result.push_back(model);
                             model = ThreeDModel();
+                            model.pool = pool;
                             material = i;
                             model.material = material;
                         }
@@ -174,16 +197,86 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStreamMaterial(std::istream& geo
     }
 
     model.material = material;
-    model.vertices.assign(vertices.begin(), vertices.end());
-    model.normals.assign(normals.begin(), normals.end());
-    model.textureCoords.assign(textureCoords.begin(), textureCoords.end());
     result.push_back(model);
     return result;
 }
 
+/**
+ * @brief ThreeDModel::readObjectFileMaterial reads the same models as readObjectStreamMaterial,
+ *        memory-mapping the geometry file and parsing it in parallel
+ *
+ * @param geometryPath path of the .obj file
+ * @param materialStream the .mtl file
+ *
+ * @return the models, empty if the geometry file cannot be read
+ */
+std::vector<ThreeDModel> ThreeDModel::readObjectFileMaterial(const std::string& geometryPath,
+                                                             std::istream& materialStream) {
+    MappedFile geometryFile(geometryPath);
+
+    if (!geometryFile.isOpen()) {
+        return {};
+    }
+
+    std::vector<Material*> ms = Material::readMaterials(materialStream);
+
+    return ObjParser::parse(geometryFile.data(), geometryFile.size(), ms);
+}
+
+/**
+ * @brief ThreeDModel::readObjectFileCached reads the models from the binary cache next to the geometry file.
+ *        When there is no cache, or it was written from other sources, the files are parsed
+ *        like readObjectFileMaterial does and the cache is (re)written for the next time.
+ *
+ * @param geometryPath path of the .obj file
+ * @param materialPath path of the .mtl file
+ *
+ * @return the models, empty if either file cannot be read
+ */
+std::vector<ThreeDModel> ThreeDModel::readObjectFileCached(const std::string& geometryPath,
+                                                           const std::string& materialPath) {
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile geometryFile(geometryPath);
+    MappedFile materialFile(materialPath);
+
+    if (!geometryFile.isOpen() || !materialFile.isOpen()) {
+        return {};
+    }
+
+    // Both sources are hashed, editing either of them invalidates the cache
+    std::uint64_t sourceHash = SceneCache::hash(geometryFile.data(), geometryFile.size(), SCENE_CACHE_VERSION);
+    sourceHash = SceneCache::hash(materialFile.data(), materialFile.size(), sourceHash);
+
+    const std::string cachePath = SceneCache::pathFor(geometryPath);
+    std::vector<ThreeDModel> models;
+    SceneCache::Status status = SceneCache::read(cachePath, sourceHash, models);
+
+    if (status == SceneCache::Status::Loaded) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Scene cache: loaded " << cachePath << " in " << elapsed.count() << " ms" << std::endl;
+        return models;
+    }
+
+    std::istringstream materialStream(std::string(materialFile.data(), materialFile.size()));
+    std::vector<Material*> ms = Material::readMaterials(materialStream);
+    models = ObjParser::parse(geometryFile.data(), geometryFile.size(), ms);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Scene cache: " << SceneCache::statusName(status) << ", parsed " << geometryPath << " in "
+            << elapsed.count() << " ms" << std::endl;
+
+    if (SceneCache::write(cachePath, sourceHash, ms, models)) {
+        std::cout << "Scene cache: wrote " << cachePath << std::endl;
+    }
+
+    return models;
+}
+
 // read routine object true on success, NULL otherwise
 std::vector<ThreeDModel> ThreeDModel::readObjectStream(std::istream& geometryStream) {
     ThreeDModel model;
+    model.pool = std::make_shared<VertexPool>();
     model.material = nullptr;
 
     while (true) {
@@ -216,7 +309,7 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStream(std::istream& geometryStr
                     case ' ': {
                         glm::vec3 vertex;
                         geometryStream >> vertex;
-                        model.vertices.push_back(vertex);
+                        model.pool->vertices.push_back(vertex);
                         break;
                     }
 
@@ -224,7 +317,7 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStream(std::istream& geometryStr
                     case 'n': {
                         glm::vec3 normal;
                         geometryStream >> normal;
-                        model.normals.push_back(normal);
+                        model.pool->normals.push_back(normal);
                         break;
                     }
 
@@ -232,7 +325,7 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStream(std::istream& geometryStr
                     case 't': {
                         glm::vec3 texCoord;
                         geometryStream >> texCoord;
-                        model.textureCoords.push_back(texCoord);
+                        model.pool->textureCoords.push_back(texCoord);
                         break;
                     }
                     default:
@@ -291,9 +384,7 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStream(std::istream& geometryStr
 
                 // as long as the face has at least three vertices, add to the master list
                 if (faceVertexSet.size() > 2) {
-                    model.faceVertices.push_back(faceVertexSet);
-                    model.faceNormals.push_back(faceNormalSet);
-                    model.faceTexCoords.push_back(faceTexCoordSet);
+                    model.addFace(faceVertexSet, faceNormalSet, faceTexCoordSet);
                 }
 
                 break;
@@ -307,39 +398,74 @@ std::vector<ThreeDModel> ThreeDModel::readObjectStream(std::istream& geometryStr
 }
 
 void ThreeDModel::writeObjectStream(std::ostream& geometryStream) const {
-    for (unsigned int vertex = 0; vertex < vertices.size(); vertex++) {
-        geometryStream << "v  " << std::fixed << vertices[vertex] << std::endl;
+    for (unsigned int vertex = 0; vertex < pool->vertices.size(); vertex++) {
+        geometryStream << "v  " << std::fixed << pool->vertices[vertex] << std::endl;
     }
-    geometryStream << "# " << vertices.size() << " vertices" << std::endl;
+    geometryStream << "# " << pool->vertices.size() << " vertices" << std::endl;
     geometryStream << std::endl;
 
-    for (unsigned int normal = 0; normal < normals.size(); normal++) {
-        geometryStream << "vn " << std::fixed << normals[normal] << std::endl;
+    for (unsigned int normal = 0; normal < pool->normals.size(); normal++) {
+        geometryStream << "vn " << std::fixed << pool->normals[normal] << std::endl;
     }
-    geometryStream << "# " << normals.size() << " vertex normals" << std::endl;
+    geometryStream << "# " << pool->normals.size() << " vertex normals" << std::endl;
     geometryStream << std::endl;
 
-    for (unsigned int texCoord = 0; texCoord < textureCoords.size(); texCoord++) {
-        geometryStream << "vt " << std::fixed << textureCoords[texCoord] << std::endl;
+    for (unsigned int texCoord = 0; texCoord < pool->textureCoords.size(); texCoord++) {
+        geometryStream << "vt " << std::fixed << pool->textureCoords[texCoord] << std::endl;
     }
-    geometryStream << "# " << textureCoords.size() << " texture coords" << std::endl;
+    geometryStream << "# " << pool->textureCoords.size() << " texture coords" << std::endl;
     geometryStream << std::endl;
 
-    for (unsigned int face = 0; face < faceVertices.size(); face++) {
+    for (unsigned int face = 0; face < faceCount(); face++) {
         geometryStream << "f ";
 
         // loop through # of vertices
-        for (unsigned int vertex = 0; vertex < faceVertices[face].size(); vertex++) {
-            geometryStream << faceVertices[face][vertex] + 1 << "/" << faceTexCoords[face][vertex] + 1 << "/"
-                    << faceNormals[face][vertex] + 1 << " ";
+        for (unsigned int vertex = faceStarts[face]; vertex < faceStarts[face + 1]; vertex++) {
+            geometryStream << faceVertices[vertex] + 1 << "/" << faceTexCoords[vertex] + 1 << "/"
+                    << faceNormals[vertex] + 1 << " ";
         }
 
         geometryStream << std::endl;
     }
-    geometryStream << "# " << faceVertices.size() << " polygons" << std::endl;
+    geometryStream << "# " << faceCount() << " polygons" << std::endl;
     geometryStream << std::endl;
 }
 
+/**
+ * @brief ThreeDModel::printMemoryReport prints the memory held by models, counting each vertex pool once,
+ *        next to what it would take if every model held its own copy of the vertex data
+ */
+void ThreeDModel::printMemoryReport(const std::vector<ThreeDModel>& models) {
+    std::vector<const VertexPool*> pools;
+    std::size_t poolBytes = 0;
+    std::size_t copiedPoolBytes = 0;
+    std::size_t faceBytes = 0;
+    std::size_t faces = 0;
+
+    for (const ThreeDModel& model : models) {
+        copiedPoolBytes += model.pool->memoryUsage();
+
+        if (std::find(pools.begin(), pools.end(), model.pool.get()) == pools.end()) {
+            pools.push_back(model.pool.get());
+            poolBytes += model.pool->memoryUsage();
+        }
+
+        faceBytes += (model.faceVertices.capacity() + model.faceNormals.capacity()
+                      + model.faceTexCoords.capacity() + model.faceStarts.capacity()) * sizeof(unsigned int);
+        faces += model.faceCount();
+    }
+
+    const double megabyte = 1024.0 * 1024.0;
+
+    std::cout << "Memory: " << models.size() << " models, " << pools.size() << " vertex pools, " << faces << " faces"
+            << std::endl
+            << "Vertex data: " << poolBytes / megabyte << " MB (" << copiedPoolBytes / megabyte << " MB if copied per model)"
+            << std::endl
+            << "Face indices: " << faceBytes / megabyte << " MB"
+            << std::endl;
+}
+
+#ifndef SOFT_TRACE_HEADLESS
 void ThreeDModel::render() const {
     float emissiveColour[4];
     float specularColour[4];
@@ -399,25 +525,26 @@ void ThreeDModel::render() const {
     // repeat this for colour - extra call, but saves if statements
     glColor3fv(surfaceColour);
 
-    for (unsigned int face = 0; face < faceVertices.size(); face++) {
+    for (unsigned int face = 0; face < faceCount(); face++) {
         glBegin(GL_TRIANGLE_FAN);
-        for (unsigned int faceVertex = 0; faceVertex < faceVertices[face].size(); faceVertex++) {
+        for (unsigned int faceVertex = faceStarts[face]; faceVertex < faceStarts[face + 1]; faceVertex++) {
             glNormal3f(
-                normals[faceNormals[face][faceVertex]].x,
-                normals[faceNormals[face][faceVertex]].y,
-                normals[faceNormals[face][faceVertex]].z);
+                pool->normals[faceNormals[faceVertex]].x,
+                pool->normals[faceNormals[faceVertex]].y,
+                pool->normals[faceNormals[faceVertex]].z);
 
             // set the texture coordinate
             glTexCoord2f(
-                textureCoords[faceTexCoords[face][faceVertex]].x,
-                textureCoords[faceTexCoords[face][faceVertex]].y);
+                pool->textureCoords[faceTexCoords[faceVertex]].x,
+                pool->textureCoords[faceTexCoords[faceVertex]].y);
 
             // and set the vertex position
             glVertex3f(
-                vertices[faceVertices[face][faceVertex]].x,
-                vertices[faceVertices[face][faceVertex]].y,
-                vertices[faceVertices[face][faceVertex]].z);
+                pool->vertices[faceVertices[faceVertex]].x,
+                pool->vertices[faceVertices[faceVertex]].y,
+                pool->vertices[faceVertices[faceVertex]].z);
         }
         glEnd();
     }
 }
+#endif
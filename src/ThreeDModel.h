@@ -1,48 +1,86 @@
 #ifndef TEXTURED_OBJECT_H
 #define TEXTURED_OBJECT_H
 
+#include <cstddef>
+#include <memory>
+#include <string>
 #include <vector>
 #include <glm/vec3.hpp>
 
+// Headless builds have no OpenGL context, so they leave out immediate mode rendering
+#ifndef SOFT_TRACE_HEADLESS
 #ifdef __APPLE__
 #include <OpenGL/gl.h>
 #else
 #include <GL/gl.h>
 #endif
+#endif
 
 #include "Material.h"
 
+// Vertex data of a file, shared by all the models read from it
+struct VertexPool {
+    std::vector<glm::vec3> vertices;
+
+    std::vector<glm::vec3> normals;
+
+    std::vector<glm::vec3> textureCoords;
+
+    std::size_t memoryUsage() const;
+};
+
 /*
  * Minimalist (non-optimised) code for reading and
  * rendering an object file
  */
 class ThreeDModel {
 public:
-    std::vector<glm::vec3> vertices;
+    // Faces index into the pool, which usually holds the vertex data of other models too
+    // Null until a reader gives the model the pool of its file
+    std::shared_ptr<VertexPool> pool;
 
-    std::vector<glm::vec3> normals;
+    // Faces are stored flat: the corners of face f are [faceStarts[f], faceStarts[f + 1])
+    // in each of faceVertices, faceNormals & faceTexCoords
+    std::vector<unsigned int> faceVertices;
 
-    std::vector<glm::vec3> textureCoords;
-
-    std::vector<std::vector<unsigned int>> faceVertices;
+    std::vector<unsigned int> faceNormals;
 
-    std::vector<std::vector<unsigned int>> faceNormals;
+    std::vector<unsigned int> faceTexCoords;
 
-    std::vector<std::vector<unsigned int>> faceTexCoords;
+    // one entry per face followed by the total number of corners, starts at 0
+    std::vector<unsigned int> faceStarts;
 
     Material* material;
 
+#ifndef SOFT_TRACE_HEADLESS
     GLuint textureID;
+#endif
 
     ThreeDModel();
 
+    unsigned int faceCount() const;
+
+    unsigned int faceSize(unsigned int face) const;
+
+    void addFace(const std::vector<unsigned int>& vertexIDs,
+                 const std::vector<unsigned int>& normalIDs,
+                 const std::vector<unsigned int>& texCoordIDs);
+
     static std::vector<ThreeDModel> readObjectStream(std::istream& geometryStream);
 
     static std::vector<ThreeDModel> readObjectStreamMaterial(std::istream& geometryStream, std::istream& materialStream);
 
+    static std::vector<ThreeDModel> readObjectFileMaterial(const std::string& geometryPath, std::istream& materialStream);
+
+    static std::vector<ThreeDModel> readObjectFileCached(const std::string& geometryPath, const std::string& materialPath);
+
     void writeObjectStream(std::ostream& geometryStream) const;
 
+    static void printMemoryReport(const std::vector<ThreeDModel>& models);
+
+#ifndef SOFT_TRACE_HEADLESS
     void render() const;
+#endif
 };
 
 #endif
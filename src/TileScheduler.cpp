@@ -0,0 +1,117 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @return the Morton code of (x, y), the bits of x and y interleaved
+ */
+std::uint32_t mortonCode(std::uint32_t x, std::uint32_t y) {
+    auto spread = [](std::uint32_t v) {
+        v &= 0x0000FFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+
+    return spread(x) | (spread(y) << 1);
+}
+
+/**
+ * @param width of the image in pixels
+ * @param height of the image in pixels
+ * @param tileSize side of the tiles in pixels, tiles on the right and top edges may be smaller
+ * @param threads number of threads that will ask for tiles, identified by 0 .. threads - 1
+ */
+TileScheduler::TileScheduler(long width, long height, int tileSize, int threads)
+    : tiles(0) {
+    tileSize = std::max(1, tileSize);
+    threads = std::max(1, threads);
+
+    const int tilesX = static_cast<int>((width + tileSize - 1) / tileSize);
+    const int tilesY = static_cast<int>((height + tileSize - 1) / tileSize);
+
+    std::vector<std::pair<std::uint32_t, Tile>> ordered;
+    ordered.reserve(static_cast<unsigned long>(tilesX * tilesY));
+
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            Tile tile{};
+            tile.x0 = tx * tileSize;
+            tile.y0 = ty * tileSize;
+            tile.x1 = static_cast<int>(std::min<long>(tile.x0 + tileSize, width));
+            tile.y1 = static_cast<int>(std::min<long>(tile.y0 + tileSize, height));
+
+            ordered.emplace_back(mortonCode(tx, ty), tile);
+        }
+    }
+
+    std::sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    tiles = static_cast<unsigned int>(ordered.size());
+
+    // Contiguous runs of the curve, so every thread starts on a compact region of the image
+    for (int t = 0; t < threads; t++) {
+        auto queue = std::make_unique<WorkQueue>();
+
+        const unsigned long first = ordered.size() * t / threads;
+        const unsigned long last = ordered.size() * (t + 1) / threads;
+        for (unsigned long i = first; i < last; i++) {
+            queue->tiles.push_back(ordered[i].second);
+        }
+
+        queues.push_back(std::move(queue));
+    }
+}
+
+/**
+ * @brief TileScheduler::next takes the next tile of thread's own queue, or steals one if it is empty
+ *
+ * @param thread index of the calling thread
+ * @param tile set to the tile to trace
+ * @param stolen set to whether the tile was taken from another thread's queue
+ *
+ * @return false once every tile has been handed out
+ */
+bool TileScheduler::next(int thread, Tile& tile, bool& stolen) {
+    WorkQueue& own = *queues[thread];
+
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tiles.empty()) {
+            tile = own.tiles.front();
+            own.tiles.pop_front();
+            stolen = false;
+            return true;
+        }
+    }
+
+    stolen = true;
+    return steal(thread, tile);
+}
+
+bool TileScheduler::steal(int thread, Tile& tile) {
+    const int threads = static_cast<int>(queues.size());
+
+    // Victims are visited starting from the next thread, so thieves spread over the queues
+    for (int offset = 1; offset < threads; offset++) {
+        WorkQueue& victim = *queues[(thread + offset) % threads];
+
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tiles.empty()) {
+            tile = victim.tiles.back();
+            victim.tiles.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+unsigned int TileScheduler::tileCount() const {
+    return tiles;
+}
@@ -0,0 +1,43 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Rectangle of pixels [x0, x1) x [y0, y1) traced as a unit of work
+struct Tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+/*
+ * Splits an image into square tiles and hands them out to a fixed number of threads
+ * Tiles are laid out in Morton (Z-order) so that consecutive tiles are close in the image,
+ * and every thread starts with a contiguous run of them in its own deque.
+ * A thread that runs dry steals from the back of the other deques, away from where their owner works.
+ */
+class TileScheduler {
+public:
+    TileScheduler(long width, long height, int tileSize, int threads);
+
+    bool next(int thread, Tile& tile, bool& stolen);
+
+    unsigned int tileCount() const;
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+
+    // one queue per thread, on the heap as mutexes cannot move
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    unsigned int tiles;
+
+    bool steal(int thread, Tile& tile);
+};
+
+#endif // TILE_SCHEDULER_H
@@ -0,0 +1,171 @@
+#include "TopLevelBVH.h"
+
+#include <limits>
+
+#include "Math.h"
+
+/**
+ * @brief TopLevelBVH::build updates the bounds of instances and builds the hierarchy over them.
+ *        Instances of empty meshes are left out.
+ */
+void TopLevelBVH::build(std::vector<Instance>& instances, const std::vector<Mesh>& meshes) {
+    std::vector<AABB> bounds;
+    bounds.reserve(instances.size());
+    order.clear();
+
+    for (unsigned int i = 0; i < instances.size(); i++) {
+        instances[i].updateBounds(meshes[instances[i].mesh].bounds());
+        bounds.push_back(instances[i].bounds);
+
+        if (!instances[i].bounds.isEmpty()) {
+            order.push_back(i);
+        }
+    }
+
+    bvh.build(bounds, order);
+}
+
+/**
+ * @brief TopLevelBVH::closestHit traverses the instances front to back, tracing ray through the mesh
+ *        of every instance it reaches, in the object space of the mesh.
+ *
+ * @return the collision with the closest triangle hit by ray, if any, along with the instance it belongs to
+ */
+CollisionInfo TopLevelBVH::closestHit(const Ray& ray,
+                                      const std::vector<Instance>& instances,
+                                      const std::vector<Mesh>& meshes,
+                                      const IntersectionKernel kernel,
+                                      const BVHLayout layout) const {
+    CollisionInfo closest;
+    float t = std::numeric_limits<float>::infinity();
+
+    const std::vector<BVHNode>& nodes = bvh.nodes;
+    if (nodes.empty()) {
+        return closest;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+
+    // Pending nodes along with the distance at which the ray enters them
+    BVHStackEntry stack[BVH_MAX_DEPTH + 1];
+    unsigned int stackSize = 0;
+
+    float rootT = nodes[0].bounds.intersect(ray, inverseDirection, t);
+    if (rootT == NO_INTERSECT) {
+        return closest;
+    }
+    stack[stackSize++] = {0, rootT};
+
+    while (stackSize > 0) {
+        const auto [nodeIndex, entryT] = stack[--stackSize];
+
+        // A closer hit was found after this node was pushed
+        if (entryT >= t) {
+            continue;
+        }
+
+        const BVHNode& node = nodes[nodeIndex];
+
+        if (node.isLeaf()) {
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                const Instance& instance = instances[order[i]];
+                const Mesh& mesh = meshes[instance.mesh];
+
+                CollisionInfo hit = mesh.closestHit(instance.toObject(ray), kernel, layout, t);
+
+                if (hit.isHit()) {
+                    closest = hit;
+                    closest.instance = &instance;
+                    t = hit.t;
+                }
+            }
+            continue;
+        }
+
+        unsigned int near = node.leftFirst;
+        unsigned int far = node.leftFirst + 1;
+        float nearT = nodes[near].bounds.intersect(ray, inverseDirection, t);
+        float farT = nodes[far].bounds.intersect(ray, inverseDirection, t);
+
+        if (nearT == NO_INTERSECT || (farT != NO_INTERSECT && farT < nearT)) {
+            std::swap(near, far);
+            std::swap(nearT, farT);
+        }
+
+        // Push the far child first so the near child is visited next
+        if (farT != NO_INTERSECT) {
+            stack[stackSize++] = {far, farT};
+        }
+        if (nearT != NO_INTERSECT) {
+            stack[stackSize++] = {near, nearT};
+        }
+    }
+
+    return closest;
+}
+
+/**
+ * @brief TopLevelBVH::occludingHit looks for an occluder along ray up to maxT, see BVH::occludingHit.
+ *        Stops at the first instance with an opaque hit, otherwise keeps the closest non-opaque hit.
+ */
+CollisionInfo TopLevelBVH::occludingHit(const Ray& ray,
+                                        const std::vector<Instance>& instances,
+                                        const std::vector<Mesh>& meshes,
+                                        const IntersectionKernel kernel,
+                                        const BVHLayout layout,
+                                        float maxT) const {
+    CollisionInfo closestTransparent;
+    float t = maxT;
+
+    const std::vector<BVHNode>& nodes = bvh.nodes;
+    if (nodes.empty()) {
+        return closestTransparent;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+
+    unsigned int stack[BVH_MAX_DEPTH + 1];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BVHNode& node = nodes[stack[--stackSize]];
+
+        if (node.bounds.intersect(ray, inverseDirection, t) == NO_INTERSECT) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+                const Instance& instance = instances[order[i]];
+                const Mesh& mesh = meshes[instance.mesh];
+
+                CollisionInfo hit = mesh.occludingHit(instance.toObject(ray), kernel, layout, t);
+
+                if (!hit.isHit()) {
+                    continue;
+                }
+
+                hit.instance = &instance;
+
+                if (hit.triangle->sharedMaterial->isPhong()) {
+                    return hit;
+                }
+
+                // Only keep looking for opaque triangles in front of the transparent one
+                closestTransparent = hit;
+                t = hit.t;
+            }
+            continue;
+        }
+
+        stack[stackSize++] = node.leftFirst + 1;
+        stack[stackSize++] = node.leftFirst;
+    }
+
+    return closestTransparent;
+}
+
+unsigned int TopLevelBVH::nodeCount() const {
+    return static_cast<unsigned int>(bvh.nodes.size());
+}
@@ -0,0 +1,40 @@
+#ifndef TOP_LEVEL_BVH_H
+#define TOP_LEVEL_BVH_H
+
+#include <vector>
+
+#include "BVH.h"
+#include "CollisionInfo.h"
+#include "Instance.h"
+#include "Mesh.h"
+#include "Ray.h"
+
+// Hierarchy over the instances of a scene, each leaf instance is traversed through the BVH of its mesh
+// Moving instances only requires rebuilding this level, which is proportional to the number of instances
+class TopLevelBVH {
+public:
+    void build(std::vector<Instance>& instances, const std::vector<Mesh>& meshes);
+
+    CollisionInfo closestHit(const Ray& ray,
+                             const std::vector<Instance>& instances,
+                             const std::vector<Mesh>& meshes,
+                             IntersectionKernel kernel,
+                             BVHLayout layout) const;
+
+    CollisionInfo occludingHit(const Ray& ray,
+                               const std::vector<Instance>& instances,
+                               const std::vector<Mesh>& meshes,
+                               IntersectionKernel kernel,
+                               BVHLayout layout,
+                               float maxT) const;
+
+    unsigned int nodeCount() const;
+
+private:
+    BVH bvh;
+
+    // instances in leaf order, leaves reference ranges of it
+    std::vector<unsigned int> order;
+};
+
+#endif // TOP_LEVEL_BVH_H
@@ -1,14 +1,36 @@
 #include "Triangle.h"
 
 #include "Math.h"
+#include <utility>
+#include <glm/common.hpp>
 #include <glm/ext/quaternion_geometric.hpp>
 
+WatertightRay::WatertightRay(const Ray& ray)
+    : origin(ray.origin) {
+    const glm::vec3 magnitude = glm::abs(ray.direction);
+
+    kz = magnitude.x > magnitude.y ? (magnitude.x > magnitude.z ? 0 : 2) : (magnitude.y > magnitude.z ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+
+    // Keep the winding of the triangles when looking down a negative axis
+    if (ray.direction[kz] < 0.0f) {
+        std::swap(kx, ky);
+    }
+
+    shear = glm::vec3(ray.direction[kx] / ray.direction[kz],
+                      ray.direction[ky] / ray.direction[kz],
+                      1.0f / ray.direction[kz]);
+}
+
 Triangle::Triangle()
     : vertices({}),
       normals({}),
       colors({}),
       uvs({}),
-      sharedMaterial(nullptr) {
+      sharedMaterial(nullptr),
+      edge1(0.0f),
+      edge2(0.0f) {
 }
 
 /**
@@ -16,10 +38,11 @@ Triangle::Triangle()
  *        The point o is the intersection between the Ray and the Triangle.
  *
  * @param ray the direction used to calculate the intersection
+ * @param barycentric set to the (alpha, beta, gamma) barycentric coordinates of o, if the intersection exists
  *
  * @return t > 0.0f if the intersection exists
  */
-float Triangle::intersect(const Ray& ray) const {
+float Triangle::intersect(const Ray& ray, glm::vec3& barycentric) const {
     glm::vec3 p = perspective(vertices[0]);
     glm::vec3 n = std::get<2>(planarBasis);
 
@@ -46,7 +69,7 @@ float Triangle::intersect(const Ray& ray) const {
         return NO_INTERSECT;
     }
 
-    return isInside(s + l * t) ? t : NO_INTERSECT;
+    return isInside(s + l * t, barycentric) ? t : NO_INTERSECT;
 }
 
 /**
@@ -54,11 +77,12 @@ float Triangle::intersect(const Ray& ray) const {
  *        Makes use of u & w, vectors on the plane of the triangle defined by {p, u, w, n}.
  *
  * @param o target point
+ * @param barycentric set to the (alpha, beta, gamma) barycentric coordinates of o
  *
  * @return true when the point o is inside the triangle defined by {p, q, r},
  *         false otherwise.
  */
-bool Triangle::isInside(const glm::vec3& o) const {
+bool Triangle::isInside(const glm::vec3& o, glm::vec3& barycentric) const {
     const auto& [u, w, _] = planarBasis;
     const auto& [aPcs, bPcs, cPcs] = pcsVertices;
 
@@ -72,38 +96,15 @@ bool Triangle::isInside(const glm::vec3& o) const {
      * Check if the dot products point in the direction of the left orthogonal normals
      * Left-orthogonal normals point inwards
      */
-    return isGreaterEqual(dot1, 0.0f) && isGreaterEqual(dot2, 0.0f) && isGreaterEqual(dot3, 0.0f);
-}
-
-/**
- * @param o target point
- * @param a point a on the line
- * @param b point b on the line
- *
- * @return the distance from the line (b - a) to the point o
- *         all 3 points are assumed to be on the same plane
- */
-float distance(const glm::vec3& o, const glm::vec3& a, const glm::vec3& b) {
-    glm::vec3 n = glm::normalize(leftOrthogonal(b - a));
-
-    return glm::dot(n, o) - glm::dot(n, b);
-}
-
-/**
- * @param collisionPoint that intersects the triangle
- *
- * @return the (alpha, beta, gamma) barycentric coordinates
- */
-glm::vec3 Triangle::barycentricCoordinates(const glm::vec3& collisionPoint) const {
-    const auto& [u, w, _] = planarBasis;
-    const auto& [aPcs, bPcs, cPcs] = pcsVertices;
-    glm::vec3 oPcs{glm::dot(collisionPoint, u), glm::dot(collisionPoint, w), 0.0f};
+    if (!isGreaterEqual(dot1, 0.0f) || !isGreaterEqual(dot2, 0.0f) || !isGreaterEqual(dot3, 0.0f)) {
+        return false;
+    }
 
-    float alpha = distance(oPcs, bPcs, cPcs) / distance(aPcs, bPcs, cPcs);
-    float beta = distance(oPcs, aPcs, cPcs) / distance(bPcs, aPcs, cPcs);
-    float gamma = distance(oPcs, bPcs, aPcs) / distance(cPcs, bPcs, aPcs);
+    // Each dot product is twice the area of the sub-triangle opposite to a vertex
+    // Normalised by the total, they are the barycentric coordinates
+    barycentric = glm::vec3(dot2, dot3, dot1) / (dot1 + dot2 + dot3);
 
-    return {alpha, beta, gamma};
+    return true;
 }
 
 void Triangle::computePlanarValues() {
@@ -132,8 +133,122 @@ void Triangle::computePlanarValues() {
     glm::vec3 cPcs{glm::dot(c, u), glm::dot(c, w), 0.0f};
 
     pcsVertices = std::make_tuple(aPcs, bPcs, cPcs);
+
+    edge1 = b - a;
+    edge2 = c - a;
 }
 
 glm::vec3 Triangle::weightedNormal(const glm::vec3& weights) const {
     return weights[0] * normals[0] + weights[1] * normals[1] + weights[2] * normals[2];
 }
+
+/**
+ * @brief Triangle::intersectMollerTrumbore computes t and the barycentrics in one pass over the precomputed edges,
+ *        without going through the plane of the triangle
+ *
+ * @param ray the direction used to calculate the intersection
+ * @param barycentric set to the (alpha, beta, gamma) barycentric coordinates of the hit, if any
+ *
+ * @return t > 0.0f if the intersection exists
+ */
+float Triangle::intersectMollerTrumbore(const Ray& ray, glm::vec3& barycentric) const {
+    const glm::vec3 p = glm::cross(ray.direction, edge2);
+    const float determinant = glm::dot(edge1, p);
+
+    // The ray is parallel to the plane of the triangle
+    if (determinant == 0.0f) {
+        return NO_INTERSECT;
+    }
+
+    const float inverseDeterminant = 1.0f / determinant;
+    const glm::vec3 s = ray.origin - glm::vec3(vertices[0]);
+
+    const float u = glm::dot(s, p) * inverseDeterminant;
+    if (u < 0.0f || u > 1.0f) {
+        return NO_INTERSECT;
+    }
+
+    const glm::vec3 q = glm::cross(s, edge1);
+    const float v = glm::dot(ray.direction, q) * inverseDeterminant;
+    if (v < 0.0f || u + v > 1.0f) {
+        return NO_INTERSECT;
+    }
+
+    const float t = glm::dot(edge2, q) * inverseDeterminant;
+
+    // Same threshold as the planar kernel, so both agree on self-intersections
+    if (isGreaterEqual(0.0f, t)) {
+        return NO_INTERSECT;
+    }
+
+    barycentric = glm::vec3(1.0f - u - v, u, v);
+    return t;
+}
+
+/**
+ * @brief Triangle::intersectWatertight is the watertight test of Woop, Benthin & Wald (JCGT 2013).
+ *        The vertices are sheared so that the ray runs along z, then the hit is tested with 2D edge functions.
+ *        Edge functions that round to 0 are recomputed in double, so adjacent triangles never both miss.
+ *
+ * @param ray the ray, with its constants computed once for all triangles
+ * @param barycentric set to the (alpha, beta, gamma) barycentric coordinates of the hit, if any
+ *
+ * @return t > 0.0f if the intersection exists
+ */
+float Triangle::intersectWatertight(const WatertightRay& ray, glm::vec3& barycentric) const {
+    const glm::vec3 a = glm::vec3(vertices[0]) - ray.origin;
+    const glm::vec3 b = glm::vec3(vertices[1]) - ray.origin;
+    const glm::vec3 c = glm::vec3(vertices[2]) - ray.origin;
+
+    const float ax = a[ray.kx] - ray.shear.x * a[ray.kz];
+    const float ay = a[ray.ky] - ray.shear.y * a[ray.kz];
+    const float bx = b[ray.kx] - ray.shear.x * b[ray.kz];
+    const float by = b[ray.ky] - ray.shear.y * b[ray.kz];
+    const float cx = c[ray.kx] - ray.shear.x * c[ray.kz];
+    const float cy = c[ray.ky] - ray.shear.y * c[ray.kz];
+
+    // Twice the signed areas of the sub-triangles opposite to each vertex
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+        u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+        v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+        w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+    }
+
+    // Triangles are two-sided, the hit is inside when all the areas have the same sign
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) {
+        return NO_INTERSECT;
+    }
+
+    const float determinant = u + v + w;
+    if (determinant == 0.0f) {
+        return NO_INTERSECT;
+    }
+
+    const float az = ray.shear.z * a[ray.kz];
+    const float bz = ray.shear.z * b[ray.kz];
+    const float cz = ray.shear.z * c[ray.kz];
+
+    const float t = (u * az + v * bz + w * cz) / determinant;
+
+    // Same threshold as the planar kernel, so both agree on self-intersections
+    if (isGreaterEqual(0.0f, t)) {
+        return NO_INTERSECT;
+    }
+
+    barycentric = glm::vec3(u, v, w) / determinant;
+    return t;
+}
+
+AABB Triangle::bounds() const {
+    AABB box;
+
+    for (const auto& vertex : vertices) {
+        box.extend(perspective(vertex));
+    }
+
+    return box;
+}
@@ -5,9 +5,35 @@
 #include <tuple>
 #include <glm/vec4.hpp>
 
+#include "AABB.h"
 #include "Material.h"
 #include "Ray.h"
 
+// Ray/triangle intersection algorithms, they agree up to rounding away from the edges of the triangle
+enum class IntersectionKernel {
+    // hit on the plane of the triangle, tested against the edges in the coordinates of the plane
+    Planar,
+    // Moller-Trumbore, over the precomputed edges
+    MollerTrumbore,
+    // Woop, Benthin & Wald, rays never slip between triangles sharing an edge
+    Watertight,
+    // Moller-Trumbore on packets of triangles, with the widest of SSE or AVX2 the processor supports
+    Simd
+};
+
+// Constants of a ray for the watertight test, computed once and shared by every triangle tested
+struct WatertightRay {
+    glm::vec3 origin;
+    // the axis where the direction is largest is kz, the test is done in the (kx, ky) plane
+    int kx;
+    int ky;
+    int kz;
+    // shear taking the direction to (0, 0, 1)
+    glm::vec3 shear;
+
+    explicit WatertightRay(const Ray& ray);
+};
+
 class Triangle {
 public:
     std::array<glm::vec4, 3> vertices;
@@ -22,12 +48,16 @@ public:
 
     void computePlanarValues();
 
-    float intersect(const Ray& ray) const;
+    float intersect(const Ray& ray, glm::vec3& barycentric) const;
+
+    float intersectMollerTrumbore(const Ray& ray, glm::vec3& barycentric) const;
 
-    glm::vec3 barycentricCoordinates(const glm::vec3& collisionPoint) const;
+    float intersectWatertight(const WatertightRay& ray, glm::vec3& barycentric) const;
 
     glm::vec3 weightedNormal(const glm::vec3& weights) const;
 
+    AABB bounds() const;
+
 private:
     // Orthonormal basis of the plane of the triangle [u w n]
     // u & w are pallalel to the plane - n is normal to the plane
@@ -36,7 +66,11 @@ private:
     // vertices as PCS coordinates with respect to the triangle's plane
     std::tuple<glm::vec3, glm::vec3, glm::vec3> pcsVertices;
 
-    bool isInside(const glm::vec3& o) const;
+    // edges from the first vertex to the other two
+    glm::vec3 edge1;
+    glm::vec3 edge2;
+
+    bool isInside(const glm::vec3& o, glm::vec3& barycentric) const;
 };
 
 #endif // TRIANGLE_H
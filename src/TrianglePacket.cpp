@@ -0,0 +1,330 @@
+#include "TrianglePacket.h"
+
+#include <algorithm>
+#include <glm/vec3.hpp>
+
+#include "Math.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRIANGLE_PACKET_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/**
+ * @brief intersectScalar tests the lanes one at a time, with the same operations as Triangle::intersectMollerTrumbore.
+ *        Fallback for processors without SSE, and reference for the vector versions.
+ */
+unsigned int intersectScalar(const Ray& ray, const TrianglePacket& packet, const float maxT, PacketHits& hits) {
+    const glm::vec3& o = ray.origin;
+    const glm::vec3& d = ray.direction;
+    unsigned int mask = 0;
+
+    for (unsigned int lane = 0; lane < packet.count; lane++) {
+        const glm::vec3 e1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+        const glm::vec3 e2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+
+        const glm::vec3 p(d.y * e2.z - e2.y * d.z, d.z * e2.x - e2.z * d.x, d.x * e2.y - e2.x * d.y);
+        const float determinant = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+        if (determinant == 0.0f) {
+            continue;
+        }
+        const float inverseDeterminant = 1.0f / determinant;
+
+        const glm::vec3 s(o.x - packet.vertex[0][lane], o.y - packet.vertex[1][lane], o.z - packet.vertex[2][lane]);
+        const float u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverseDeterminant;
+
+        const glm::vec3 q(s.y * e1.z - e1.y * s.z, s.z * e1.x - e1.z * s.x, s.x * e1.y - e1.x * s.y);
+        const float v = (d.x * q.x + d.y * q.y + d.z * q.z) * inverseDeterminant;
+        const float t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverseDeterminant;
+
+        // t >= EPS is the threshold of the planar kernel, see isGreaterEqual
+        if (u >= 0.0f && u <= 1.0f && v >= 0.0f && u + v <= 1.0f && t >= EPS && t < maxT) {
+            hits.t[lane] = t;
+            hits.u[lane] = u;
+            hits.v[lane] = v;
+            mask |= 1u << lane;
+        }
+    }
+
+    return mask;
+}
+
+#ifdef TRIANGLE_PACKET_X86
+
+/**
+ * @brief intersectSSEHalf tests 4 lanes of the packet from offset, returns their mask in the low 4 bits
+ */
+__attribute__((target("sse2")))
+unsigned int intersectSSEHalf(const Ray& ray, const TrianglePacket& packet, const unsigned int offset,
+                              const float maxT, PacketHits& hits) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    const __m128 dx = _mm_set1_ps(ray.direction.x);
+    const __m128 dy = _mm_set1_ps(ray.direction.y);
+    const __m128 dz = _mm_set1_ps(ray.direction.z);
+
+    const __m128 e1x = _mm_load_ps(packet.edge1[0] + offset);
+    const __m128 e1y = _mm_load_ps(packet.edge1[1] + offset);
+    const __m128 e1z = _mm_load_ps(packet.edge1[2] + offset);
+    const __m128 e2x = _mm_load_ps(packet.edge2[0] + offset);
+    const __m128 e2y = _mm_load_ps(packet.edge2[1] + offset);
+    const __m128 e2z = _mm_load_ps(packet.edge2[2] + offset);
+
+    // p = d x e2
+    const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+    const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+    const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+
+    const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    const __m128 inverseDeterminant = _mm_div_ps(one, determinant);
+
+    const __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(packet.vertex[0] + offset));
+    const __m128 sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(packet.vertex[1] + offset));
+    const __m128 sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(packet.vertex[2] + offset));
+
+    const __m128 u = _mm_mul_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+
+    // q = s x e1
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(e1y, sz));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(e1z, sx));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(e1x, sy));
+
+    const __m128 v = _mm_mul_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDeterminant);
+    const __m128 t = _mm_mul_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDeterminant);
+
+    // Ordered comparisons, lanes with a NaN are misses
+    __m128 hit = _mm_cmpneq_ps(determinant, zero);
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(u, one));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(t, _mm_set1_ps(EPS)));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_set1_ps(maxT)));
+
+    _mm_store_ps(hits.t + offset, t);
+    _mm_store_ps(hits.u + offset, u);
+    _mm_store_ps(hits.v + offset, v);
+
+    return static_cast<unsigned int>(_mm_movemask_ps(hit));
+}
+
+/**
+ * @brief intersectSSE tests the packet 4 lanes at a time, the second half only if it is in use
+ */
+unsigned int intersectSSE(const Ray& ray, const TrianglePacket& packet, const float maxT, PacketHits& hits) {
+    unsigned int mask = intersectSSEHalf(ray, packet, 0, maxT, hits);
+    if (packet.count > TRIANGLE_PACKET_WIDTH / 2) {
+        mask |= intersectSSEHalf(ray, packet, TRIANGLE_PACKET_WIDTH / 2, maxT, hits) << (TRIANGLE_PACKET_WIDTH / 2);
+    }
+
+    // Unused lanes have a null determinant, masked all the same in case the packet was filled by hand
+    return mask & ((1u << packet.count) - 1u);
+}
+
+/**
+ * @brief intersectAVX2 tests the 8 lanes of the packet at once.
+ *        FMA is left out so that the results are bit for bit those of the scalar kernel.
+ */
+__attribute__((target("avx2")))
+unsigned int intersectAVX2(const Ray& ray, const TrianglePacket& packet, const float maxT, PacketHits& hits) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    const __m256 dx = _mm256_set1_ps(ray.direction.x);
+    const __m256 dy = _mm256_set1_ps(ray.direction.y);
+    const __m256 dz = _mm256_set1_ps(ray.direction.z);
+
+    const __m256 e1x = _mm256_load_ps(packet.edge1[0]);
+    const __m256 e1y = _mm256_load_ps(packet.edge1[1]);
+    const __m256 e1z = _mm256_load_ps(packet.edge1[2]);
+    const __m256 e2x = _mm256_load_ps(packet.edge2[0]);
+    const __m256 e2y = _mm256_load_ps(packet.edge2[1]);
+    const __m256 e2z = _mm256_load_ps(packet.edge2[2]);
+
+    // p = d x e2
+    const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+    const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+    const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+
+    const __m256 determinant = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+    const __m256 inverseDeterminant = _mm256_div_ps(one, determinant);
+
+    const __m256 sx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(packet.vertex[0]));
+    const __m256 sy = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(packet.vertex[1]));
+    const __m256 sz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(packet.vertex[2]));
+
+    const __m256 u = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)),
+        inverseDeterminant);
+
+    // q = s x e1
+    const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(e1y, sz));
+    const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(e1z, sx));
+    const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(e1x, sy));
+
+    const __m256 v = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)),
+        inverseDeterminant);
+    const __m256 t = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)),
+        inverseDeterminant);
+
+    // Ordered comparisons, lanes with a NaN are misses
+    __m256 hit = _mm256_cmp_ps(determinant, zero, _CMP_NEQ_OQ);
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_set1_ps(EPS), _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, _mm256_set1_ps(maxT), _CMP_LT_OQ));
+
+    _mm256_store_ps(hits.t, t);
+    _mm256_store_ps(hits.u, u);
+    _mm256_store_ps(hits.v, v);
+
+    return static_cast<unsigned int>(_mm256_movemask_ps(hit)) & ((1u << packet.count) - 1u);
+}
+
+#endif // TRIANGLE_PACKET_X86
+
+} // namespace
+
+/**
+ * @brief PackedTriangles::build packs the triangles leaf by leaf, every leaf starts a new packet
+ *
+ * @param triangles in the order produced by bvh
+ * @param bvh built over triangles
+ */
+void PackedTriangles::build(const std::vector<Triangle>& triangles, const BVH& bvh) {
+    packets.clear();
+    nodePackets.assign(bvh.nodes.size(), 0);
+
+    unsigned int total = 0;
+    for (const BVHNode& node : bvh.nodes) {
+        if (node.isLeaf()) {
+            total += packetCount(node.count);
+        }
+    }
+    packets.reserve(total);
+
+    for (unsigned int i = 0; i < bvh.nodes.size(); i++) {
+        const BVHNode& node = bvh.nodes[i];
+
+        if (node.isLeaf()) {
+            nodePackets[i] = static_cast<unsigned int>(packets.size());
+            pack(triangles, node.leftFirst, node.count);
+        }
+    }
+}
+
+/**
+ * @brief PackedTriangles::build packs all the triangles in order, without a hierarchy
+ */
+void PackedTriangles::build(const std::vector<Triangle>& triangles) {
+    packets.clear();
+    nodePackets.clear();
+
+    packets.reserve(packetCount(static_cast<unsigned int>(triangles.size())));
+    pack(triangles, 0, static_cast<unsigned int>(triangles.size()));
+}
+
+void PackedTriangles::pack(const std::vector<Triangle>& triangles, const unsigned int first, const unsigned int count) {
+    for (unsigned int start = first; start < first + count; start += TRIANGLE_PACKET_WIDTH) {
+        TrianglePacket packet{};
+        packet.first = start;
+        packet.count = std::min<unsigned int>(TRIANGLE_PACKET_WIDTH, first + count - start);
+
+        for (unsigned int lane = 0; lane < packet.count; lane++) {
+            const Triangle& triangle = triangles[start + lane];
+
+            // Same edges as Triangle::computePlanarValues
+            const glm::vec3 a = triangle.vertices[0];
+            const glm::vec3 edge1 = glm::vec3(triangle.vertices[1]) - a;
+            const glm::vec3 edge2 = glm::vec3(triangle.vertices[2]) - a;
+
+            for (int axis = 0; axis < 3; axis++) {
+                packet.vertex[axis][lane] = a[axis];
+                packet.edge1[axis][lane] = edge1[axis];
+                packet.edge2[axis][lane] = edge2[axis];
+            }
+        }
+
+        packets.push_back(packet);
+    }
+}
+
+/**
+ * @return the number of packets needed to hold that many consecutive triangles
+ */
+unsigned int PackedTriangles::packetCount(const unsigned int triangles) {
+    return (triangles + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH;
+}
+
+/**
+ * @brief PackedTriangles::isSupported asks CPUID whether the processor runs isa
+ */
+bool PackedTriangles::isSupported(const PacketIsa isa) {
+    switch (isa) {
+#ifdef TRIANGLE_PACKET_X86
+        case PacketIsa::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case PacketIsa::SSE:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+#else
+        case PacketIsa::AVX2:
+        case PacketIsa::SSE:
+            return false;
+#endif
+        case PacketIsa::Scalar:
+        default:
+            return true;
+    }
+}
+
+/**
+ * @return the widest instruction set supported by the processor, detected once
+ */
+PacketIsa PackedTriangles::bestIsa() {
+    static const PacketIsa best = isSupported(PacketIsa::AVX2) ? PacketIsa::AVX2
+                                  : isSupported(PacketIsa::SSE) ? PacketIsa::SSE
+                                  : PacketIsa::Scalar;
+    return best;
+}
+
+/**
+ * @return the packet test implemented with isa, which must be supported
+ */
+PacketIntersector PackedTriangles::intersector(const PacketIsa isa) {
+    switch (isa) {
+#ifdef TRIANGLE_PACKET_X86
+        case PacketIsa::AVX2:
+            return intersectAVX2;
+        case PacketIsa::SSE:
+            return intersectSSE;
+#endif
+        case PacketIsa::Scalar:
+        default:
+            return intersectScalar;
+    }
+}
+
+const char* PackedTriangles::isaName(const PacketIsa isa) {
+    switch (isa) {
+        case PacketIsa::AVX2:
+            return "avx2";
+        case PacketIsa::SSE:
+            return "sse";
+        case PacketIsa::Scalar:
+        default:
+            return "scalar";
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef TRIANGLE_PACKET_H
+#define TRIANGLE_PACKET_H
+
+#include <vector>
+
+#include "BVH.h"
+#include "Ray.h"
+#include "Triangle.h"
+
+// Lanes of a packet, the width of an AVX2 register, SSE tests a packet as two halves
+#define TRIANGLE_PACKET_WIDTH 8
+
+// Instruction sets the packet test is implemented with, picked at runtime from CPUID
+enum class PacketIsa {
+    Scalar,
+    SSE,
+    AVX2
+};
+
+// Up to 8 consecutive triangles, stored component by component so that each lane is one triangle
+// Only what the Moller-Trumbore test needs is kept, unused lanes have null edges and are never hit
+struct alignas(32) TrianglePacket {
+    float vertex[3][TRIANGLE_PACKET_WIDTH];
+    float edge1[3][TRIANGLE_PACKET_WIDTH];
+    float edge2[3][TRIANGLE_PACKET_WIDTH];
+
+    // index of the triangle in the first lane, the others follow
+    unsigned int first;
+    // lanes in use
+    unsigned int count;
+};
+
+// Result of testing a ray against every lane of a packet
+// Lanes hit have their bit set in the returned mask, their t, u and v are left in the arrays
+struct alignas(32) PacketHits {
+    float t[TRIANGLE_PACKET_WIDTH];
+    float u[TRIANGLE_PACKET_WIDTH];
+    float v[TRIANGLE_PACKET_WIDTH];
+};
+
+// Tests a ray against a packet, hits must be in (0, maxT), returns the mask of the lanes hit
+typedef unsigned int (*PacketIntersector)(const Ray& ray, const TrianglePacket& packet, float maxT, PacketHits& hits);
+
+// Structure-of-arrays copy of the triangles of a mesh, packed leaf by leaf so that a leaf is a run of packets
+class PackedTriangles {
+public:
+    std::vector<TrianglePacket> packets;
+
+    // first packet of every node of the hierarchy, only meaningful for leaves
+    std::vector<unsigned int> nodePackets;
+
+    void build(const std::vector<Triangle>& triangles, const BVH& bvh);
+
+    void build(const std::vector<Triangle>& triangles);
+
+    static unsigned int packetCount(unsigned int triangles);
+
+    static bool isSupported(PacketIsa isa);
+
+    static PacketIsa bestIsa();
+
+    static PacketIntersector intersector(PacketIsa isa);
+
+    static const char* isaName(PacketIsa isa);
+
+private:
+    void pack(const std::vector<Triangle>& triangles, unsigned int first, unsigned int count);
+};
+
+#endif // TRIANGLE_PACKET_H
@@ -0,0 +1,421 @@
+#include "WideBVH.h"
+
+#include <limits>
+
+#include "BVHLeaves.h"
+#include "Math.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WIDE_BVH_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Slab test of a ray against all the children of a node, sets the entry t of every child and returns the mask
+// of the children hit in front of tMax, with the same semantics as AABB::intersect
+template<unsigned int Width>
+using ChildTest = unsigned int (*)(const WideBVHNode<Width>& node,
+                                   const glm::vec3& origin,
+                                   const glm::vec3& inverseDirection,
+                                   float tMax,
+                                   float* entries);
+
+/**
+ * @brief childHitsScalar tests the children one at a time, fallback for processors without SSE
+ */
+template<unsigned int Width>
+unsigned int childHitsScalar(const WideBVHNode<Width>& node,
+                             const glm::vec3& origin,
+                             const glm::vec3& inverseDirection,
+                             const float tMax,
+                             float* entries) {
+    unsigned int mask = 0;
+
+    for (unsigned int child = 0; child < Width; child++) {
+        const AABB box({node.bounds[0][child], node.bounds[1][child], node.bounds[2][child]},
+                       {node.bounds[3][child], node.bounds[4][child], node.bounds[5][child]});
+        const float entry = box.intersect(Ray(origin, glm::vec3(0.0f)), inverseDirection, tMax);
+
+        if (entry != NO_INTERSECT) {
+            entries[child] = entry;
+            mask |= 1u << child;
+        }
+    }
+
+    return mask;
+}
+
+#ifdef WIDE_BVH_X86
+
+/**
+ * @brief childHitsSSE tests the children 4 at a time
+ */
+template<unsigned int Width>
+__attribute__((target("sse2")))
+unsigned int childHitsSSE(const WideBVHNode<Width>& node,
+                          const glm::vec3& origin,
+                          const glm::vec3& inverseDirection,
+                          const float tMax,
+                          float* entries) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 minusInfinity = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    unsigned int mask = 0;
+
+    for (unsigned int offset = 0; offset < Width; offset += 4) {
+        __m128 tNear = minusInfinity;
+        __m128 tFar = infinity;
+
+        for (int axis = 0; axis < 3; axis++) {
+            const __m128 o = _mm_set1_ps(origin[axis]);
+            const __m128 inverse = _mm_set1_ps(inverseDirection[axis]);
+            const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[axis] + offset), o), inverse);
+            const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[axis + 3] + offset), o), inverse);
+
+            // The second operand is returned on NaN, which discards NaNs from 0 * inf like AABB::intersect
+            tNear = _mm_max_ps(_mm_min_ps(t1, t2), tNear);
+            tFar = _mm_min_ps(_mm_max_ps(t1, t2), tFar);
+        }
+
+        __m128 hit = _mm_cmpge_ps(tFar, tNear);
+        hit = _mm_and_ps(hit, _mm_cmpgt_ps(tFar, zero));
+        hit = _mm_and_ps(hit, _mm_cmplt_ps(tNear, _mm_set1_ps(tMax)));
+
+        _mm_store_ps(entries + offset, _mm_max_ps(tNear, zero));
+        mask |= static_cast<unsigned int>(_mm_movemask_ps(hit)) << offset;
+    }
+
+    return mask;
+}
+
+/**
+ * @brief childHitsAVX2 tests the 8 children at once
+ */
+__attribute__((target("avx2")))
+unsigned int childHitsAVX2(const WideBVHNode<8>& node,
+                           const glm::vec3& origin,
+                           const glm::vec3& inverseDirection,
+                           const float tMax,
+                           float* entries) {
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 tNear = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 tFar = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+
+    for (int axis = 0; axis < 3; axis++) {
+        const __m256 o = _mm256_set1_ps(origin[axis]);
+        const __m256 inverse = _mm256_set1_ps(inverseDirection[axis]);
+        const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[axis]), o), inverse);
+        const __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[axis + 3]), o), inverse);
+
+        // The second operand is returned on NaN, which discards NaNs from 0 * inf like AABB::intersect
+        tNear = _mm256_max_ps(_mm256_min_ps(t1, t2), tNear);
+        tFar = _mm256_min_ps(_mm256_max_ps(t1, t2), tFar);
+    }
+
+    __m256 hit = _mm256_cmp_ps(tFar, tNear, _CMP_GE_OQ);
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(tFar, zero, _CMP_GT_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(tNear, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+    _mm256_store_ps(entries, _mm256_max_ps(tNear, zero));
+    return static_cast<unsigned int>(_mm256_movemask_ps(hit));
+}
+
+#endif // WIDE_BVH_X86
+
+/**
+ * @return the widest child test the processor supports, detected once
+ */
+template<unsigned int Width>
+ChildTest<Width> childTest() {
+#ifdef WIDE_BVH_X86
+    if constexpr (Width == 8) {
+        if (PackedTriangles::isSupported(PacketIsa::AVX2)) {
+            return childHitsAVX2;
+        }
+    }
+    if (PackedTriangles::isSupported(PacketIsa::SSE)) {
+        return childHitsSSE<Width>;
+    }
+#endif
+    return childHitsScalar<Width>;
+}
+
+/**
+ * @brief pushNearestFirst pushes the children hit so that the nearest of them is on top of the stack
+ *
+ * @param mask of the children hit
+ * @param entries distance at which the ray enters each child
+ */
+template<unsigned int Width>
+void pushNearestFirst(const WideBVHNode<Width>& node, unsigned int mask, const float* entries,
+                      BVHStackEntry* stack, unsigned int& stackSize) {
+    const unsigned int first = stackSize;
+
+    // Insertion sort by decreasing distance, on at most Width children
+    for (; mask != 0; mask &= mask - 1) {
+        const unsigned int child = __builtin_ctz(mask);
+        const BVHStackEntry entry{node.children[child], entries[child]};
+
+        unsigned int i = stackSize++;
+        for (; i > first && stack[i - 1].entryT < entry.entryT; i--) {
+            stack[i] = stack[i - 1];
+        }
+        stack[i] = entry;
+    }
+}
+
+} // namespace
+
+/**
+ * @brief WideBVH::collapse builds the wide hierarchy from the binary one, which it keeps the leaves of
+ */
+template<unsigned int Width>
+void WideBVH<Width>::collapse(const BVH& bvh) {
+    nodes.clear();
+
+    if (bvh.nodes.empty()) {
+        return;
+    }
+
+    collapseNode(bvh, 0);
+    nodes.shrink_to_fit();
+}
+
+/**
+ * @brief WideBVH::collapseNode gathers the descendants of a binary node into the children of a wide node,
+ *        opening the largest interior child until there are Width of them or only leaves are left.
+ *        Interior children are collapsed in turn.
+ *
+ * @return the index of the wide node
+ */
+template<unsigned int Width>
+unsigned int WideBVH<Width>::collapseNode(const BVH& bvh, const unsigned int binaryIndex) {
+    unsigned int children[Width];
+    unsigned int count = 0;
+
+    const BVHNode& binaryNode = bvh.nodes[binaryIndex];
+    if (binaryNode.isLeaf()) {
+        // Only happens at the root
+        children[count++] = binaryIndex;
+    } else {
+        children[count++] = binaryNode.leftFirst;
+        children[count++] = binaryNode.leftFirst + 1;
+    }
+
+    while (count < Width) {
+        int largest = -1;
+        float largestArea = -1.0f;
+
+        for (unsigned int i = 0; i < count; i++) {
+            const BVHNode& child = bvh.nodes[children[i]];
+            if (!child.isLeaf() && child.bounds.surfaceArea() > largestArea) {
+                largest = static_cast<int>(i);
+                largestArea = child.bounds.surfaceArea();
+            }
+        }
+
+        if (largest < 0) {
+            break;
+        }
+
+        const unsigned int opened = bvh.nodes[children[largest]].leftFirst;
+        children[largest] = opened;
+        children[count++] = opened + 1;
+    }
+
+    // Filled in a copy, collapsing the children grows nodes
+    const auto index = static_cast<unsigned int>(nodes.size());
+    nodes.emplace_back();
+
+    WideBVHNode<Width> node{};
+    for (unsigned int i = 0; i < Width; i++) {
+        for (auto& component : node.bounds) {
+            component[i] = std::numeric_limits<float>::infinity();
+        }
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        const BVHNode& child = bvh.nodes[children[i]];
+
+        for (int axis = 0; axis < 3; axis++) {
+            node.bounds[axis][i] = child.bounds.min[axis];
+            node.bounds[axis + 3][i] = child.bounds.max[axis];
+        }
+
+        node.children[i] = child.isLeaf() ? children[i] | WIDE_BVH_LEAF : collapseNode(bvh, children[i]);
+    }
+
+    nodes[index] = node;
+    return index;
+}
+
+/**
+ * @brief WideBVH::closestHitWith traverses the hierarchy, visiting the children of every node nearest first
+ *        and pruning those further than the closest hit
+ *
+ * @param bvh the binary hierarchy this one was collapsed from, holding the leaves
+ * @param leaves tests ray against the triangles of a leaf, see TriangleLeaves::closest
+ * @param statistics counts the nodes and triangles visited, if not null
+ */
+template<unsigned int Width>
+template<typename Leaves>
+CollisionInfo WideBVH<Width>::closestHitWith(const Ray& ray, const BVH& bvh, float maxT, const Leaves& leaves,
+                                             TraversalStatistics* statistics) const {
+    CollisionInfo closest;
+    float t = maxT;
+
+    if (nodes.empty()) {
+        return closest;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+    static const ChildTest<Width> childHits = childTest<Width>();
+
+    // The root has no parent node holding its bounds
+    const float rootT = bvh.nodes[0].bounds.intersect(ray, inverseDirection, t);
+    if (rootT == NO_INTERSECT) {
+        return closest;
+    }
+
+    // Every level adds at most Width - 1 entries to the stack
+    BVHStackEntry stack[BVH_MAX_DEPTH * (Width - 1) + 1];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = {0, rootT};
+
+    alignas(32) float entries[Width];
+
+    while (stackSize > 0) {
+        const auto [child, entryT] = stack[--stackSize];
+
+        // A closer hit was found after this child was pushed
+        if (entryT >= t) {
+            continue;
+        }
+
+        if (child & WIDE_BVH_LEAF) {
+            const unsigned int leaf = child & ~WIDE_BVH_LEAF;
+            const BVHNode& node = bvh.nodes[leaf];
+
+            if (statistics != nullptr) {
+                statistics->triangles += node.count;
+            }
+            leaves.closest(leaf, node, t, closest);
+            continue;
+        }
+
+        if (statistics != nullptr) {
+            statistics->nodes++;
+        }
+
+        const WideBVHNode<Width>& node = nodes[child];
+        const unsigned int mask = childHits(node, ray.origin, inverseDirection, t, entries);
+        pushNearestFirst(node, mask, entries, stack, stackSize);
+    }
+
+    return closest;
+}
+
+/**
+ * @brief WideBVH::closestHit finds the closest triangle hit by ray with the given intersection kernel,
+ *        see closestHitWith
+ */
+template<unsigned int Width>
+CollisionInfo WideBVH<Width>::closestHit(const Ray& ray,
+                                         const BVH& bvh,
+                                         const std::vector<Triangle>& triangles,
+                                         const PackedTriangles& packed,
+                                         const IntersectionKernel kernel,
+                                         float maxT,
+                                         TraversalStatistics* statistics) const {
+    return visitLeaves(ray, triangles, packed, kernel, [&](const auto& leaves) {
+        return closestHitWith(ray, bvh, maxT, leaves, statistics);
+    });
+}
+
+/**
+ * @brief WideBVH::occludingHitWith looks for an occluder along ray up to maxT, nearest children first,
+ *        see BVH::occludingHitWith
+ */
+template<unsigned int Width>
+template<typename Leaves>
+CollisionInfo WideBVH<Width>::occludingHitWith(const Ray& ray, const BVH& bvh, float maxT, const Leaves& leaves,
+                                               TraversalStatistics* statistics) const {
+    CollisionInfo closestTransparent;
+    float t = maxT;
+
+    if (nodes.empty()) {
+        return closestTransparent;
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / ray.direction;
+    static const ChildTest<Width> childHits = childTest<Width>();
+
+    // The root has no parent node holding its bounds
+    const float rootT = bvh.nodes[0].bounds.intersect(ray, inverseDirection, t);
+    if (rootT == NO_INTERSECT) {
+        return closestTransparent;
+    }
+
+    BVHStackEntry stack[BVH_MAX_DEPTH * (Width - 1) + 1];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = {0, rootT};
+
+    alignas(32) float entries[Width];
+
+    while (stackSize > 0) {
+        const auto [child, entryT] = stack[--stackSize];
+
+        // A non-opaque hit was found in front of this child after it was pushed
+        if (entryT >= t) {
+            continue;
+        }
+
+        if (child & WIDE_BVH_LEAF) {
+            const unsigned int leaf = child & ~WIDE_BVH_LEAF;
+            const BVHNode& node = bvh.nodes[leaf];
+
+            if (statistics != nullptr) {
+                statistics->triangles += node.count;
+            }
+            if (leaves.occluding(leaf, node, t, closestTransparent)) {
+                return closestTransparent;
+            }
+            continue;
+        }
+
+        if (statistics != nullptr) {
+            statistics->nodes++;
+        }
+
+        const WideBVHNode<Width>& node = nodes[child];
+        const unsigned int mask = childHits(node, ray.origin, inverseDirection, t, entries);
+        pushNearestFirst(node, mask, entries, stack, stackSize);
+    }
+
+    return closestTransparent;
+}
+
+/**
+ * @brief WideBVH::occludingHit any-hit query with the given intersection kernel, see occludingHitWith
+ */
+template<unsigned int Width>
+CollisionInfo WideBVH<Width>::occludingHit(const Ray& ray,
+                                           const BVH& bvh,
+                                           const std::vector<Triangle>& triangles,
+                                           const PackedTriangles& packed,
+                                           const IntersectionKernel kernel,
+                                           float maxT,
+                                           TraversalStatistics* statistics) const {
+    return visitLeaves(ray, triangles, packed, kernel, [&](const auto& leaves) {
+        return occludingHitWith(ray, bvh, maxT, leaves, statistics);
+    });
+}
+
+template<unsigned int Width>
+std::size_t WideBVH<Width>::bytes() const {
+    return nodes.size() * sizeof(WideBVHNode<Width>);
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
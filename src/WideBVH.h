@@ -0,0 +1,66 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include <cstddef>
+#include <vector>
+
+#include "BVH.h"
+#include "CollisionInfo.h"
+#include "Ray.h"
+#include "Triangle.h"
+#include "TrianglePacket.h"
+
+// Set on the children of a wide node that are leaves of the binary BVH
+#define WIDE_BVH_LEAF 0x80000000u
+
+// Node of a wide BVH, the bounds of all its children are stored component by component
+// so that a ray is tested against all of them with one SIMD slab test
+// Unused children have bounds at +infinity, which no ray enters
+template<unsigned int Width>
+struct alignas(32) WideBVHNode {
+    // min x, min y, min z, max x, max y, max z of every child
+    float bounds[6][Width];
+    // interior children: index of the wide node, leaves: index of the leaf in the binary BVH | WIDE_BVH_LEAF
+    unsigned int children[Width];
+};
+
+// Bounding Volume Hierarchy with up to Width children per node, collapsed from a binary BVH
+// Leaves are those of the binary BVH, and so are the order of the triangles and their packets
+template<unsigned int Width>
+class WideBVH {
+public:
+    std::vector<WideBVHNode<Width>> nodes;
+
+    void collapse(const BVH& bvh);
+
+    CollisionInfo closestHit(const Ray& ray,
+                             const BVH& bvh,
+                             const std::vector<Triangle>& triangles,
+                             const PackedTriangles& packed,
+                             IntersectionKernel kernel,
+                             float maxT,
+                             TraversalStatistics* statistics = nullptr) const;
+
+    CollisionInfo occludingHit(const Ray& ray,
+                               const BVH& bvh,
+                               const std::vector<Triangle>& triangles,
+                               const PackedTriangles& packed,
+                               IntersectionKernel kernel,
+                               float maxT,
+                               TraversalStatistics* statistics = nullptr) const;
+
+    std::size_t bytes() const;
+
+private:
+    unsigned int collapseNode(const BVH& bvh, unsigned int binaryIndex);
+
+    template<typename Leaves>
+    CollisionInfo closestHitWith(const Ray& ray, const BVH& bvh, float maxT, const Leaves& leaves,
+                                 TraversalStatistics* statistics) const;
+
+    template<typename Leaves>
+    CollisionInfo occludingHitWith(const Ray& ray, const BVH& bvh, float maxT, const Leaves& leaves,
+                                   TraversalStatistics* statistics) const;
+};
+
+#endif // WIDE_BVH_H
@@ -0,0 +1,1770 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/geometric.hpp>
+
+#include "BVHCache.h"
+#include "Mesh.h"
+#include "Raytracer.h"
+#include "RenderParameters.h"
+#include "RGBAImage.h"
+#include "Sampler.h"
+#include "ThreeDModel.h"
+#include "Triangle.h"
+#include "TrianglePacket.h"
+
+// Rays cast by --kernel-check, every triangle is tested against each of them
+#define KERNEL_CHECK_RAYS 20000
+// Kernels may disagree on rays that would hit the other side of an edge if moved sideways by this much,
+// relative to the size of the scene
+#define KERNEL_CHECK_EDGE_TOLERANCE 1e-5f
+// or on hits this close to the origin of the ray, where the t > 0 threshold differs
+#define KERNEL_CHECK_NEAR_T 1e-3f
+// Rays cast by --packet-benchmark, every triangle is tested against each of them
+#define PACKET_BENCHMARK_RAYS 20000
+// Rays traced by --bvh-benchmark through every layout
+#define BVH_BENCHMARK_RAYS 200000
+// Closest distances found by two layouts may differ by this much, relative to the distance
+#define BVH_BENCHMARK_TOLERANCE 1e-4f
+// Rays traced by --build-benchmark through the hierarchy of every builder
+#define BUILD_BENCHMARK_RAYS 100000
+// Camera rays traced by --hit-benchmark, rounded up to whole images
+#define HIT_BENCHMARK_RAYS 2000000
+// Progressive passes rendered by --variance-benchmark for every sampling strategy, unless --passes is given
+#define VARIANCE_BENCHMARK_PASSES 16
+// Most samples per pixel rendered by --sampler-benchmark with every sampler, unless --passes is given
+#define SAMPLER_BENCHMARK_SAMPLES 32
+// Samples per pixel of its reference image, as a multiple of the most samples compared
+#define SAMPLER_BENCHMARK_REFERENCE_FACTOR 16
+// Samples per pixel of the reference image of --adaptive-benchmark
+#define ADAPTIVE_BENCHMARK_REFERENCE_SAMPLES 256
+// Largest threshold compared by --adaptive-benchmark unless --adaptive is given, halved ADAPTIVE_BENCHMARK_THRESHOLDS - 1 times
+#define ADAPTIVE_BENCHMARK_THRESHOLD 0.4f
+#define ADAPTIVE_BENCHMARK_THRESHOLDS 4
+
+/*
+ * Headless batch renderer
+ * Renders an .obj/.mtl pair into a .ppm image without any window or OpenGL context
+ */
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " geometry material output.ppm [options]" << std::endl
+            << std::endl
+            << "Options:" << std::endl
+            << "  --width <pixels>       image width (default 800)" << std::endl
+            << "  --height <pixels>      image height (default 600)" << std::endl
+            << "  --interpolation        render interpolated normals" << std::endl
+            << "  --shadows              enable shadows" << std::endl
+            << "  --fresnel              enable Fresnel reflectance" << std::endl
+            << "  --monte-carlo          enable anti-aliasing and Monte Carlo indirect lighting" << std::endl
+            << "  --area-lights          enable soft shadows from area lights" << std::endl
+            << "  --orthographic         use an orthographic camera" << std::endl
+            << "  --seed <n>             seed of the sample generators (default 0)" << std::endl
+            << "  --mc-samples <n>       indirect lighting samples per shading point (default " << N_MC_SAMPLES << ")"
+            << std::endl
+            << "  --hemisphere <name>    distribution of the indirect lighting samples: cosine (default) or uniform"
+            << std::endl
+            << "  --sampler <name>       sample sequence: independent (default), stratified, sobol or rank1" << std::endl
+            << "  --adaptive <t>         sample every pixel until the 95% confidence interval of its luminance is within"
+            << " t of its mean, e.g. 0.1 (default 0, the same samples for every pixel)" << std::endl
+            << "  --adaptive-samples <min> <max>" << std::endl
+            << "                         samples of a pixel with adaptive sampling (default " << ADAPTIVE_MIN_SAMPLES
+            << " to " << ADAPTIVE_MAX_SAMPLES << ")" << std::endl
+            << "  --sample-heatmap <ppm> also write the samples of every pixel, black for none to red for the most"
+            << std::endl
+            << "  --integrator <name>    whitted (default), recursive, or path, one iterative path per sample"
+            << std::endl
+            << "  --bounces <n>          rays traced along a path at most (default " << N_BOUNCES << ")" << std::endl
+            << "  --roulette <t>         throughput under which Monte Carlo paths may be ended by Russian roulette,"
+            << " 0 to never end them early (default " << TERMINATION_FACTOR << ")" << std::endl
+            << "  --kernel <name>        ray/triangle test: planar (default), moller-trumbore, watertight or simd"
+            << std::endl
+            << "  --bvh <layout>         hierarchy of the meshes: binary, bvh4 or bvh8 (default)" << std::endl
+            << "  --builder <name>       algorithm the hierarchies are built with: sah (default), lbvh or sbvh"
+            << std::endl
+            << "  --threads <n>          number of render threads (default " << N_THREADS << ")" << std::endl
+            << "  --tile-size <pixels>   side of the square tiles handed out to the threads (default " << TILE_SIZE << ")"
+            << std::endl
+            << "  --scaling              render with 1, 2, 4, ... up to --threads threads and report the speed-up"
+            << std::endl
+            << "  --passes <n>           render progressively, one sample per pixel per pass, up to n passes" << std::endl
+            << "  --time-budget <ms>     render progressively until the time budget is spent" << std::endl
+            << "  --loader-benchmark     compare the stream, memory-mapped and cached .obj readers instead of rendering"
+            << std::endl
+            << "  --instances <object> <count> <dx> <dy> <dz>" << std::endl
+            << "                         add count copies of the object-th model, the k-th one offset by k * (dx, dy, dz)"
+            << std::endl
+            << "  --kernel-check         compare every ray/triangle kernel with the planar one instead of rendering"
+            << std::endl
+            << "  --packet-benchmark     compare the scalar, SSE and AVX2 packet tests with one triangle at a time instead of rendering"
+            << std::endl
+            << "  --bvh-benchmark        compare the traversal speed and statistics of every BVH layout instead of rendering"
+            << std::endl
+            << "  --build-benchmark      compare the build time of every BVH builder, on one and all threads, instead of rendering"
+            << std::endl
+            << "  --hit-benchmark        time the closest hit and surface element of every camera ray instead of rendering"
+            << std::endl
+            << "  --integrator-benchmark compare the rays per pixel and render time of every integrator instead of rendering"
+            << std::endl
+            << "  --sampler-benchmark    compare the error of every sampler to a reference image instead of rendering"
+            << std::endl
+            << "  --adaptive-benchmark   compare the error and render time of adaptive and fixed sampling instead of rendering"
+            << std::endl
+            << "  --variance-benchmark   compare the variance of every indirect lighting sampling instead of rendering"
+            << std::endl
+            << "  --bvh-cache <dir>      directory the hierarchies of the meshes are cached in (default: next to the .obj file)"
+            << std::endl
+            << "  --no-cache             parse the .obj file and build the hierarchies even if they are cached,"
+            << " and leave the caches alone, not with --bvh-cache" << std::endl;
+}
+
+// Copies of a model laid out in a row, see --instances
+struct InstanceRow {
+    unsigned int object;
+    unsigned int count;
+    glm::vec3 offset;
+};
+
+/**
+ * @brief parseNumber reads a whole option value as a number of the type of value.
+ *        Unlike std::stoi and its siblings, it does not throw on text and does not ignore trailing characters.
+ *
+ * @return false if text is not such a number, value is then left untouched
+ */
+template <typename T>
+bool parseNumber(const char* text, T& value) {
+    const char* end = text + std::strlen(text);
+    T parsed;
+    auto [last, error] = std::from_chars(text, end, parsed);
+
+    if (error != std::errc() || last != end) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+/**
+ * @brief writeImage writes image as a PPM, top row first
+ *        The frame buffer is stored bottom row first, as expected by glDrawPixels
+ */
+bool writeImage(const RGBAImage& image, const std::string& path) {
+    std::ofstream outputFile(path);
+
+    if (!outputFile.good()) {
+        return false;
+    }
+
+    RGBAImage flipped;
+    flipped.resize(image.width, image.height);
+    for (int row = 0; row < image.height; row++) {
+        for (int col = 0; col < image.width; col++) {
+            flipped[row][col] = image[image.height - 1 - row][col];
+        }
+    }
+
+    flipped.writePPM(outputFile);
+    return outputFile.good();
+}
+
+/**
+ * @return true if both lists hold the same geometry, faces and materials
+ */
+bool sameModels(const std::vector<ThreeDModel>& a, const std::vector<ThreeDModel>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    // Bitwise, so that the NaNs of degenerate normals compare equal
+    auto sameVectors = [](const std::vector<glm::vec3>& x, const std::vector<glm::vec3>& y, int components) {
+        return std::equal(x.begin(), x.end(), y.begin(), y.end(), [components](const glm::vec3& u, const glm::vec3& v) {
+            return std::memcmp(&u, &v, components * sizeof(float)) == 0;
+        });
+    };
+
+    for (unsigned int i = 0; i < a.size(); i++) {
+        // Materials are read separately for each model list, so compare them by name
+        if (a[i].material->name != b[i].material->name
+            || !sameVectors(a[i].pool->vertices, b[i].pool->vertices, 3)
+            || !sameVectors(a[i].pool->normals, b[i].pool->normals, 3)
+            // Texture coordinates only have 2 meaningful components
+            || !sameVectors(a[i].pool->textureCoords, b[i].pool->textureCoords, 2)
+            || a[i].faceVertices != b[i].faceVertices
+            || a[i].faceNormals != b[i].faceNormals
+            || a[i].faceTexCoords != b[i].faceTexCoords
+            || a[i].faceStarts != b[i].faceStarts) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief benchmarkLoader reads the geometry with the stream reader, the memory-mapped parser and the binary cache,
+ *        checks that they produce the same models and reports the best throughput of each over a few runs.
+ *        The cache is written by the first cached read if needed, which is not timed.
+ *
+ * @return true if all readers agree
+ */
+bool benchmarkLoader(const char* geometryPath, const char* materialPath) {
+    const int repetitions = 5;
+
+    std::ifstream sizeFile(geometryPath, std::ios::binary | std::ios::ate);
+    const double megabytes = static_cast<double>(sizeFile.tellg()) / 1.0e6;
+
+    std::vector<ThreeDModel> streamModels;
+    std::vector<ThreeDModel> mappedModels;
+    std::vector<ThreeDModel> cachedModels;
+    double streamMilliseconds = std::numeric_limits<double>::infinity();
+    double mappedMilliseconds = std::numeric_limits<double>::infinity();
+    double cachedMilliseconds = std::numeric_limits<double>::infinity();
+
+    for (int r = 0; r < repetitions; r++) {
+        std::ifstream geometryFile(geometryPath);
+        std::ifstream materialFile(materialPath);
+
+        auto start = std::chrono::steady_clock::now();
+        streamModels = ThreeDModel::readObjectStreamMaterial(geometryFile, materialFile);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        streamMilliseconds = std::min(streamMilliseconds, elapsed.count());
+    }
+
+    for (int r = 0; r < repetitions; r++) {
+        std::ifstream materialFile(materialPath);
+
+        auto start = std::chrono::steady_clock::now();
+        mappedModels = ThreeDModel::readObjectFileMaterial(geometryPath, materialFile);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        mappedMilliseconds = std::min(mappedMilliseconds, elapsed.count());
+    }
+
+    ThreeDModel::readObjectFileCached(geometryPath, materialPath);
+    for (int r = 0; r < repetitions; r++) {
+        auto start = std::chrono::steady_clock::now();
+        cachedModels = ThreeDModel::readObjectFileCached(geometryPath, materialPath);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        cachedMilliseconds = std::min(cachedMilliseconds, elapsed.count());
+    }
+
+    unsigned long faces = 0;
+    for (const ThreeDModel& model : mappedModels) {
+        faces += model.faceCount();
+    }
+
+    const bool same = sameModels(streamModels, mappedModels) && sameModels(mappedModels, cachedModels);
+
+    std::cout << std::endl
+            << geometryPath << ": " << megabytes << " MB, " << mappedModels.size() << " models, "
+            << faces << " faces, " << omp_get_max_threads() << " threads" << std::endl
+            << "Reader\tTime (ms)\tMB/s" << std::endl
+            << "stream\t" << streamMilliseconds << "\t" << megabytes / (streamMilliseconds / 1000.0) << std::endl
+            << "mapped\t" << mappedMilliseconds << "\t" << megabytes / (mappedMilliseconds / 1000.0) << std::endl
+            << "cached\t" << cachedMilliseconds << "\t" << megabytes / (cachedMilliseconds / 1000.0) << std::endl
+            << "Speed-up: " << streamMilliseconds / mappedMilliseconds << " mapped, "
+            << streamMilliseconds / cachedMilliseconds << " cached" << std::endl
+            << "Output: " << (same ? "identical" : "DIFFERENT") << std::endl;
+
+    return same;
+}
+
+const IntersectionKernel kernels[] = {
+    IntersectionKernel::Planar, IntersectionKernel::MollerTrumbore, IntersectionKernel::Watertight,
+    IntersectionKernel::Simd
+};
+const char* kernelNames[] = {"planar", "moller-trumbore", "watertight", "simd"};
+// Kernels that test one triangle at a time, compared by --kernel-check
+// The SIMD kernel only exists on packets, --packet-benchmark compares it with Moller-Trumbore
+#define CHECKED_KERNELS 3
+
+/**
+ * @brief parseKernel sets kernel to the kernel called name
+ *
+ * @return false if there is no such kernel
+ */
+bool parseKernel(const std::string& name, IntersectionKernel& kernel) {
+    for (unsigned int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (name == kernelNames[k]) {
+            kernel = kernels[k];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief gatherTriangles triangulates every model in its object space, as the scene does
+ *
+ * @param triangles the triangles of all the models are appended to
+ * @param bounds extended to the bounds of the triangles
+ */
+void gatherTriangles(const std::vector<ThreeDModel>& models, std::vector<Triangle>& triangles, AABB& bounds) {
+    for (const ThreeDModel& model : models) {
+        Mesh mesh;
+        mesh.build(model, nullptr);
+        triangles.insert(triangles.end(), mesh.triangles.begin(), mesh.triangles.end());
+        bounds.extend(mesh.bounds());
+    }
+}
+
+/**
+ * @brief sceneRay draws a ray starting anywhere around the scene, up to half its size away from it,
+ *        towards a point of the scene or towards a vertex of one of its triangles
+ *
+ * @param triangles of the scene, not empty
+ * @param bounds of triangles
+ * @param sampler set up for the ray, draws its dimensions
+ * @param ray set to the ray drawn
+ *
+ * @return false if the ray starts on its target and has no direction
+ */
+bool sceneRay(const std::vector<Triangle>& triangles, const AABB& bounds, bool aimedAtVertex, Sampler& sampler,
+              Ray& ray) {
+    const auto count = static_cast<unsigned int>(triangles.size());
+
+    glm::vec3 origin;
+    glm::vec3 target;
+    for (int axis = 0; axis < 3; axis++) {
+        origin[axis] = bounds.min[axis] + bounds.extent()[axis] * (2.0f * sampler.next1D() - 0.5f);
+        target[axis] = bounds.min[axis] + bounds.extent()[axis] * sampler.next1D();
+    }
+
+    if (aimedAtVertex) {
+        const Triangle& triangle = triangles[std::min(count - 1, static_cast<unsigned int>(sampler.next1D() * count))];
+        target = glm::vec3(triangle.vertices[std::min(2, static_cast<int>(sampler.next1D() * 3))]);
+    }
+
+    if (target == origin) {
+        return false;
+    }
+
+    ray = Ray(origin, glm::normalize(target - origin));
+    return true;
+}
+
+/**
+ * @brief checkKernels casts random rays through the scene, tests each of them against every triangle
+ *        with every kernel and compares the results with the planar kernel.
+ *        Half of the rays are aimed at a vertex of the geometry: a closed mesh cannot let them through,
+ *        those that hit nothing are reported as leaks.
+ *        Kernels only round differently, so they may only disagree on rays that pass within rounding distance
+ *        of an edge, which includes rays parallel to the triangle, or on hits right at the origin of the ray.
+ *
+ * @return true if no kernel disagrees with the planar kernel on any other hit
+ */
+bool checkKernels(const std::vector<ThreeDModel>& models, unsigned int seed) {
+    struct KernelResult {
+        unsigned long long hits = 0;
+        unsigned long long edgeMismatches = 0;
+        unsigned long long interiorMismatches = 0;
+        unsigned long long closestMismatches = 0;
+        unsigned long long leaks = 0;
+        float maxTError = 0.0f;
+        float maxBarycentricError = 0.0f;
+        double milliseconds = 0.0;
+    };
+
+    std::vector<Triangle> triangles;
+    AABB bounds;
+    gatherTriangles(models, triangles, bounds);
+
+    if (triangles.empty()) {
+        return false;
+    }
+
+    const unsigned int count = static_cast<unsigned int>(triangles.size());
+    const float edgeTolerance = KERNEL_CHECK_EDGE_TOLERANCE * glm::length(bounds.extent());
+    std::vector<float> t[CHECKED_KERNELS];
+    std::vector<glm::vec3> barycentric[CHECKED_KERNELS];
+    for (int k = 0; k < CHECKED_KERNELS; k++) {
+        t[k].resize(count);
+        barycentric[k].resize(count);
+    }
+
+    KernelResult results[CHECKED_KERNELS];
+    Sampler sampler(seed);
+
+    for (unsigned int r = 0; r < KERNEL_CHECK_RAYS; r++) {
+        sampler.startPixelSample(r, 0, 0);
+
+        const bool aimedAtVertex = r % 2 == 1;
+        Ray ray({}, {});
+        if (!sceneRay(triangles, bounds, aimedAtVertex, sampler, ray)) {
+            continue;
+        }
+
+        for (int k = 0; k < CHECKED_KERNELS; k++) {
+            auto start = std::chrono::steady_clock::now();
+
+            if (kernels[k] == IntersectionKernel::Watertight) {
+                const WatertightRay watertightRay(ray);
+                for (unsigned int i = 0; i < count; i++) {
+                    t[k][i] = triangles[i].intersectWatertight(watertightRay, barycentric[k][i]);
+                }
+            } else if (kernels[k] == IntersectionKernel::MollerTrumbore) {
+                for (unsigned int i = 0; i < count; i++) {
+                    t[k][i] = triangles[i].intersectMollerTrumbore(ray, barycentric[k][i]);
+                }
+            } else {
+                for (unsigned int i = 0; i < count; i++) {
+                    t[k][i] = triangles[i].intersect(ray, barycentric[k][i]);
+                }
+            }
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            results[k].milliseconds += elapsed.count();
+        }
+
+        float closestT[CHECKED_KERNELS];
+        for (int k = 0; k < CHECKED_KERNELS; k++) {
+            closestT[k] = std::numeric_limits<float>::infinity();
+            for (unsigned int i = 0; i < count; i++) {
+                if (t[k][i] > 0.0f) {
+                    results[k].hits++;
+                    closestT[k] = std::min(closestT[k], t[k][i]);
+                }
+            }
+
+            if (aimedAtVertex && closestT[k] == std::numeric_limits<float>::infinity()) {
+                results[k].leaks++;
+            }
+        }
+
+        for (int k = 1; k < CHECKED_KERNELS; k++) {
+            KernelResult& result = results[k];
+
+            for (unsigned int i = 0; i < count; i++) {
+                const bool referenceHit = t[0][i] > 0.0f;
+                const bool hit = t[k][i] > 0.0f;
+
+                if (referenceHit && hit) {
+                    glm::vec3 error = glm::abs(barycentric[k][i] - barycentric[0][i]);
+                    result.maxTError = std::max(result.maxTError, std::abs(t[k][i] - t[0][i]) / t[0][i]);
+                    result.maxBarycentricError = std::max({result.maxBarycentricError, error.x, error.y, error.z});
+                    continue;
+                }
+
+                if (!referenceHit && !hit) {
+                    continue;
+                }
+
+                // The kernel that hit tells where the hit is
+                const int hitKernel = referenceHit ? 0 : k;
+                const glm::vec3& weights = barycentric[hitKernel][i];
+                const Triangle& triangle = triangles[i];
+                const glm::vec3 a = glm::vec3(triangle.vertices[0]);
+                const glm::vec3 b = glm::vec3(triangle.vertices[1]);
+                const glm::vec3 c = glm::vec3(triangle.vertices[2]);
+                const glm::vec3 cross = glm::cross(b - a, c - a);
+
+                // Distance from the hit to the closest edge, at most the barycentric weight times the smallest altitude,
+                // seen from the ray. Rays at a grazing angle only need to move slightly to cross the edge.
+                const float longestEdge = std::max({glm::length(b - a), glm::length(c - b), glm::length(a - c)});
+                const float altitude = glm::length(cross) / longestEdge;
+                const float cosine = std::abs(glm::dot(glm::normalize(cross), ray.direction));
+                const float edgeDistance = std::min({weights.x, weights.y, weights.z}) * altitude * cosine;
+
+                const bool atEdge = !(edgeDistance >= edgeTolerance);
+                const bool atOrigin = t[hitKernel][i] < KERNEL_CHECK_NEAR_T;
+
+                if (atEdge || atOrigin) {
+                    result.edgeMismatches++;
+                } else {
+                    result.interiorMismatches++;
+                }
+            }
+
+            // Different triangles may be hit first at the same distance, only the distance has to agree
+            const bool referenceMiss = closestT[0] == std::numeric_limits<float>::infinity();
+            const bool miss = closestT[k] == std::numeric_limits<float>::infinity();
+            if (referenceMiss != miss
+                || (!miss && std::abs(closestT[k] - closestT[0]) > edgeTolerance)) {
+                result.closestMismatches++;
+            }
+        }
+    }
+
+    bool consistent = true;
+    const double tests = static_cast<double>(KERNEL_CHECK_RAYS) * count;
+
+    std::cout << std::endl
+            << "Kernel check: " << count << " triangles, " << KERNEL_CHECK_RAYS << " rays, half aimed at vertices"
+            << std::endl
+            << "Kernel\tMtests/s\tHits\tEdge mismatches\tInterior mismatches\tClosest mismatches\tLeaks"
+            << "\tMax t error\tMax barycentric error" << std::endl;
+
+    for (int k = 0; k < CHECKED_KERNELS; k++) {
+        const KernelResult& result = results[k];
+        std::cout << kernelNames[k] << "\t"
+                << tests / (result.milliseconds * 1000.0) << "\t"
+                << result.hits << "\t"
+                << result.edgeMismatches << "\t"
+                << result.interiorMismatches << "\t"
+                << result.closestMismatches << "\t"
+                << result.leaks << "\t"
+                << result.maxTError << "\t"
+                << result.maxBarycentricError << std::endl;
+
+        consistent = consistent && result.interiorMismatches == 0;
+    }
+
+    std::cout << "Result: " << (consistent ? "consistent" : "INCONSISTENT") << std::endl;
+
+    return consistent;
+}
+
+/**
+ * @brief benchmarkPackets tests random rays against every triangle of the scene, one triangle at a time with
+ *        Moller-Trumbore, then a packet at a time with each instruction set the processor supports.
+ *        Packet tests must find exactly the hits, distances and barycentrics of the triangle at a time test.
+ *
+ * @return true if every packet test agrees with the triangle at a time test
+ */
+bool benchmarkPackets(const std::vector<ThreeDModel>& models, unsigned int seed) {
+    std::vector<Triangle> triangles;
+    AABB bounds;
+    gatherTriangles(models, triangles, bounds);
+
+    if (triangles.empty()) {
+        return false;
+    }
+
+    PackedTriangles packed;
+    packed.build(triangles);
+
+    std::vector<Ray> rays;
+    rays.reserve(PACKET_BENCHMARK_RAYS);
+    Sampler sampler(seed);
+    for (unsigned int r = 0; r < PACKET_BENCHMARK_RAYS; r++) {
+        sampler.startPixelSample(r, 0, 0);
+
+        Ray ray({}, {});
+        if (sceneRay(triangles, bounds, r % 2 == 1, sampler, ray)) {
+            rays.push_back(ray);
+        }
+    }
+
+    const auto count = static_cast<unsigned int>(triangles.size());
+    const double tests = static_cast<double>(rays.size()) * count;
+    const float infinity = std::numeric_limits<float>::infinity();
+
+    std::cout << std::endl
+            << "Packet benchmark: " << count << " triangles in " << packed.packets.size() << " packets of "
+            << TRIANGLE_PACKET_WIDTH << ", " << rays.size() << " rays, best instruction set "
+            << PackedTriangles::isaName(PackedTriangles::bestIsa()) << std::endl
+            << "Test\tMtests/s\tSpeed-up\tHits\tMismatches" << std::endl;
+
+    // One triangle at a time, the reference
+    unsigned long long referenceHits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Ray& ray : rays) {
+        for (const Triangle& triangle : triangles) {
+            glm::vec3 barycentric;
+            referenceHits += triangle.intersectMollerTrumbore(ray, barycentric) > 0.0f;
+        }
+    }
+    std::chrono::duration<double, std::milli> referenceTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "triangle\t" << tests / (referenceTime.count() * 1000.0) << "\t1\t" << referenceHits << "\t0"
+            << std::endl;
+
+    bool consistent = true;
+    const PacketIsa isas[] = {PacketIsa::Scalar, PacketIsa::SSE, PacketIsa::AVX2};
+
+    for (PacketIsa isa : isas) {
+        if (!PackedTriangles::isSupported(isa)) {
+            std::cout << "packet-" << PackedTriangles::isaName(isa) << "\tunsupported" << std::endl;
+            continue;
+        }
+
+        const PacketIntersector intersect = PackedTriangles::intersector(isa);
+        PacketHits hits;
+
+        unsigned long long packetHits = 0;
+        start = std::chrono::steady_clock::now();
+        for (const Ray& ray : rays) {
+            for (const TrianglePacket& packet : packed.packets) {
+                packetHits += __builtin_popcount(intersect(ray, packet, infinity, hits));
+            }
+        }
+        std::chrono::duration<double, std::milli> packetTime = std::chrono::steady_clock::now() - start;
+
+        // Compared outside of the timed loop, lane by lane
+        unsigned long long mismatches = 0;
+        for (const Ray& ray : rays) {
+            for (const TrianglePacket& packet : packed.packets) {
+                const unsigned int mask = intersect(ray, packet, infinity, hits);
+
+                for (unsigned int lane = 0; lane < packet.count; lane++) {
+                    glm::vec3 barycentric;
+                    const float t = triangles[packet.first + lane].intersectMollerTrumbore(ray, barycentric);
+                    const bool hit = (mask >> lane) & 1u;
+
+                    if (hit != (t > 0.0f)
+                        || (hit && (hits.t[lane] != t || hits.u[lane] != barycentric.y
+                                    || hits.v[lane] != barycentric.z))) {
+                        mismatches++;
+                    }
+                }
+            }
+        }
+
+        std::cout << "packet-" << PackedTriangles::isaName(isa) << "\t"
+                << tests / (packetTime.count() * 1000.0) << "\t"
+                << referenceTime.count() / packetTime.count() << "\t"
+                << packetHits << "\t"
+                << mismatches << std::endl;
+
+        consistent = consistent && mismatches == 0;
+    }
+
+    std::cout << "Result: " << (consistent ? "consistent" : "INCONSISTENT") << std::endl;
+
+    return consistent;
+}
+
+const BVHLayout layouts[] = {BVHLayout::Binary, BVHLayout::Wide4, BVHLayout::Wide8};
+const char* layoutNames[] = {"binary", "bvh4", "bvh8"};
+
+/**
+ * @brief parseLayout sets layout to the BVH layout called name
+ *
+ * @return false if there is no such layout
+ */
+bool parseLayout(const std::string& name, BVHLayout& layout) {
+    for (unsigned int l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++) {
+        if (name == layoutNames[l]) {
+            layout = layouts[l];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief benchmarkBVH traces random rays through the meshes of the scene with every BVH layout, single threaded,
+ *        as closest hit queries then as shadow queries towards a light at infinity.
+ *        Every layout must find the same closest distances, up to rounding, and the same occlusions as the binary one.
+ *        Rays aimed at a vertex are the exception: they hit all the triangles around it at the same distance up to
+ *        rounding, which grows as triangles are seen edge-on, and layouts prune those triangles in a different order.
+ *
+ * @param kernel tests the triangles of the leaves
+ * @param builder builds the binary hierarchy the wide ones are collapsed from
+ *
+ * @return true if every layout agrees with the binary one
+ */
+bool benchmarkBVH(const std::vector<ThreeDModel>& models, IntersectionKernel kernel, BVHBuilder builder,
+                  unsigned int seed) {
+    struct LayoutResult {
+        double closestMilliseconds = 0.0;
+        double occludingMilliseconds = 0.0;
+        TraversalStatistics closest;
+        TraversalStatistics occluding;
+        unsigned long long hits = 0;
+        unsigned long long occluded = 0;
+        unsigned long long mismatches = 0;
+        unsigned long long vertexMismatches = 0;
+    };
+
+    Material defaultMaterial;
+    std::vector<Mesh> meshes(models.size());
+    std::vector<Triangle> triangles;
+    AABB bounds;
+    for (unsigned int i = 0; i < models.size(); i++) {
+        meshes[i].build(models[i], &defaultMaterial, builder);
+        triangles.insert(triangles.end(), meshes[i].triangles.begin(), meshes[i].triangles.end());
+        bounds.extend(meshes[i].bounds());
+    }
+
+    if (triangles.empty()) {
+        return false;
+    }
+
+    std::vector<Ray> rays;
+    std::vector<bool> aimedAtVertex;
+    rays.reserve(BVH_BENCHMARK_RAYS);
+    aimedAtVertex.reserve(BVH_BENCHMARK_RAYS);
+    Sampler sampler(seed);
+    for (unsigned int r = 0; r < BVH_BENCHMARK_RAYS; r++) {
+        sampler.startPixelSample(r, 0, 0);
+
+        Ray ray({}, {});
+        if (sceneRay(triangles, bounds, r % 2 == 1, sampler, ray)) {
+            rays.push_back(ray);
+            aimedAtVertex.push_back(r % 2 == 1);
+        }
+    }
+
+    const float infinity = std::numeric_limits<float>::infinity();
+    const unsigned int layoutCount = sizeof(layouts) / sizeof(layouts[0]);
+    std::vector<float> referenceT(rays.size());
+    std::vector<bool> referenceOccluded(rays.size());
+    LayoutResult results[layoutCount];
+
+    for (unsigned int l = 0; l < layoutCount; l++) {
+        LayoutResult& result = results[l];
+        std::vector<float> closestT(rays.size(), infinity);
+        std::vector<bool> occluded(rays.size(), false);
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int r = 0; r < rays.size(); r++) {
+            for (const Mesh& mesh : meshes) {
+                CollisionInfo hit = mesh.closestHit(rays[r], kernel, layouts[l], closestT[r], &result.closest);
+                if (hit.isHit()) {
+                    closestT[r] = hit.t;
+                }
+            }
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        result.closestMilliseconds = elapsed.count();
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned int r = 0; r < rays.size(); r++) {
+            for (const Mesh& mesh : meshes) {
+                if (mesh.occludingHit(rays[r], kernel, layouts[l], infinity, &result.occluding).isHit()) {
+                    occluded[r] = true;
+                    break;
+                }
+            }
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+        result.occludingMilliseconds = elapsed.count();
+
+        if (l == 0) {
+            referenceT = closestT;
+            referenceOccluded = occluded;
+        }
+
+        for (unsigned int r = 0; r < rays.size(); r++) {
+            result.hits += closestT[r] != infinity;
+            result.occluded += occluded[r];
+            const bool sameClosest = closestT[r] == referenceT[r]
+                                     || std::abs(closestT[r] - referenceT[r]) <= BVH_BENCHMARK_TOLERANCE * referenceT[r];
+            if (!sameClosest || occluded[r] != referenceOccluded[r]) {
+                (aimedAtVertex[r] ? result.vertexMismatches : result.mismatches)++;
+            }
+        }
+    }
+
+    std::size_t binaryBytes = 0;
+    std::size_t wide4Bytes = 0;
+    std::size_t wide8Bytes = 0;
+    for (const Mesh& mesh : meshes) {
+        binaryBytes += mesh.bvh.nodes.size() * sizeof(BVHNode);
+        wide4Bytes += mesh.bvh4.bytes();
+        wide8Bytes += mesh.bvh8.bytes();
+    }
+    const std::size_t layoutBytes[] = {binaryBytes, wide4Bytes, wide8Bytes};
+
+    bool consistent = true;
+    const auto rayCount = static_cast<double>(rays.size());
+
+    std::cout << std::endl
+            << "BVH benchmark: " << meshes.size() << " meshes, " << triangles.size() << " triangles, "
+            << rays.size() << " rays, half aimed at vertices, single threaded" << std::endl
+            << "Layout\tKB\tClosest Mrays/s\tSpeed-up\tNodes/ray\tTriangles/ray"
+            << "\tShadow Mrays/s\tSpeed-up\tNodes/ray\tTriangles/ray\tHits\tOccluded\tVertex mismatches\tMismatches"
+            << std::endl;
+
+    for (unsigned int l = 0; l < layoutCount; l++) {
+        const LayoutResult& result = results[l];
+        std::cout << layoutNames[l] << "\t"
+                << layoutBytes[l] / 1024 << "\t"
+                << rayCount / (result.closestMilliseconds * 1000.0) << "\t"
+                << results[0].closestMilliseconds / result.closestMilliseconds << "\t"
+                << result.closest.nodes / rayCount << "\t"
+                << result.closest.triangles / rayCount << "\t"
+                << rayCount / (result.occludingMilliseconds * 1000.0) << "\t"
+                << results[0].occludingMilliseconds / result.occludingMilliseconds << "\t"
+                << result.occluding.nodes / rayCount << "\t"
+                << result.occluding.triangles / rayCount << "\t"
+                << result.hits << "\t"
+                << result.occluded << "\t"
+                << result.vertexMismatches << "\t"
+                << result.mismatches << std::endl;
+
+        consistent = consistent && result.mismatches == 0;
+    }
+
+    std::cout << "Result: " << (consistent ? "consistent" : "INCONSISTENT") << std::endl;
+
+    return consistent;
+}
+
+const BVHBuilder builders[] = {BVHBuilder::BinnedSAH, BVHBuilder::Linear, BVHBuilder::Spatial};
+const char* builderNames[] = {"sah", "lbvh", "sbvh"};
+
+/**
+ * @brief parseBuilder sets builder to the BVH builder called name
+ *
+ * @return false if there is no such builder
+ */
+bool parseBuilder(const std::string& name, BVHBuilder& builder) {
+    for (unsigned int b = 0; b < sizeof(builders) / sizeof(builders[0]); b++) {
+        if (name == builderNames[b]) {
+            builder = builders[b];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief buildMeshes builds a mesh per model with builder on the given number of threads, one task per mesh
+ *        as Scene::buildGeometry does
+ *
+ * @return the time taken, in milliseconds
+ */
+double buildMeshes(const std::vector<ThreeDModel>& models,
+                   Material* defaultMaterial,
+                   BVHBuilder builder,
+                   int threads,
+                   std::vector<Mesh>& meshes) {
+    const int maxThreads = omp_get_max_threads();
+    omp_set_num_threads(threads);
+
+    meshes.assign(models.size(), Mesh());
+
+    auto start = std::chrono::steady_clock::now();
+    // clang-format off
+#pragma omp parallel
+#pragma omp single
+    // clang-format on
+    for (unsigned int i = 0; i < models.size(); i++) {
+        // clang-format off
+#pragma omp task firstprivate(i)
+        // clang-format on
+        meshes[i].build(models[i], defaultMaterial, builder);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    omp_set_num_threads(maxThreads);
+    return elapsed.count();
+}
+
+/**
+ * @brief benchmarkBuilders builds the meshes of the scene with every BVH builder, on one thread then on all of them,
+ *        and traces the same random rays through the hierarchies built, single threaded, as closest hit queries.
+ *        The SAH cost of the hierarchies is reported along with the work the rays actually took.
+ *        Builds must not depend on the number of threads: both must give the same triangle order and nodes.
+ *
+ * @param kernel tests the triangles of the leaves
+ * @param layout hierarchy the rays are traced through
+ *
+ * @return true if every builder built the same hierarchies on one and all threads
+ */
+bool benchmarkBuilders(const std::vector<ThreeDModel>& models,
+                       IntersectionKernel kernel,
+                       BVHLayout layout,
+                       unsigned int seed) {
+    std::vector<Triangle> triangles;
+    AABB bounds;
+    gatherTriangles(models, triangles, bounds);
+
+    if (triangles.empty()) {
+        return false;
+    }
+
+    std::vector<Ray> rays;
+    rays.reserve(BUILD_BENCHMARK_RAYS);
+    Sampler sampler(seed);
+    for (unsigned int r = 0; r < BUILD_BENCHMARK_RAYS; r++) {
+        sampler.startPixelSample(r, 0, 0);
+
+        Ray ray({}, {});
+        if (sceneRay(triangles, bounds, false, sampler, ray)) {
+            rays.push_back(ray);
+        }
+    }
+
+    Material defaultMaterial;
+    const int threads = omp_get_max_threads();
+    const auto rayCount = static_cast<double>(rays.size());
+    bool deterministic = true;
+
+    std::cout << std::endl
+            << "Build benchmark: " << models.size() << " meshes, " << triangles.size() << " triangles, "
+            << rays.size() << " rays traced single threaded" << std::endl
+            << "Builder\tNodes\tDepth\tDuplicates\tSAH cost\t1 thread ms\t" << threads << " threads ms\tSpeed-up"
+            << "\tms per million triangles\tClosest Mrays/s\tNodes/ray\tTriangles/ray\tDeterministic" << std::endl;
+
+    for (unsigned int b = 0; b < sizeof(builders) / sizeof(builders[0]); b++) {
+        std::vector<Mesh> serial;
+        std::vector<Mesh> meshes;
+        const double serialMilliseconds = buildMeshes(models, &defaultMaterial, builders[b], 1, serial);
+        const double parallelMilliseconds = buildMeshes(models, &defaultMaterial, builders[b], threads, meshes);
+
+        std::size_t nodes = 0;
+        std::size_t duplicates = 0;
+        unsigned int depth = 0;
+        double sahCost = 0.0;
+        double rootArea = 0.0;
+        bool same = true;
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            const Mesh& mesh = meshes[i];
+            nodes += mesh.bvh.nodes.size();
+            duplicates += mesh.bvh.duplicates();
+            depth = std::max(depth, mesh.bvh.depth());
+
+            // Costs are relative to the root of each mesh, weigh them by its area to sum them over the scene
+            const double area = mesh.bounds().surfaceArea();
+            sahCost += mesh.bvh.sahCost() * area;
+            rootArea += area;
+
+            // Tasks take nodes in any order, so compare the leaves and the sizes rather than the node arrays
+            same = same && mesh.bvh.nodes.size() == serial[i].bvh.nodes.size()
+                   && mesh.bvh.depth() == serial[i].bvh.depth()
+                   && mesh.triangles.size() == serial[i].triangles.size()
+                   && std::equal(mesh.triangles.begin(), mesh.triangles.end(), serial[i].triangles.begin(),
+                                 [](const Triangle& a, const Triangle& c) {
+                                     return std::memcmp(&a.vertices, &c.vertices, sizeof(a.vertices)) == 0;
+                                 });
+        }
+        deterministic = deterministic && same;
+
+        TraversalStatistics statistics;
+        auto start = std::chrono::steady_clock::now();
+        for (const Ray& ray : rays) {
+            float closestT = std::numeric_limits<float>::infinity();
+            for (const Mesh& mesh : meshes) {
+                CollisionInfo hit = mesh.closestHit(ray, kernel, layout, closestT, &statistics);
+                if (hit.isHit()) {
+                    closestT = hit.t;
+                }
+            }
+        }
+        std::chrono::duration<double, std::milli> traceMilliseconds = std::chrono::steady_clock::now() - start;
+
+        std::cout << builderNames[b] << "\t"
+                << nodes << "\t"
+                << depth << "\t"
+                << duplicates << "\t"
+                << (rootArea > 0.0 ? sahCost / rootArea : 0.0) << "\t"
+                << serialMilliseconds << "\t"
+                << parallelMilliseconds << "\t"
+                << serialMilliseconds / parallelMilliseconds << "\t"
+                << parallelMilliseconds * 1.0e6 / static_cast<double>(triangles.size()) << "\t"
+                << rayCount / (traceMilliseconds.count() * 1000.0) << "\t"
+                << static_cast<double>(statistics.nodes) / rayCount << "\t"
+                << static_cast<double>(statistics.triangles) / rayCount << "\t"
+                << (same ? "yes" : "NO") << std::endl;
+    }
+
+    std::cout << "Result: " << (deterministic ? "deterministic" : "NOT DETERMINISTIC") << std::endl;
+
+    return deterministic;
+}
+
+// In the order of the enum, so that names can be looked up by value
+const HemisphereSampling hemisphereSamplings[] = {HemisphereSampling::Cosine, HemisphereSampling::UniformSphere};
+const char* hemisphereSamplingNames[] = {"cosine", "uniform"};
+
+/**
+ * @brief parseHemisphereSampling sets sampling to the distribution of indirect lighting samples called name
+ *
+ * @return false if there is no such distribution
+ */
+bool parseHemisphereSampling(const std::string& name, HemisphereSampling& sampling) {
+    for (unsigned int s = 0; s < sizeof(hemisphereSamplings) / sizeof(hemisphereSamplings[0]); s++) {
+        if (name == hemisphereSamplingNames[s]) {
+            sampling = hemisphereSamplings[s];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Progressive render of the frame with one sampling strategy, compared by --variance-benchmark
+struct SamplingRun {
+    HemisphereSampling sampling;
+    unsigned int samples;
+    double milliseconds;
+    // average over the pixels of the mean luminance, and of the variance of the luminance of one sample
+    double meanLuminance;
+    double variance;
+};
+
+/**
+ * @brief benchmarkSampling renders the frame progressively with uniform sphere sampling and the indirect lighting
+ *        samples of renderParameters, then with cosine sampling and as many, half as many... down to one sample.
+ *        Every strategy estimates the same image, so the mean luminances must agree.
+ *        The variance of a pixel sample, averaged over the image, measures the noise of each strategy.
+ *        Efficiency is the inverse of variance times render time, relative to uniform sampling.
+ *
+ * @param passes samples per pixel of every render, at least 2
+ *
+ * @return true if cosine sampling has a lower variance than uniform sampling with as many samples
+ */
+bool benchmarkSampling(Raytracer& raytracer, RenderParameters& renderParameters, RGBAImage& image,
+                       unsigned int passes) {
+    const unsigned int samples = std::max(1u, renderParameters.monteCarloSamples);
+    renderParameters.monteCarloEnabled = true;
+
+    std::vector<SamplingRun> runs;
+    runs.push_back({HemisphereSampling::UniformSphere, samples, 0.0, 0.0, 0.0});
+    for (unsigned int s = samples; s >= 1; s /= 2) {
+        runs.push_back({HemisphereSampling::Cosine, s, 0.0, 0.0, 0.0});
+    }
+
+    for (SamplingRun& run : runs) {
+        renderParameters.hemisphereSampling = run.sampling;
+        renderParameters.monteCarloSamples = run.samples;
+
+        PassStatistics statistics{};
+        raytracer.startProgressive(image);
+        for (unsigned int pass = 0; pass < passes; pass++) {
+            statistics = raytracer.renderPass(image);
+            run.milliseconds += statistics.passMilliseconds;
+        }
+
+        const AccumulationBuffer& accumulation = raytracer.accumulated();
+        for (int row = 0; row < accumulation.height; row++) {
+            for (int col = 0; col < accumulation.width; col++) {
+                run.meanLuminance += luminance(accumulation.mean(row, col));
+                run.variance += accumulation.variance(row, col);
+            }
+        }
+
+        const double pixels = static_cast<double>(accumulation.width * accumulation.height);
+        run.meanLuminance /= pixels;
+        run.variance /= pixels;
+    }
+
+    const SamplingRun& uniform = runs[0];
+    const SamplingRun& cosine = runs[1];
+
+    std::cout << std::endl
+            << passes << " samples per pixel" << std::endl
+            << "Sampling\tMC samples\tRender (ms)\tMean luminance\tVariance\tVariance reduction\tEfficiency"
+            << std::endl;
+    for (const SamplingRun& run : runs) {
+        std::cout << hemisphereSamplingNames[static_cast<int>(run.sampling)] << "\t"
+                << run.samples << "\t"
+                << run.milliseconds << "\t"
+                << run.meanLuminance << "\t"
+                << run.variance << "\t"
+                << (run.variance > 0.0 ? uniform.variance / run.variance : 0.0) << "\t"
+                << (run.variance > 0.0 ? uniform.variance * uniform.milliseconds / (run.variance * run.milliseconds)
+                                       : 0.0) << std::endl;
+    }
+
+    const bool reduced = cosine.variance < uniform.variance;
+    std::cout << "Result: cosine sampling " << (reduced ? "reduces" : "DOES NOT REDUCE") << " the variance" << std::endl;
+
+    return reduced;
+}
+
+// In the order of the enum, so that names can be looked up by value
+const SampleSequence sampleSequences[] = {SampleSequence::Independent, SampleSequence::Stratified,
+                                          SampleSequence::Sobol, SampleSequence::Rank1};
+const char* sampleSequenceNames[] = {"independent", "stratified", "sobol", "rank1"};
+
+/**
+ * @brief parseSampleSequence sets sequence to the sample sequence called name
+ *
+ * @return false if there is no such sequence
+ */
+bool parseSampleSequence(const std::string& name, SampleSequence& sequence) {
+    for (unsigned int s = 0; s < sizeof(sampleSequences) / sizeof(sampleSequences[0]); s++) {
+        if (name == sampleSequenceNames[s]) {
+            sequence = sampleSequences[s];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @param noise if not null, set to the standard deviation of the luminance of the average, over the image
+ *
+ * @return the average of the samples of every pixel of accumulation, row by row
+ */
+std::vector<glm::vec3> averageImage(const AccumulationBuffer& accumulation, double* noise = nullptr) {
+    std::vector<glm::vec3> average;
+    average.reserve(accumulation.width * accumulation.height);
+    double variance = 0.0;
+
+    for (int row = 0; row < accumulation.height; row++) {
+        for (int col = 0; col < accumulation.width; col++) {
+            average.push_back(accumulation.mean(row, col));
+            variance += accumulation.variance(row, col) / std::max(1u, accumulation.sampleCount(row, col));
+        }
+    }
+
+    if (noise != nullptr) {
+        *noise = std::sqrt(variance / static_cast<double>(average.size()));
+    }
+
+    return average;
+}
+
+/**
+ * @brief renderAverage renders the frame progressively with samples samples per pixel drawn from sequence
+ *
+ * @param noise if not null, set to the standard deviation of the luminance of the average, over the image
+ *
+ * @return the average of the samples of every pixel, row by row
+ */
+std::vector<glm::vec3> renderAverage(Raytracer& raytracer, RenderParameters& renderParameters, RGBAImage& image,
+                                     SampleSequence sequence, unsigned int samples, double* noise = nullptr) {
+    renderParameters.sampleSequence = sequence;
+    renderParameters.sequenceSamples = samples;
+
+    raytracer.startProgressive(image);
+    for (unsigned int pass = 0; pass < samples; pass++) {
+        raytracer.renderPass(image);
+    }
+
+    return averageImage(raytracer.accumulated(), noise);
+}
+
+/**
+ * @return the root mean square error of the channels of image with respect to reference
+ */
+double rootMeanSquareError(const std::vector<glm::vec3>& image, const std::vector<glm::vec3>& reference) {
+    double sum = 0.0;
+
+    for (std::size_t p = 0; p < image.size(); p++) {
+        const glm::vec3 error = image[p] - reference[p];
+        sum += glm::dot(error, error);
+    }
+
+    return std::sqrt(sum / (3.0 * static_cast<double>(image.size())));
+}
+
+/**
+ * @brief benchmarkSamplers renders a reference image with SAMPLER_BENCHMARK_REFERENCE_FACTOR times maxSamples
+ *        independent samples per pixel, from another seed. It then renders the frame with every sampler and
+ *        1, 2, 4... up to maxSamples samples per pixel, and reports the error of each render to the reference.
+ *        The error of independent sampling decreases as samples^-0.5, the rate of every sampler is fitted in log space.
+ *        The quality bar is the error of independent sampling with maxSamples samples.
+ *
+ * @return true if every sampler meets the quality bar with at most maxSamples samples
+ */
+bool benchmarkSamplers(Raytracer& raytracer, RenderParameters& renderParameters, RGBAImage& image,
+                       unsigned int maxSamples) {
+    const unsigned int seed = renderParameters.seed;
+    const unsigned int sequences = sizeof(sampleSequences) / sizeof(sampleSequences[0]);
+
+    double referenceNoise = 0.0;
+    renderParameters.seed = seed + 1;
+    const std::vector<glm::vec3> reference = renderAverage(raytracer, renderParameters, image,
+                                                           SampleSequence::Independent,
+                                                           maxSamples * SAMPLER_BENCHMARK_REFERENCE_FACTOR,
+                                                           &referenceNoise);
+    renderParameters.seed = seed;
+
+    std::vector<unsigned int> counts;
+    for (unsigned int samples = 1; samples <= maxSamples; samples *= 2) {
+        counts.push_back(samples);
+    }
+
+    // errors[s][c], error of sequence s with counts[c] samples
+    std::vector<std::vector<double>> errors(sequences);
+    for (unsigned int s = 0; s < sequences; s++) {
+        for (unsigned int samples : counts) {
+            const std::vector<glm::vec3> average = renderAverage(raytracer, renderParameters, image,
+                                                                 sampleSequences[s], samples);
+            errors[s].push_back(rootMeanSquareError(average, reference));
+        }
+    }
+
+    std::cout << std::endl
+            << "Reference: " << maxSamples * SAMPLER_BENCHMARK_REFERENCE_FACTOR << " independent samples per pixel, "
+            << "noise " << referenceNoise << std::endl
+            << "Samples";
+    for (const char* name : sampleSequenceNames) {
+        std::cout << "\t" << name;
+    }
+    std::cout << std::endl;
+
+    for (unsigned int c = 0; c < counts.size(); c++) {
+        std::cout << counts[c];
+        for (unsigned int s = 0; s < sequences; s++) {
+            std::cout << "\t" << errors[s][c];
+        }
+        std::cout << std::endl;
+    }
+
+    const double qualityBar = errors[0].back();
+    bool allMeetBar = true;
+
+    std::cout << std::endl
+            << "Sampler\tRate\tSamples to RMSE " << qualityBar << std::endl;
+    for (unsigned int s = 0; s < sequences; s++) {
+        // Least squares slope of log(error) over log(samples)
+        double meanX = 0.0;
+        double meanY = 0.0;
+        for (unsigned int c = 0; c < counts.size(); c++) {
+            meanX += std::log(static_cast<double>(counts[c])) / counts.size();
+            meanY += std::log(errors[s][c]) / counts.size();
+        }
+
+        double covariance = 0.0;
+        double varianceX = 0.0;
+        for (unsigned int c = 0; c < counts.size(); c++) {
+            const double dx = std::log(static_cast<double>(counts[c])) - meanX;
+            covariance += dx * (std::log(errors[s][c]) - meanY);
+            varianceX += dx * dx;
+        }
+
+        unsigned int cheapest = 0;
+        for (unsigned int c = 0; c < counts.size() && cheapest == 0; c++) {
+            if (errors[s][c] <= qualityBar) {
+                cheapest = counts[c];
+            }
+        }
+        allMeetBar = allMeetBar && cheapest != 0;
+
+        std::cout << sampleSequenceNames[s] << "\t"
+                << (varianceX > 0.0 ? covariance / varianceX : 0.0) << "\t";
+        if (cheapest != 0) {
+            std::cout << cheapest << std::endl;
+        } else {
+            std::cout << "more than " << maxSamples << std::endl;
+        }
+    }
+
+    return allMeetBar;
+}
+
+/**
+ * @return image as it is displayed, tone-mapped to 8 bits and scaled back to [0..1].
+ *         An error in a dark pixel is as visible there as a proportionally larger one in a bright pixel.
+ */
+std::vector<glm::vec3> displayedImage(std::vector<glm::vec3> image) {
+    for (glm::vec3& colour : image) {
+        const RGBAValue value = toneMap(colour);
+        colour = glm::vec3(value.red, value.green, value.blue) / 255.0f;
+    }
+
+    return image;
+}
+
+/**
+ * @brief benchmarkAdaptive renders a reference image with ADAPTIVE_BENCHMARK_REFERENCE_SAMPLES samples per pixel,
+ *        from another seed. It then renders the frame with the same anti-aliasing samples for every pixel,
+ *        and with adaptive sampling at the threshold of renderParameters, or at a range of thresholds if none is set.
+ *        Every render reports its time, its average samples per pixel and its error to the reference, once displayed:
+ *        adaptive sampling aims at the same relative error everywhere, which is what the eye sees.
+ *        Efficiency is the inverse of the squared error times render time, relative to fixed sampling.
+ *        The squared error of fixed sampling falls as 1 / samples, which gives the samples per pixel
+ *        fixed sampling would need for the error of every adaptive render.
+ *
+ * @return true if adaptive sampling is more efficient than fixed sampling at one of the thresholds
+ */
+bool benchmarkAdaptive(Raytracer& raytracer, RenderParameters& renderParameters, RGBAImage& image) {
+    const unsigned int seed = renderParameters.seed;
+    const unsigned int sequenceSamples = renderParameters.sequenceSamples;
+    const SampleSequence sequence = renderParameters.sampleSequence;
+
+    std::vector<float> thresholds;
+    if (renderParameters.adaptiveThreshold > 0.0f) {
+        thresholds.push_back(renderParameters.adaptiveThreshold);
+    } else {
+        for (int t = 0; t < ADAPTIVE_BENCHMARK_THRESHOLDS; t++) {
+            thresholds.push_back(ADAPTIVE_BENCHMARK_THRESHOLD / static_cast<float>(1 << t));
+        }
+    }
+
+    renderParameters.monteCarloEnabled = true;
+    renderParameters.adaptiveThreshold = 0.0f;
+    renderParameters.seed = seed + 1;
+    const std::vector<glm::vec3> reference = displayedImage(renderAverage(raytracer, renderParameters, image,
+                                                                          SampleSequence::Independent,
+                                                                          ADAPTIVE_BENCHMARK_REFERENCE_SAMPLES));
+    renderParameters.seed = seed;
+    renderParameters.sampleSequence = sequence;
+    renderParameters.sequenceSamples = sequenceSamples;
+
+    // threshold 0 first, fixed sampling
+    thresholds.insert(thresholds.begin(), 0.0f);
+    std::vector<RenderStatistics> results;
+    std::vector<double> errors;
+
+    for (float threshold : thresholds) {
+        renderParameters.adaptiveThreshold = threshold;
+        results.push_back(raytracer.render(image));
+        errors.push_back(rootMeanSquareError(displayedImage(averageImage(raytracer.accumulated())), reference));
+    }
+
+    const double pixels = static_cast<double>(image.width * image.height);
+    const double fixedCost = errors[0] * errors[0] * results[0].renderMilliseconds;
+    const double fixedSquaredError = errors[0] * errors[0] * static_cast<double>(results[0].samples) / pixels;
+    bool moreEfficient = false;
+
+    std::cout << std::endl
+            << "Reference: " << ADAPTIVE_BENCHMARK_REFERENCE_SAMPLES << " samples per pixel" << std::endl
+            << "Threshold\tRender (ms)\tSamples/pixel\tRays/pixel\tDisplayed RMSE\tFixed samples/pixel\tEfficiency" << std::endl;
+    for (unsigned int r = 0; r < results.size(); r++) {
+        const double efficiency = fixedCost / (errors[r] * errors[r] * results[r].renderMilliseconds);
+        moreEfficient = moreEfficient || (r > 0 && efficiency > 1.0);
+
+        if (r == 0) {
+            std::cout << "fixed";
+        } else {
+            std::cout << thresholds[r];
+        }
+        std::cout << "\t" << results[r].renderMilliseconds << "\t"
+                << static_cast<double>(results[r].samples) / pixels << "\t"
+                << static_cast<double>(results[r].rays) / pixels << "\t"
+                << errors[r] << "\t"
+                << fixedSquaredError / (errors[r] * errors[r]) << "\t"
+                << efficiency << std::endl;
+    }
+
+    return moreEfficient;
+}
+
+const Integrator integrators[] = {Integrator::Whitted, Integrator::Path};
+const char* integratorNames[] = {"whitted", "path"};
+
+/**
+ * @brief parseIntegrator sets integrator to the integrator called name
+ *
+ * @return false if there is no such integrator
+ */
+bool parseIntegrator(const std::string& name, Integrator& integrator) {
+    for (unsigned int i = 0; i < sizeof(integrators) / sizeof(integrators[0]); i++) {
+        if (name == integratorNames[i]) {
+            integrator = integrators[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief benchmarkHits times the closest hit and surface element of HIT_BENCHMARK_RAYS camera rays, single threaded,
+ *        the per ray cost of intersecting that the shading of a render is added to
+ */
+void benchmarkHits(Raytracer& raytracer, const RGBAImage& image) {
+    const unsigned long long pixels = static_cast<unsigned long long>(image.width * image.height);
+    const auto passes = static_cast<unsigned int>((HIT_BENCHMARK_RAYS + pixels - 1) / pixels);
+
+    HitStatistics statistics = raytracer.traceHits(image, passes);
+
+    std::cout << std::endl
+            << "Camera rays: " << statistics.rays << " (" << passes << " passes), "
+            << statistics.hits << " hits" << std::endl
+            << "Closest hit + surface element: " << statistics.nanosecondsPerRay() << " ns/ray, "
+            << statistics.milliseconds << " ms" << std::endl
+            << "Normal sum: " << statistics.normalSum.x << " " << statistics.normalSum.y << " "
+            << statistics.normalSum.z << std::endl;
+}
+
+/**
+ * @brief benchmarkIntegrators renders the frame with every integrator and the other settings of renderParameters,
+ *        and reports the render time, the rays per pixel, shadow rays included, and the average path length
+ */
+void benchmarkIntegrators(Raytracer& raytracer, RenderParameters& renderParameters, RGBAImage& image) {
+    std::vector<RenderStatistics> results;
+
+    for (Integrator integrator : integrators) {
+        renderParameters.integrator = integrator;
+        results.push_back(raytracer.render(image));
+    }
+
+    const double pixels = static_cast<double>(image.width * image.height);
+
+    std::cout << std::endl
+            << "Integrator\tRender (ms)\tRays\tRays/pixel\tRays/s\tPath length" << std::endl;
+    for (unsigned int i = 0; i < results.size(); i++) {
+        const RenderStatistics& statistics = results[i];
+        std::cout << integratorNames[i] << "\t"
+                << statistics.renderMilliseconds << "\t"
+                << statistics.rays << "\t"
+                << static_cast<double>(statistics.rays) / pixels << "\t"
+                << statistics.raysPerSecond() << "\t"
+                << statistics.pathStatistics.averageLength() << std::endl;
+    }
+}
+
+/**
+ * @brief renderProgressive accumulates passes until maxPasses are done, the time budget is spent or adaptive sampling
+ *        has stopped on every pixel, whichever comes first. A budget of 0 ms means no time limit.
+ *        The pass that crosses the budget is completed, so the budget may be exceeded by up to one pass.
+ */
+PassStatistics renderProgressive(Raytracer& raytracer, RGBAImage& image, unsigned int maxPasses, double budgetMilliseconds) {
+    PassStatistics statistics{};
+    unsigned long long rays = 0;
+
+    raytracer.startProgressive(image);
+
+    do {
+        statistics = raytracer.renderPass(image);
+        rays += statistics.rays;
+    } while (statistics.samples < maxPasses && statistics.sampledPixels > 0
+             && (budgetMilliseconds <= 0.0 || statistics.elapsedMilliseconds < budgetMilliseconds));
+
+    std::cout << std::endl
+            << "Done Progressive Raytracing: " << statistics.samples << " samples per pixel in "
+            << statistics.elapsedMilliseconds << " ms" << std::endl;
+
+    statistics.rays = rays;
+    return statistics;
+}
+
+/**
+ * @brief renderScaling renders the same frame with an increasing number of threads
+ *        and reports the speed-up and parallel efficiency with respect to a single thread
+ */
+void renderScaling(Raytracer& raytracer, RenderParameters& renderParameters, RGBAImage& image) {
+    std::vector<std::pair<int, RenderStatistics>> results;
+    const int maxThreads = static_cast<int>(renderParameters.threads);
+
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        renderParameters.threads = threads;
+        results.emplace_back(threads, raytracer.render(image));
+
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+
+    const double singleThreaded = results.front().second.renderMilliseconds;
+
+    std::cout << std::endl
+            << "Threads\tRender (ms)\tRays/s\tSpeed-up\tEfficiency" << std::endl;
+    for (const auto& [threads, statistics] : results) {
+        double speedUp = singleThreaded / statistics.renderMilliseconds;
+        std::cout << threads << "\t"
+                << statistics.renderMilliseconds << "\t"
+                << statistics.raysPerSecond() << "\t"
+                << speedUp << "\t"
+                << speedUp / threads << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    RenderParameters renderParameters;
+    long width = 800;
+    long height = 600;
+    bool scaling = false;
+    bool loaderBenchmark = false;
+    bool useCache = true;
+    bool kernelCheck = false;
+    bool packetBenchmark = false;
+    bool bvhBenchmark = false;
+    bool buildBenchmark = false;
+    bool varianceBenchmark = false;
+    bool integratorBenchmark = false;
+    bool hitBenchmark = false;
+    bool samplerBenchmark = false;
+    bool adaptiveBenchmark = false;
+    std::string heatmapPath;
+    std::vector<InstanceRow> instanceRows;
+    bool progressive = false;
+    unsigned int passes = std::numeric_limits<unsigned int>::max();
+    double timeBudget = 0.0;
+
+    for (int i = 4; i < argc; i++) {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        // cleared when the value of the option is not a number, or out of its range
+        bool validValue = true;
+        int count = 0;
+        float threshold = 0.0f;
+
+        if (option == "--width" && hasValue) {
+            validValue = parseNumber(argv[++i], width) && width > 0;
+        } else if (option == "--height" && hasValue) {
+            validValue = parseNumber(argv[++i], height) && height > 0;
+        } else if (option == "--interpolation") {
+            renderParameters.interpolationRendering = true;
+        } else if (option == "--shadows") {
+            renderParameters.shadowsEnabled = true;
+        } else if (option == "--fresnel") {
+            renderParameters.fresnelRendering = true;
+        } else if (option == "--monte-carlo") {
+            renderParameters.monteCarloEnabled = true;
+        } else if (option == "--area-lights") {
+            renderParameters.areaLightsEnabled = true;
+        } else if (option == "--orthographic") {
+            renderParameters.orthoProjection = true;
+        } else if (option == "--seed" && hasValue) {
+            validValue = parseNumber(argv[++i], renderParameters.seed);
+        } else if (option == "--mc-samples" && hasValue) {
+            validValue = parseNumber(argv[++i], count);
+            renderParameters.monteCarloSamples = std::max(1, count);
+        } else if (option == "--hemisphere" && hasValue) {
+            if (!parseHemisphereSampling(argv[++i], renderParameters.hemisphereSampling)) {
+                std::cout << "Unknown hemisphere sampling " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (option == "--sampler" && hasValue) {
+            if (!parseSampleSequence(argv[++i], renderParameters.sampleSequence)) {
+                std::cout << "Unknown sampler " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (option == "--adaptive" && hasValue) {
+            validValue = parseNumber(argv[++i], threshold);
+            renderParameters.adaptiveThreshold = std::max(0.0f, threshold);
+        } else if (option == "--adaptive-samples" && i + 2 < argc) {
+            int maxCount = 0;
+            validValue = parseNumber(argv[++i], count) && parseNumber(argv[++i], maxCount);
+            renderParameters.adaptiveMinSamples = std::max(1, count);
+            renderParameters.adaptiveMaxSamples = std::max(static_cast<int>(renderParameters.adaptiveMinSamples),
+                                                           maxCount);
+        } else if (option == "--sample-heatmap" && hasValue) {
+            heatmapPath = argv[++i];
+        } else if (option == "--integrator" && hasValue) {
+            if (!parseIntegrator(argv[++i], renderParameters.integrator)) {
+                std::cout << "Unknown integrator " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (option == "--bounces" && hasValue) {
+            validValue = parseNumber(argv[++i], count);
+            renderParameters.maxBounces = std::max(1, count);
+        } else if (option == "--roulette" && hasValue) {
+            validValue = parseNumber(argv[++i], threshold);
+            renderParameters.rouletteThreshold = std::max(0.0f, threshold);
+        } else if (option == "--threads" && hasValue) {
+            validValue = parseNumber(argv[++i], count);
+            renderParameters.threads = std::max(1, count);
+        } else if (option == "--tile-size" && hasValue) {
+            validValue = parseNumber(argv[++i], count);
+            renderParameters.tileSize = std::max(1, count);
+        } else if (option == "--scaling") {
+            scaling = true;
+        } else if (option == "--loader-benchmark") {
+            loaderBenchmark = true;
+        } else if (option == "--instances" && i + 5 < argc) {
+            InstanceRow row{};
+            validValue = parseNumber(argv[++i], row.object)
+                         && parseNumber(argv[++i], row.count)
+                         && parseNumber(argv[++i], row.offset.x)
+                         && parseNumber(argv[++i], row.offset.y)
+                         && parseNumber(argv[++i], row.offset.z);
+            instanceRows.push_back(row);
+        } else if (option == "--kernel" && hasValue) {
+            if (!parseKernel(argv[++i], renderParameters.intersectionKernel)) {
+                std::cout << "Unknown kernel " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (option == "--bvh" && hasValue) {
+            if (!parseLayout(argv[++i], renderParameters.bvhLayout)) {
+                std::cout << "Unknown BVH layout " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (option == "--builder" && hasValue) {
+            if (!parseBuilder(argv[++i], renderParameters.bvhBuilder)) {
+                std::cout << "Unknown BVH builder " << argv[i] << std::endl;
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (option == "--kernel-check") {
+            kernelCheck = true;
+        } else if (option == "--packet-benchmark") {
+            packetBenchmark = true;
+        } else if (option == "--bvh-benchmark") {
+            bvhBenchmark = true;
+        } else if (option == "--build-benchmark") {
+            buildBenchmark = true;
+        } else if (option == "--sampler-benchmark") {
+            samplerBenchmark = true;
+        } else if (option == "--adaptive-benchmark") {
+            adaptiveBenchmark = true;
+        } else if (option == "--integrator-benchmark") {
+            integratorBenchmark = true;
+        } else if (option == "--hit-benchmark") {
+            hitBenchmark = true;
+        } else if (option == "--variance-benchmark") {
+            varianceBenchmark = true;
+        } else if (option == "--no-cache") {
+            useCache = false;
+        } else if (option == "--bvh-cache" && hasValue) {
+            renderParameters.bvhCacheDirectory = argv[++i];
+        } else if (option == "--passes" && hasValue) {
+            progressive = true;
+            validValue = parseNumber(argv[++i], count);
+            passes = std::max(1, count);
+        } else if (option == "--time-budget" && hasValue) {
+            progressive = true;
+            validValue = parseNumber(argv[++i], timeBudget) && timeBudget >= 0.0;
+        } else {
+            std::cout << "Unknown option " << option << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        if (!validValue) {
+            std::cout << "Invalid value for " << option << std::endl;
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!useCache && !renderParameters.bvhCacheDirectory.empty()) {
+        std::cout << "--no-cache and --bvh-cache cannot be combined" << std::endl;
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // read input files for the geometry & material
+    std::ifstream geometryFile(argv[1]);
+    std::ifstream materialFile(argv[2]);
+
+    if (!geometryFile.good() || !materialFile.good()) {
+        std::cout << "Read failed for object " << argv[1] << " or material " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (loaderBenchmark) {
+        return benchmarkLoader(argv[1], argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (useCache && renderParameters.bvhCacheDirectory.empty()) {
+        renderParameters.bvhCacheDirectory = BVHCache::directoryFor(argv[1]);
+    }
+
+    std::vector<ThreeDModel> texturedObjects = useCache
+                                                   ? ThreeDModel::readObjectFileCached(argv[1], argv[2])
+                                                   : ThreeDModel::readObjectFileMaterial(argv[1], materialFile);
+
+    if (texturedObjects.empty()) {
+        std::cout << "Read failed for object " << argv[1] << " or material " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ThreeDModel::printMemoryReport(texturedObjects);
+
+    if (kernelCheck) {
+        return checkKernels(texturedObjects, renderParameters.seed) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (packetBenchmark) {
+        return benchmarkPackets(texturedObjects, renderParameters.seed) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (bvhBenchmark) {
+        return benchmarkBVH(texturedObjects, renderParameters.intersectionKernel, renderParameters.bvhBuilder,
+                            renderParameters.seed) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (buildBenchmark) {
+        return benchmarkBuilders(texturedObjects, renderParameters.intersectionKernel, renderParameters.bvhLayout,
+                                 renderParameters.seed) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    renderParameters.findLights(texturedObjects);
+
+    RGBAImage image;
+    if (!image.resize(width, height)) {
+        std::cout << "Cannot create an image of " << width << " x " << height << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Raytracer raytracer(&texturedObjects, &renderParameters);
+
+    for (const InstanceRow& row : instanceRows) {
+        if (row.object >= texturedObjects.size()) {
+            std::cout << "No model " << row.object << " to instance, there are " << texturedObjects.size() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for (unsigned int k = 1; k <= row.count; k++) {
+            glm::vec3 translation = static_cast<float>(k) * row.offset;
+            raytracer.scene.addInstance(row.object, glm::translate(glm::identity<glm::mat4>(), translation));
+        }
+    }
+
+    if (samplerBenchmark) {
+        const unsigned int maxSamples = passes == std::numeric_limits<unsigned int>::max()
+                                            ? SAMPLER_BENCHMARK_SAMPLES
+                                            : passes;
+        return benchmarkSamplers(raytracer, renderParameters, image, maxSamples) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (adaptiveBenchmark) {
+        return benchmarkAdaptive(raytracer, renderParameters, image) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (integratorBenchmark) {
+        benchmarkIntegrators(raytracer, renderParameters, image);
+        return EXIT_SUCCESS;
+    }
+
+    if (hitBenchmark) {
+        benchmarkHits(raytracer, image);
+        return EXIT_SUCCESS;
+    }
+
+    if (varianceBenchmark) {
+        const unsigned int benchmarkPasses = passes == std::numeric_limits<unsigned int>::max()
+                                                 ? VARIANCE_BENCHMARK_PASSES
+                                                 : std::max(2u, passes);
+        return benchmarkSampling(raytracer, renderParameters, image, benchmarkPasses) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Lay the sample sequence out for the passes of the progressive render
+    if (progressive && passes != std::numeric_limits<unsigned int>::max()) {
+        renderParameters.sequenceSamples = passes;
+    }
+
+    RenderStatistics statistics{};
+    if (scaling) {
+        renderScaling(raytracer, renderParameters, image);
+    } else if (progressive) {
+        PassStatistics passStatistics = renderProgressive(raytracer, image, passes, timeBudget);
+        statistics.rays = passStatistics.rays;
+        statistics.renderMilliseconds = passStatistics.elapsedMilliseconds;
+    } else {
+        statistics = raytracer.render(image);
+    }
+
+    if (!writeImage(image, argv[3])) {
+        std::cout << "Write failed for image " << argv[3] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!heatmapPath.empty()) {
+        const AccumulationBuffer& accumulation = raytracer.accumulated();
+        const unsigned int maxSamples = renderParameters.adaptiveThreshold > 0.0f
+                                            ? renderParameters.adaptiveMaxSamples
+                                            : std::max(1u, accumulation.sampleCount(0, 0));
+        accumulation.sampleHeatmap(image, maxSamples);
+
+        if (!writeImage(image, heatmapPath)) {
+            std::cout << "Write failed for image " << heatmapPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Wrote sample heatmap " << heatmapPath << ", red for " << maxSamples << " samples" << std::endl;
+    }
+
+    std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start;
+
+    std::cout << std::endl
+            << "Wrote " << argv[3] << " (" << width << " x " << height << ")" << std::endl
+            << "Total time: " << total.count() << " ms" << std::endl;
+    if (!scaling) {
+        std::cout << "Rays: " << statistics.rays << ", " << statistics.raysPerSecond() << " rays/s" << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 
+#include "BVHCache.h"
 #include "RenderController.h"
 #include "RenderParameters.h"
 #include "RenderWindow.h"
@@ -30,7 +31,7 @@ int main(int argc, char** argv) {
     std::vector<ThreeDModel> texturedObjects;
     // if is actually passing a material. This will trigger the modified obj read code.
     if (std::string s = argv[2]; s.find(".mtl") != std::string::npos) {
-        texturedObjects = ThreeDModel::readObjectStreamMaterial(geometryFile, textureFile);
+        texturedObjects = ThreeDModel::readObjectFileCached(argv[1], argv[2]);
     } else {
         std::cout << "Second file is not a material file!" << std::endl;
         return 0;
@@ -41,8 +42,12 @@ int main(int argc, char** argv) {
         return 0;
     }
 
+    ThreeDModel::printMemoryReport(texturedObjects);
+
     // Execute application
     RenderParameters renderParameters;
+    // Cached next to the .obj file as by the CLI, so that relaunching does not build every hierarchy again
+    renderParameters.bvhCacheDirectory = BVHCache::directoryFor(argv[1]);
 
     renderParameters.findLights(texturedObjects);
 